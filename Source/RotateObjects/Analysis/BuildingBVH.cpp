@@ -0,0 +1,432 @@
+#include "BuildingBVH.h"
+#include "../RotateObjects.h"
+#include "Algo/Partition.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+
+DECLARE_CYCLE_STAT(TEXT("Building BVH Build"), STAT_BuildingBVHBuild, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Building BVH Refit"), STAT_BuildingBVHRefit, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Building BVH Raycast"), STAT_BuildingBVHRaycast, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Building BVH Subtrees Rebuilt"), STAT_BuildingBVHSubtreesRebuilt, STATGROUP_LuminaCity);
+
+namespace BuildingBVH
+{
+	static float HalfArea(const FVector3f& Min, const FVector3f& Max)
+	{
+		const FVector3f D = Max - Min;
+		return D.X * D.Y + D.Y * D.Z + D.Z * D.X;
+	}
+}
+
+void FBuildingBVH::SetPlacementTransform(FPlacement& Placement, const FTransform& Transform) const
+{
+	//relative to the origin before converting to floats, like the scene BVH
+	FTransform Relative = Transform;
+	Relative.AddToTranslation(-Origin);
+	Placement.WorldToMesh = FMatrix44f(Relative.ToMatrixWithScale().Inverse());
+
+	FVector3f MeshMin, MeshMax;
+	Placement.Mesh->GetBounds(MeshMin, MeshMax);
+
+	Placement.Min = FVector3f(MAX_flt);
+	Placement.Max = FVector3f(-MAX_flt);
+	for (int32 Corner = 0; Corner < 8; ++Corner)
+	{
+		const FVector Local((Corner & 1) ? MeshMax.X : MeshMin.X, (Corner & 2) ? MeshMax.Y : MeshMin.Y, (Corner & 4) ? MeshMax.Z : MeshMin.Z);
+		const FVector3f Position(Relative.TransformPosition(Local));
+		Placement.Min = Placement.Min.ComponentMin(Position);
+		Placement.Max = Placement.Max.ComponentMax(Position);
+	}
+}
+
+void FBuildingBVH::BuildFromWorld(UWorld* World, const TArray<AActor*>& IgnoredActors, int32 InLODIndex, FBuildingMeshCache* MeshCache)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BuildingBVHBuild);
+
+	Nodes.Reset();
+	Parents.Reset();
+	BuildAreas.Reset();
+	Placements.Reset();
+	ComponentPlacements.Reset();
+	MovedLeaves.Reset();
+	NumMeshes = 0;
+	LODIndex = InLODIndex;
+
+	if (!World) return;
+
+	//placements in world space first, the origin is the center of all of them
+	struct FGathered
+	{
+		UStaticMeshComponent* Component;
+		int32 Item;
+		FTransform Transform;
+	};
+	TArray<FGathered> Gathered;
+	FBox WorldBounds(ForceInit);
+
+	for (TActorIterator<AActor> It(World); It; ++It)
+	{
+		AActor* Actor = *It;
+		if (IgnoredActors.Contains(Actor)) continue;
+
+		TInlineComponentArray<UStaticMeshComponent*> Components(Actor);
+		for (UStaticMeshComponent* Component : Components)
+		{
+			if (!Component->GetStaticMesh() || !Component->IsVisible() || !Component->CastShadow) continue;
+
+			if (const UInstancedStaticMeshComponent* Instanced = Cast<UInstancedStaticMeshComponent>(Component))
+			{
+				for (int32 i = 0; i < Instanced->GetInstanceCount(); ++i)
+				{
+					FTransform InstanceTransform;
+					if (Instanced->GetInstanceTransform(i, InstanceTransform, true))
+					{
+						Gathered.Add({ Component, i, InstanceTransform });
+						WorldBounds += InstanceTransform.GetLocation();
+					}
+				}
+			}
+			else
+			{
+				Gathered.Add({ Component, INDEX_NONE, Component->GetComponentTransform() });
+				WorldBounds += Component->GetComponentLocation();
+			}
+		}
+	}
+
+	Origin = WorldBounds.IsValid ? WorldBounds.GetCenter() : FVector::ZeroVector;
+
+	FBuildingMeshCache LocalCache;
+	FBuildingMeshCache& Meshes = MeshCache ? *MeshCache : LocalCache;
+	TSet<const FSceneBVH*> UsedMeshes;
+
+	for (const FGathered& Entry : Gathered)
+	{
+		//one mesh BVH per mesh and LOD, shared by every placement
+		const UStaticMesh* Mesh = Entry.Component->GetStaticMesh();
+		TSharedPtr<const FSceneBVH, ESPMode::ThreadSafe>& MeshBVH = Meshes.FindOrAdd(MakeTuple(FObjectKey(Mesh), LODIndex));
+		if (!MeshBVH.IsValid())
+		{
+			TArray<FVector3f> Vertices;
+			FSceneBVH::GatherMeshTriangles(Mesh, LODIndex, Vertices);
+			TSharedPtr<FSceneBVH, ESPMode::ThreadSafe> NewBVH = MakeShared<FSceneBVH, ESPMode::ThreadSafe>();
+			NewBVH->Build(MoveTemp(Vertices), FVector::ZeroVector);
+			MeshBVH = NewBVH;
+		}
+		if (MeshBVH->IsEmpty()) continue;
+
+		UsedMeshes.Add(MeshBVH.Get());
+		FPlacement& Placement = Placements.AddDefaulted_GetRef();
+		Placement.Mesh = MeshBVH;
+		Placement.Component = Entry.Component;
+		Placement.Item = Entry.Item;
+		SetPlacementTransform(Placement, Entry.Transform);
+		ComponentPlacements.FindOrAdd(FObjectKey(Entry.Component)).Add(Placements.Num() - 1);
+	}
+
+	NumMeshes = UsedMeshes.Num();
+
+	const int32 NumPlacements = Placements.Num();
+	if (NumPlacements == 0) return;
+
+	Nodes.SetNum(2 * NumPlacements - 1);
+	Parents.Init(INDEX_NONE, Nodes.Num());
+	BuildAreas.SetNumZeroed(Nodes.Num());
+
+	//node 0 is the root, every following pair is free for the build
+	TArray<int32> Pairs;
+	for (int32 Pair = 1; Pair < Nodes.Num(); Pair += 2)
+		Pairs.Add(Pair);
+
+	TArray<int32> PlacementIndices;
+	PlacementIndices.SetNumUninitialized(NumPlacements);
+	for (int32 i = 0; i < NumPlacements; ++i)
+		PlacementIndices[i] = i;
+
+	BuildSubtree(0, PlacementIndices, Pairs);
+}
+
+void FBuildingBVH::BuildSubtree(int32 Root, TArray<int32>& PlacementIndices, TArray<int32>& Pairs)
+{
+	struct FBuildTask
+	{
+		int32 Node;
+		int32 First;
+		int32 Count;
+	};
+
+	TArray<FBuildTask, TInlineAllocator<64>> Stack;
+	Stack.Add({ Root, 0, PlacementIndices.Num() });
+
+	while (Stack.Num() > 0)
+	{
+		const FBuildTask Task = Stack.Pop(false);
+		FSceneBVH::FNode& Node = Nodes[Task.Node];
+
+		FVector3f Min(MAX_flt), Max(-MAX_flt), CentroidMin(MAX_flt), CentroidMax(-MAX_flt);
+		for (int32 i = Task.First; i < Task.First + Task.Count; ++i)
+		{
+			const FPlacement& Placement = Placements[PlacementIndices[i]];
+			Min = Min.ComponentMin(Placement.Min);
+			Max = Max.ComponentMax(Placement.Max);
+			const FVector3f Centroid = (Placement.Min + Placement.Max) * 0.5f;
+			CentroidMin = CentroidMin.ComponentMin(Centroid);
+			CentroidMax = CentroidMax.ComponentMax(Centroid);
+		}
+		Node.Min = Min;
+		Node.Max = Max;
+		BuildAreas[Task.Node] = BuildingBVH::HalfArea(Min, Max);
+
+		if (Task.Count == 1)
+		{
+			const int32 PlacementIndex = PlacementIndices[Task.First];
+			Node.LeftOrFirst = PlacementIndex;
+			Node.NumTriangles = 1;
+			Placements[PlacementIndex].Leaf = Task.Node;
+			continue;
+		}
+
+		//buildings are spread out over a site, a spatial median on the widest axis splits them well
+		const FVector3f Extent = CentroidMax - CentroidMin;
+		const int32 Axis = Extent.X >= Extent.Y && Extent.X >= Extent.Z ? 0 : (Extent.Y >= Extent.Z ? 1 : 2);
+		const float Split = 0.5f * (CentroidMin[Axis] + CentroidMax[Axis]);
+		const int32 NumLeft = Algo::Partition(PlacementIndices.GetData() + Task.First, Task.Count, [&](int32 p)
+		{
+			return Placements[p].Min[Axis] + Placements[p].Max[Axis] < 2.f * Split;
+		});
+		const int32 Mid = Task.First + (NumLeft > 0 && NumLeft < Task.Count ? NumLeft : Task.Count / 2);
+
+		const int32 Left = Pairs.Pop(false);
+		Node.LeftOrFirst = Left;
+		Node.NumTriangles = 0;
+		Parents[Left] = Task.Node;
+		Parents[Left + 1] = Task.Node;
+
+		Stack.Add({ Left, Task.First, Mid - Task.First });
+		Stack.Add({ Left + 1, Mid, Task.First + Task.Count - Mid });
+	}
+}
+
+bool FBuildingBVH::UpdateComponent(const UPrimitiveComponent* Component)
+{
+	const TArray<int32, TInlineAllocator<1>>* Indices = Component ? ComponentPlacements.Find(FObjectKey(Component)) : nullptr;
+	if (!Indices) return true;
+
+	const UInstancedStaticMeshComponent* Instanced = Cast<UInstancedStaticMeshComponent>(Component);
+	if (Instanced && Instanced->GetInstanceCount() != Indices->Num()) return false;
+
+	for (int32 PlacementIndex : *Indices)
+	{
+		FPlacement& Placement = Placements[PlacementIndex];
+		FTransform Transform = Component->GetComponentTransform();
+		if (Instanced && !Instanced->GetInstanceTransform(Placement.Item, Transform, true)) return false;
+
+		SetPlacementTransform(Placement, Transform);
+		MovedLeaves.Add(Placement.Leaf);
+	}
+	return true;
+}
+
+void FBuildingBVH::RemoveComponent(const FObjectKey& Component)
+{
+	TArray<int32, TInlineAllocator<1>> Indices;
+	if (!ComponentPlacements.RemoveAndCopyValue(Component, Indices)) return;
+
+	for (int32 PlacementIndex : Indices)
+	{
+		//the leaf stays in the tree until the next build, a point has no area for the refit
+		FPlacement& Placement = Placements[PlacementIndex];
+		Placement.Mesh.Reset();
+		Placement.Component.Reset();
+		Placement.Min = Placement.Max = (Placement.Min + Placement.Max) * 0.5f;
+		MovedLeaves.Add(Placement.Leaf);
+	}
+}
+
+void FBuildingBVH::Refit()
+{
+	SCOPE_CYCLE_COUNTER(STAT_BuildingBVHRefit);
+
+	if (MovedLeaves.Num() == 0) return;
+
+	//walk up from every moved leaf, remembering the highest node that degraded on the way
+	TSet<int32> Degraded;
+	for (int32 Leaf : MovedLeaves)
+	{
+		const FPlacement& Placement = Placements[Nodes[Leaf].LeftOrFirst];
+		Nodes[Leaf].Min = Placement.Min;
+		Nodes[Leaf].Max = Placement.Max;
+
+		int32 Highest = INDEX_NONE;
+		for (int32 Node = Parents[Leaf]; Node != INDEX_NONE; Node = Parents[Node])
+		{
+			const FSceneBVH::FNode& Left = Nodes[Nodes[Node].LeftOrFirst];
+			const FSceneBVH::FNode& Right = Nodes[Nodes[Node].LeftOrFirst + 1];
+			Nodes[Node].Min = Left.Min.ComponentMin(Right.Min);
+			Nodes[Node].Max = Left.Max.ComponentMax(Right.Max);
+
+			if (BuildingBVH::HalfArea(Nodes[Node].Min, Nodes[Node].Max) > RebuildAreaRatio * BuildAreas[Node])
+				Highest = Node;
+		}
+		if (Highest != INDEX_NONE)
+			Degraded.Add(Highest);
+	}
+	MovedLeaves.Reset();
+
+	for (int32 Root : Degraded)
+	{
+		//inside another degraded subtree, rebuilt with it
+		bool bNested = false;
+		for (int32 Node = Parents[Root]; Node != INDEX_NONE && !bNested; Node = Parents[Node])
+			bNested = Degraded.Contains(Node);
+		if (bNested) continue;
+
+		//the subtree keeps its nodes: its placements and inner node pairs are rebuilt onto themselves
+		TArray<int32> PlacementIndices;
+		TArray<int32> Pairs;
+		TArray<int32, TInlineAllocator<64>> Stack;
+		Stack.Add(Root);
+		while (Stack.Num() > 0)
+		{
+			const FSceneBVH::FNode& Node = Nodes[Stack.Pop(false)];
+			if (Node.IsLeaf())
+			{
+				PlacementIndices.Add(Node.LeftOrFirst);
+				continue;
+			}
+			Pairs.Add(Node.LeftOrFirst);
+			Stack.Add(Node.LeftOrFirst);
+			Stack.Add(Node.LeftOrFirst + 1);
+		}
+
+		BuildSubtree(Root, PlacementIndices, Pairs);
+		INC_DWORD_STAT(STAT_BuildingBVHSubtreesRebuilt);
+	}
+}
+
+void FBuildingBVH::ToMeshSpace(const FPlacement& Placement, const FVector3f& O, const FVector3f& D, FVector3f& OutO, FVector3f& OutD)
+{
+	//not normalized, so that distances along the ray stay the same in both spaces
+	OutO = FVector3f(Placement.WorldToMesh.TransformPosition(O));
+	OutD = FVector3f(Placement.WorldToMesh.TransformVector(D));
+}
+
+int32 FBuildingBVH::Occluded4(const FRayPacket4& Packet) const
+{
+	if (Nodes.Num() == 0 || Packet.ActiveMask == 0) return 0;
+
+	float OX[4], OY[4], OZ[4], DX[4], DY[4], DZ[4];
+	VectorStore(Packet.OriginX, OX);
+	VectorStore(Packet.OriginY, OY);
+	VectorStore(Packet.OriginZ, OZ);
+	VectorStore(Packet.DirX, DX);
+	VectorStore(Packet.DirY, DY);
+	VectorStore(Packet.DirZ, DZ);
+
+	int32 Occluded = 0;
+	TArray<int32, TInlineAllocator<64>> Stack;
+	Stack.Add(0);
+
+	while (Stack.Num() > 0)
+	{
+		const FSceneBVH::FNode& Node = Nodes[Stack.Pop(false)];
+
+		const int32 Hit = Packet.IntersectBox(Node.Min, Node.Max) & ~Occluded;
+		if (!Hit) continue;
+
+		if (Node.IsLeaf())
+		{
+			const FPlacement& Placement = Placements[Node.LeftOrFirst];
+			if (!Placement.Mesh.IsValid()) continue;
+
+			FVector3f Origins[4], Directions[4];
+			for (int32 Lane = 0; Lane < 4; ++Lane)
+				ToMeshSpace(Placement, FVector3f(OX[Lane], OY[Lane], OZ[Lane]), FVector3f(DX[Lane], DY[Lane], DZ[Lane]), Origins[Lane], Directions[Lane]);
+
+			FRayPacket4 MeshPacket;
+			MeshPacket.Set(Origins, Directions, 4, 0.f);
+			MeshPacket.TMax = Packet.TMax;
+			MeshPacket.ActiveMask = Hit;
+
+			Occluded |= Placement.Mesh->Occluded4(MeshPacket);
+			if (Occluded == Packet.ActiveMask)
+				return Occluded;
+		}
+		else
+		{
+			Stack.Add(Node.LeftOrFirst + 1);
+			Stack.Add(Node.LeftOrFirst);
+		}
+	}
+
+	return Occluded;
+}
+
+bool FBuildingBVH::Raycast(const FVector& Start, const FVector& End, FBuildingHit& OutHit, const TArray<AActor*>& IgnoredActors) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_BuildingBVHRaycast);
+
+	if (Nodes.Num() == 0) return false;
+
+	const FVector Delta = End - Start;
+	const float Length = Delta.Size();
+	if (Length <= KINDA_SMALL_NUMBER) return false;
+
+	const FVector3f O = ToLocal(Start);
+	const FVector3f D = FVector3f(Delta / Length);
+
+	FRayPacket4 Packet;
+	Packet.Set(&O, &D, 1, Length);
+
+	float TMax = Length;
+	int32 HitPlacement = INDEX_NONE;
+	FVector3f HitNormal = FVector3f::UpVector;
+
+	TArray<int32, TInlineAllocator<64>> Stack;
+	Stack.Add(0);
+	while (Stack.Num() > 0)
+	{
+		const FSceneBVH::FNode& Node = Nodes[Stack.Pop(false)];
+
+		//the packet's TMax shrinks to the closest hit so far
+		if (!Packet.IntersectBox(Node.Min, Node.Max)) continue;
+
+		if (!Node.IsLeaf())
+		{
+			Stack.Add(Node.LeftOrFirst + 1);
+			Stack.Add(Node.LeftOrFirst);
+			continue;
+		}
+
+		const FPlacement& Placement = Placements[Node.LeftOrFirst];
+		const UPrimitiveComponent* Component = Placement.Component.Get();
+		if (!Component || !Placement.Mesh.IsValid() || (IgnoredActors.Num() > 0 && IgnoredActors.Contains(Component->GetOwner()))) continue;
+
+		FVector3f MeshOrigin, MeshDirection;
+		ToMeshSpace(Placement, O, D, MeshOrigin, MeshDirection);
+
+		float Distance;
+		FVector3f Normal;
+		if (Placement.Mesh->Raycast(MeshOrigin, MeshDirection, TMax, Distance, Normal))
+		{
+			TMax = Distance;
+			Packet.TMax = VectorSetFloat1(TMax);
+			HitPlacement = Node.LeftOrFirst;
+
+			//normals go back with the inverse transpose
+			HitNormal = FVector3f(Placement.WorldToMesh.GetTransposed().TransformVector(Normal));
+		}
+	}
+
+	if (HitPlacement == INDEX_NONE) return false;
+
+	OutHit.Component = Placements[HitPlacement].Component;
+	OutHit.Item = Placements[HitPlacement].Item;
+	OutHit.Distance = TMax;
+	OutHit.Location = Start + FVector(D) * TMax;
+	OutHit.Normal = FVector(HitNormal.GetSafeNormal());
+	return true;
+}
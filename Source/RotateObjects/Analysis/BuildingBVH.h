@@ -0,0 +1,129 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SceneBVH.h"
+#include "UObject/ObjectKey.h"
+
+class UPrimitiveComponent;
+
+//Bottom level BVHs by static mesh and LOD, kept across builds by the owner of the Building BVH
+using FBuildingMeshCache = TMap<TPair<FObjectKey, int32>, TSharedPtr<const FSceneBVH, ESPMode::ThreadSafe>>;
+
+//Closest hit of a ray with a building of an FBuildingBVH
+struct FBuildingHit
+{
+	TWeakObjectPtr<UPrimitiveComponent> Component;
+
+	// Instance of an instanced static mesh component, INDEX_NONE for other components
+	int32 Item = INDEX_NONE;
+
+	// From the start of the ray, in cm
+	float Distance = 0.f;
+
+	FVector Location = FVector::ZeroVector;
+	FVector Normal = FVector::UpVector;
+};
+
+/**
+ * Two level BVH over the placed building meshes of a world, for picking and for shadow rays.
+ *
+ * The bottom level is one FSceneBVH per static mesh (and LOD) in mesh space, shared by every placement of the mesh.
+ * The top level has one leaf per placement (a component or an instance of an instanced component) with its transform,
+ * all nodes in one array (2 * placements - 1 of them, the children of a node are next to each other).
+ *
+ * Moving a component does not touch the meshes: UpdateComponent takes its new transforms and Refit walks up from
+ * their leaves. A subtree whose bounds grew by more than RebuildAreaRatio since it was built is rebuilt in place, on its own nodes.
+ * Copies share the bottom level, a copy is a cheap snapshot for work on other threads.
+ */
+class ROTATEOBJECTS_API FBuildingBVH : public ISceneOccluder
+{
+public:
+
+	// A subtree is rebuilt once the surface area of its bounds grew by this factor
+	static constexpr float RebuildAreaRatio = 2.f;
+
+	/**
+	 * Collects every visible, shadow casting static mesh component (and instance) of the world and builds both levels.
+	 * Meshes without CPU side data (cooked without Allow CPU Access) are skipped.
+	 * Mesh BVHs found in MeshCache are reused, the ones built are added to it.
+	 */
+	void BuildFromWorld(UWorld* World, const TArray<AActor*>& IgnoredActors = TArray<AActor*>(), int32 InLODIndex = 0
+		, FBuildingMeshCache* MeshCache = nullptr);
+
+	/**
+	 * Takes the current transforms of the placements of Component, the tree is updated by the next Refit.
+	 * Components that are not in the BVH are ignored.
+	 * @return false if instances of the component were added or removed, i.e. a rebuild is needed
+	 */
+	bool UpdateComponent(const UPrimitiveComponent* Component);
+
+	/**
+	 * Removes the placements of a destroyed component: queries skip them from now on,
+	 * their leaves shrink to a point on the next Refit and are dropped by the next build.
+	 */
+	void RemoveComponent(const FObjectKey& Component);
+
+	// Refits the nodes above the placements updated since the last call, rebuilding subtrees that degraded
+	void Refit();
+
+	/**
+	 * Closest building hit between two world locations.
+	 * Only valid on the Game Thread, IgnoredActors are checked on the components hit.
+	 */
+	bool Raycast(const FVector& Start, const FVector& End, FBuildingHit& OutHit, const TArray<AActor*>& IgnoredActors = TArray<AActor*>()) const;
+
+	virtual int32 Occluded4(const FRayPacket4& Packet) const override;
+	virtual const FVector& GetOrigin() const override { return Origin; }
+
+	bool IsEmpty() const { return Nodes.Num() == 0; }
+	int32 GetNumPlacements() const { return Placements.Num(); }
+	int32 GetNumNodes() const { return Nodes.Num(); }
+	int32 GetNumMeshes() const { return NumMeshes; }
+
+private:
+
+	struct FPlacement
+	{
+		// Null once the component was removed
+		TSharedPtr<const FSceneBVH, ESPMode::ThreadSafe> Mesh;
+
+		// Relative to Origin
+		FMatrix44f WorldToMesh;
+		FVector3f Min;
+		FVector3f Max;
+
+		TWeakObjectPtr<UPrimitiveComponent> Component;
+		int32 Item = INDEX_NONE;
+
+		// Leaf node of the placement
+		int32 Leaf = INDEX_NONE;
+	};
+
+	// Sets the transform and bounds of a placement from a world transform
+	void SetPlacementTransform(FPlacement& Placement, const FTransform& Transform) const;
+
+	// Builds the tree over PlacementIndices into Root and the node pairs of Pairs (first node of each pair), one leaf per placement
+	void BuildSubtree(int32 Root, TArray<int32>& PlacementIndices, TArray<int32>& Pairs);
+
+	// Ray from Origin relative O with direction D into the mesh space of a placement
+	static void ToMeshSpace(const FPlacement& Placement, const FVector3f& O, const FVector3f& D, FVector3f& OutO, FVector3f& OutD);
+
+	// For leaves LeftOrFirst is the placement and NumTriangles 1
+	TArray<FSceneBVH::FNode> Nodes;
+	TArray<int32> Parents;
+
+	// Surface area of every node when its subtree was (re)built
+	TArray<float> BuildAreas;
+
+	TArray<FPlacement> Placements;
+	TMap<FObjectKey, TArray<int32, TInlineAllocator<1>>> ComponentPlacements;
+
+	// Distinct meshes the placements use
+	int32 NumMeshes = 0;
+
+	// Leaves moved since the last Refit
+	TArray<int32> MovedLeaves;
+
+	FVector Origin = FVector::ZeroVector;
+	int32 LODIndex = 0;
+};
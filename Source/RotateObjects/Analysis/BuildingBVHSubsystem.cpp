@@ -0,0 +1,178 @@
+#include "BuildingBVHSubsystem.h"
+#include "SensorGrid.h"
+#include "../RotateObjects.h"
+#include "../Gizmos/BaseGizmo.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "HAL/PlatformTime.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Building BVH Copies"), STAT_BuildingBVHCopies, STATGROUP_LuminaCity);
+
+UBuildingBVHSubsystem::UBuildingBVHSubsystem()
+{
+	LODIndex = 0;
+	bRebuild = true;
+}
+
+void UBuildingBVHSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	if (UWorld* World = GetWorld())
+	{
+		ActorSpawnedHandle = World->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &UBuildingBVHSubsystem::HandleActorSpawned));
+		ActorDestroyedHandle = World->AddOnActorDestroyedHandler(FOnActorDestroyed::FDelegate::CreateUObject(this, &UBuildingBVHSubsystem::HandleActorDestroyed));
+	}
+}
+
+void UBuildingBVHSubsystem::Deinitialize()
+{
+	if (UWorld* World = GetWorld())
+	{
+		World->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+		World->RemoveOnActorDestroyedHandler(ActorDestroyedHandle);
+	}
+
+	BVH.Reset();
+	MovedComponents.Reset();
+	SpawnedActors.Reset();
+	MeshCache.Reset();
+	Super::Deinitialize();
+}
+
+bool UBuildingBVHSubsystem::IsIgnored(const AActor* Actor)
+{
+	return Actor && (Actor->IsA<ASensorGrid>() || Actor->IsA<ABaseGizmo>());
+}
+
+void UBuildingBVHSubsystem::HandleActorSpawned(AActor* Actor)
+{
+	if (Actor && !IsIgnored(Actor) && !bRebuild)
+		SpawnedActors.Add(Actor);
+}
+
+void UBuildingBVHSubsystem::HandleActorDestroyed(AActor* Actor)
+{
+	if (!Actor || IsIgnored(Actor) || bRebuild) return;
+
+	TInlineComponentArray<UStaticMeshComponent*> Components(Actor);
+	for (UStaticMeshComponent* Component : Components)
+		AddMovedComponent(Component);
+}
+
+void UBuildingBVHSubsystem::AddMovedComponent(UPrimitiveComponent* Component)
+{
+	MovedComponents.Add(FObjectKey(Component), Component);
+}
+
+void UBuildingBVHSubsystem::Rebuild()
+{
+	bRebuild = true;
+}
+
+void UBuildingBVHSubsystem::NotifyComponentMoved(USceneComponent* Component)
+{
+	if (!Component || bRebuild) return;
+
+	if (UPrimitiveComponent* Primitive = Cast<UPrimitiveComponent>(Component))
+		AddMovedComponent(Primitive);
+
+	TArray<USceneComponent*> Children;
+	Component->GetChildrenComponents(true, Children);
+	for (USceneComponent* Child : Children)
+	{
+		if (UPrimitiveComponent* Primitive = Cast<UPrimitiveComponent>(Child))
+			AddMovedComponent(Primitive);
+	}
+}
+
+TSharedPtr<const FBuildingBVH, ESPMode::ThreadSafe> UBuildingBVHSubsystem::GetBVH()
+{
+	//projectiles, pawns and the like without a static mesh are not buildings
+	for (const TWeakObjectPtr<AActor>& Actor : SpawnedActors)
+	{
+		if (Actor.IsValid() && Actor->FindComponentByClass<UStaticMeshComponent>())
+			bRebuild = true;
+	}
+	SpawnedActors.Reset();
+
+	if (!BVH.IsValid() || bRebuild)
+	{
+		TArray<AActor*> IgnoredActors;
+		if (UWorld* World = GetWorld())
+		{
+			for (TActorIterator<AActor> It(World); It; ++It)
+			{
+				if (IsIgnored(*It))
+					IgnoredActors.Add(*It);
+			}
+		}
+
+		//a new object, background work may still hold the old one
+		const double StartTime = FPlatformTime::Seconds();
+		BVH = MakeShared<FBuildingBVH, ESPMode::ThreadSafe>();
+		BVH->BuildFromWorld(GetWorld(), IgnoredActors, LODIndex, &MeshCache);
+		UE_LOG(LogLuminaCity, Log, TEXT("Building BVH: %d placements of %d meshes, %d nodes, %.2f s")
+			, BVH->GetNumPlacements(), BVH->GetNumMeshes(), BVH->GetNumNodes(), FPlatformTime::Seconds() - StartTime);
+
+		bRebuild = false;
+		MovedComponents.Reset();
+		return BVH;
+	}
+
+	if (MovedComponents.Num() > 0)
+	{
+		//copy on write, snapshots in use elsewhere stay as they are
+		if (!BVH.IsUnique())
+		{
+			BVH = MakeShared<FBuildingBVH, ESPMode::ThreadSafe>(*BVH);
+			INC_DWORD_STAT(STAT_BuildingBVHCopies);
+		}
+
+		bool bUpdated = true;
+		for (const TPair<FObjectKey, TWeakObjectPtr<UPrimitiveComponent>>& Moved : MovedComponents)
+		{
+			//destroyed since it was reported, or unregistered by a destroy in progress
+			const UPrimitiveComponent* Component = Moved.Value.Get();
+			if (!IsValid(Component) || !Component->IsRegistered())
+			{
+				BVH->RemoveComponent(Moved.Key);
+				continue;
+			}
+
+			if (!BVH->UpdateComponent(Component))
+			{
+				bUpdated = false;
+				break;
+			}
+		}
+		MovedComponents.Reset();
+
+		if (!bUpdated)
+		{
+			bRebuild = true;
+			return GetBVH();
+		}
+		BVH->Refit();
+	}
+
+	return BVH;
+}
+
+bool UBuildingBVHSubsystem::LineTrace(const FVector& Start, const FVector& End, FHitResult& OutHit, const TArray<AActor*>& IgnoredActors)
+{
+	FBuildingHit Hit;
+	if (!GetBVH()->Raycast(Start, End, Hit, IgnoredActors))
+		return false;
+
+	UPrimitiveComponent* Component = Hit.Component.Get();
+	OutHit = FHitResult(Component ? Component->GetOwner() : nullptr, Component, Hit.Location, Hit.Normal);
+	OutHit.TraceStart = Start;
+	OutHit.TraceEnd = End;
+	OutHit.Distance = Hit.Distance;
+	OutHit.Time = Hit.Distance / FVector::Distance(Start, End);
+	OutHit.Item = Hit.Item;
+	OutHit.bBlockingHit = true;
+	return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BuildingBVH.h"
+#include "BuildingBVHSubsystem.generated.h"
+
+/**
+ * Owns the Building BVH of a world, shared by picking (LineTrace) and the analysis (Sensor Grids in the Building BVH mode).
+ *
+ * The BVH is built on first use. Moved components (see NotifyComponentMoved) are refitted into it the next time it is used,
+ * destroyed ones are removed from it. Actors with static meshes spawned after the build trigger a full rebuild of the top level,
+ * the mesh BVHs are kept across rebuilds. Snapshots handed out by GetBVH are never modified:
+ * if one is still in use by a background evaluation the refit goes into a copy.
+ */
+UCLASS()
+class ROTATEOBJECTS_API UBuildingBVHSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	UBuildingBVHSubsystem();
+
+	// The up to date BVH, built or refitted first if needed. Never null
+	TSharedPtr<const FBuildingBVH, ESPMode::ThreadSafe> GetBVH();
+
+	// Component (and its attached primitives) moved or is about to be destroyed, its placements are refitted
+	// (or removed) the next time the BVH is used
+	void NotifyComponentMoved(USceneComponent* Component);
+
+	//Rebuilds the BVH from every static mesh of the world on its next use
+	UFUNCTION(BlueprintCallable, Category = "Building BVH")
+	void Rebuild();
+
+	/**
+	 * Closest building hit between two world locations, without the physics scene.
+	 * Item is the instance hit for instanced static mesh components.
+	 * @param IgnoredActors - Actors whose components are skipped
+	 * @return whether a building was hit
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Building BVH")
+	bool LineTrace(const FVector& Start, const FVector& End, FHitResult& OutHit, const TArray<AActor*>& IgnoredActors);
+
+	//Static mesh LOD the meshes are read from, coarser LODs build and trace faster
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Building BVH", meta = (ClampMin = "0"))
+	int32 LODIndex;
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+private:
+
+	void HandleActorSpawned(AActor* Actor);
+	void HandleActorDestroyed(AActor* Actor);
+
+	// Queues a primitive for the next refit
+	void AddMovedComponent(UPrimitiveComponent* Component);
+
+	// Sensor Grids and gizmos are not buildings
+	static bool IsIgnored(const AActor* Actor);
+
+	TSharedPtr<FBuildingBVH, ESPMode::ThreadSafe> BVH;
+
+	// The key still finds the placements of a component that was destroyed meanwhile
+	TMap<FObjectKey, TWeakObjectPtr<UPrimitiveComponent>> MovedComponents;
+
+	// Spawned since the last GetBVH: Blueprint spawns are deferred, their components only exist once the spawn finished
+	TArray<TWeakObjectPtr<AActor>> SpawnedActors;
+
+	// Mesh BVHs of every build so far, a rebuild only redoes the top level
+	FBuildingMeshCache MeshCache;
+
+	// The next GetBVH builds from scratch
+	bool bRebuild;
+
+	FDelegateHandle ActorSpawnedHandle;
+	FDelegateHandle ActorDestroyedHandle;
+};
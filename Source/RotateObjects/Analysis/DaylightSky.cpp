@@ -0,0 +1,47 @@
+#include "DaylightSky.h"
+#include "../RotateObjects.h"
+
+void FDaylightSky::Build(EDaylightSkyModel InModel, const FVector3f& InSunDirection)
+{
+	Model = InModel;
+	SunDirection = InSunDirection.GetSafeNormal(UE_SMALL_NUMBER, FVector3f::UpVector);
+
+	if (Dome.Num() != 145)
+		Dome.BuildTregenza();
+
+	Weights.SetNumUninitialized(Dome.Num());
+	double HorizontalIlluminance = 0.0;
+	for (int32 i = 0; i < Dome.Num(); ++i)
+	{
+		Weights[i] = GetRelativeLuminance(Model, Dome.Directions[i], SunDirection) * Dome.SolidAngles[i];
+		HorizontalIlluminance += Weights[i] * Dome.Directions[i].Z;
+	}
+
+	const float Scale = HorizontalIlluminance > 0.0 ? float(1.0 / HorizontalIlluminance) : 0.f;
+	for (float& Weight : Weights)
+		Weight *= Scale;
+}
+
+bool FDaylightSky::Matches(EDaylightSkyModel InModel, const FVector3f& InSunDirection) const
+{
+	if (Weights.Num() == 0 || Model != InModel) return false;
+
+	//the overcast sky does not depend on the sun
+	return Model == EDaylightSkyModel::DS_CIEOvercast
+		|| SunDirection.Equals(InSunDirection.GetSafeNormal(UE_SMALL_NUMBER, FVector3f::UpVector), 1e-4f);
+}
+
+float FDaylightSky::GetRelativeLuminance(EDaylightSkyModel Model, const FVector3f& Direction, const FVector3f& SunDirection)
+{
+	const float CosZenith = FMath::Max(Direction.Z, 0.f);
+
+	if (Model == EDaylightSkyModel::DS_CIEOvercast)
+		return (1.f + 2.f * CosZenith) / 3.f;
+
+	//CIE clear sky: scattering indicatrix times gradation, the zenith normalization cancels out in Build
+	const float CosGamma = FMath::Clamp(FVector3f::DotProduct(Direction, SunDirection), -1.f, 1.f);
+	const float Gamma = FMath::Acos(CosGamma);
+	const float Indicatrix = 0.91f + 10.f * FMath::Exp(-3.f * Gamma) + 0.45f * CosGamma * CosGamma;
+	const float Gradation = CosZenith > 0.f ? 1.f - FMath::Exp(-0.32f / CosZenith) : 1.f;
+	return Indicatrix * Gradation;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SolarVisibility.h"
+#include "DaylightSky.generated.h"
+
+//Luminance distribution of the sky for daylight metrics
+UENUM(BlueprintType)
+enum class EDaylightSkyModel : uint8
+{
+	//CIE standard overcast sky, three times brighter at the zenith than at the horizon, independent of the sun
+	DS_CIEOvercast		UMETA(DisplayName = "CIE Overcast"),
+	//CIE standard clear sky, brightest around the sun
+	DS_CIEClear			UMETA(DisplayName = "CIE Clear"),
+};
+
+/**
+ * A sky model sampled on the 145 Tregenza patches: the direction of every patch and its share
+ * of the illuminance an unobstructed horizontal plane receives from the whole sky.
+ *
+ * Built once per sky model (and sun direction for the clear sky) and shared by every point evaluated with it.
+ */
+struct ROTATEOBJECTS_API FDaylightSky
+{
+	FSkyDome Dome;
+
+	// Relative luminance times solid angle of each patch, normalized so that
+	// the sum of Weight * sine of the altitude over all patches is 1
+	TArray<float> Weights;
+
+	EDaylightSkyModel Model = EDaylightSkyModel::DS_CIEOvercast;
+
+	// Towards the sun, scene space (Z up), only used by the clear sky
+	FVector3f SunDirection = FVector3f::UpVector;
+
+	void Build(EDaylightSkyModel InModel, const FVector3f& InSunDirection);
+
+	// Whether Build with these arguments would give the same sky
+	bool Matches(EDaylightSkyModel InModel, const FVector3f& InSunDirection) const;
+
+	int32 Num() const { return Dome.Num(); }
+
+	// Luminance of Direction relative to the zenith luminance of an overcast sky, unnormalized for the clear sky
+	static float GetRelativeLuminance(EDaylightSkyModel Model, const FVector3f& Direction, const FVector3f& SunDirection);
+};
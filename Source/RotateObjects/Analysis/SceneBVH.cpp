@@ -0,0 +1,540 @@
+#include "SceneBVH.h"
+#include "../RotateObjects.h"
+#include "Algo/Partition.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "StaticMeshResources.h"
+
+DECLARE_CYCLE_STAT(TEXT("Scene BVH Gather"), STAT_SceneBVHGather, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Scene BVH Build"), STAT_SceneBVHBuild, STATGROUP_LuminaCity);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Scene BVH Triangles"), STAT_SceneBVHTriangles, STATGROUP_LuminaCity);
+
+namespace SceneBVH
+{
+	static const int32 NumBins = 12;
+
+	// Nodes with this many triangles or less always become leaves
+	static const int32 MinSplitTriangles = 4;
+
+	// Nodes with more triangles are split even if the SAH prefers a leaf
+	static const int32 MaxLeafTriangles = 16;
+
+	// Deeper nodes become leaves, bounds the traversal stack
+	static const int32 MaxDepth = 48;
+
+	// Rays closer than this to the surface they start on do not count as hits
+	static const float HitEpsilon = 0.01f;
+
+	static float HalfArea(const FVector3f& Min, const FVector3f& Max)
+	{
+		const FVector3f D = Max - Min;
+		return D.X * D.Y + D.Y * D.Z + D.Z * D.X;
+	}
+
+	static void AddStaticMesh(const UStaticMesh* Mesh, const FTransform& Transform, const FVector& Origin
+		, int32 LODIndex, TArray<FVector3f>& OutVertices, TArray<FVector3f>& Scratch)
+	{
+		const FStaticMeshRenderData* RenderData = Mesh->GetRenderData();
+		if (!RenderData || RenderData->LODResources.Num() == 0) return;
+
+		const FStaticMeshLODResources& LOD = RenderData->LODResources[FMath::Clamp(LODIndex, 0, RenderData->LODResources.Num() - 1)];
+		const FPositionVertexBuffer& Positions = LOD.VertexBuffers.PositionVertexBuffer;
+		const FIndexArrayView Indices = LOD.IndexBuffer.GetArrayView();
+
+		//without CPU access the buffers are released once they are uploaded
+		const int32 NumVertices = Positions.GetNumVertices();
+		if (NumVertices == 0 || Indices.Num() < 3) return;
+
+		//every vertex is transformed once, in doubles so that the origin is subtracted before losing precision
+		Scratch.SetNumUninitialized(NumVertices);
+		for (int32 v = 0; v < NumVertices; ++v)
+			Scratch[v] = FVector3f(Transform.TransformPosition(FVector(Positions.VertexPosition(v))) - Origin);
+
+		OutVertices.Reserve(OutVertices.Num() + Indices.Num());
+		for (int32 i = 0; i + 2 < Indices.Num(); i += 3)
+		{
+			const uint32 I0 = Indices[i], I1 = Indices[i + 1], I2 = Indices[i + 2];
+			if (I0 >= uint32(NumVertices) || I1 >= uint32(NumVertices) || I2 >= uint32(NumVertices)) continue;
+
+			OutVertices.Add(Scratch[I0]);
+			OutVertices.Add(Scratch[I1]);
+			OutVertices.Add(Scratch[I2]);
+		}
+	}
+
+	// Mask of the lanes of the packet that hit the triangle (Moller-Trumbore, both sides)
+	static int32 IntersectTriangle4(const FVector3f& V0, const FVector3f& Edge1, const FVector3f& Edge2, const FRayPacket4& Packet)
+	{
+		const VectorRegister4Float E1X = VectorSetFloat1(Edge1.X);
+		const VectorRegister4Float E1Y = VectorSetFloat1(Edge1.Y);
+		const VectorRegister4Float E1Z = VectorSetFloat1(Edge1.Z);
+		const VectorRegister4Float E2X = VectorSetFloat1(Edge2.X);
+		const VectorRegister4Float E2Y = VectorSetFloat1(Edge2.Y);
+		const VectorRegister4Float E2Z = VectorSetFloat1(Edge2.Z);
+
+		// P = D x E2
+		const VectorRegister4Float PX = VectorNegateMultiplyAdd(Packet.DirZ, E2Y, VectorMultiply(Packet.DirY, E2Z));
+		const VectorRegister4Float PY = VectorNegateMultiplyAdd(Packet.DirX, E2Z, VectorMultiply(Packet.DirZ, E2X));
+		const VectorRegister4Float PZ = VectorNegateMultiplyAdd(Packet.DirY, E2X, VectorMultiply(Packet.DirX, E2Y));
+
+		const VectorRegister4Float Det = VectorMultiplyAdd(E1X, PX, VectorMultiplyAdd(E1Y, PY, VectorMultiply(E1Z, PZ)));
+		const VectorRegister4Float InvDet = VectorDivide(VectorOneFloat(), Det);
+
+		// T = O - V0
+		const VectorRegister4Float TX = VectorSubtract(Packet.OriginX, VectorSetFloat1(V0.X));
+		const VectorRegister4Float TY = VectorSubtract(Packet.OriginY, VectorSetFloat1(V0.Y));
+		const VectorRegister4Float TZ = VectorSubtract(Packet.OriginZ, VectorSetFloat1(V0.Z));
+
+		const VectorRegister4Float U = VectorMultiply(
+			VectorMultiplyAdd(TX, PX, VectorMultiplyAdd(TY, PY, VectorMultiply(TZ, PZ))), InvDet);
+
+		// Q = T x E1
+		const VectorRegister4Float QX = VectorNegateMultiplyAdd(TZ, E1Y, VectorMultiply(TY, E1Z));
+		const VectorRegister4Float QY = VectorNegateMultiplyAdd(TX, E1Z, VectorMultiply(TZ, E1X));
+		const VectorRegister4Float QZ = VectorNegateMultiplyAdd(TY, E1X, VectorMultiply(TX, E1Y));
+
+		const VectorRegister4Float V = VectorMultiply(
+			VectorMultiplyAdd(Packet.DirX, QX, VectorMultiplyAdd(Packet.DirY, QY, VectorMultiply(Packet.DirZ, QZ))), InvDet);
+		const VectorRegister4Float Distance = VectorMultiply(
+			VectorMultiplyAdd(E2X, QX, VectorMultiplyAdd(E2Y, QY, VectorMultiply(E2Z, QZ))), InvDet);
+
+		const VectorRegister4Float Zero = VectorZeroFloat();
+		VectorRegister4Float Mask = VectorCompareGT(VectorAbs(Det), VectorSetFloat1(1e-8f));
+		Mask = VectorBitwiseAnd(Mask, VectorCompareGE(U, Zero));
+		Mask = VectorBitwiseAnd(Mask, VectorCompareGE(V, Zero));
+		Mask = VectorBitwiseAnd(Mask, VectorCompareLE(VectorAdd(U, V), VectorOneFloat()));
+		Mask = VectorBitwiseAnd(Mask, VectorCompareGT(Distance, VectorSetFloat1(HitEpsilon)));
+		Mask = VectorBitwiseAnd(Mask, VectorCompareLT(Distance, Packet.TMax));
+		return VectorMaskBits(Mask);
+	}
+}
+
+void FRayPacket4::Set(const FVector3f* Origins, const FVector3f* Directions, int32 NumRays, float InTMax)
+{
+	check(NumRays >= 0 && NumRays <= 4);
+
+	float O[3][4], D[3][4], I[3][4];
+	for (int32 Lane = 0; Lane < 4; ++Lane)
+	{
+		//unused lanes repeat the first ray, they are masked out anyway
+		const int32 Ray = Lane < NumRays ? Lane : 0;
+		for (int32 Axis = 0; Axis < 3; ++Axis)
+		{
+			O[Axis][Lane] = NumRays > 0 ? Origins[Ray][Axis] : 0.f;
+			D[Axis][Lane] = NumRays > 0 ? Directions[Ray][Axis] : 1.f;
+
+			//axis parallel rays get a huge instead of an infinite inverse, which keeps the slab test free of NaNs
+			const float Dir = D[Axis][Lane];
+			I[Axis][Lane] = 1.f / (FMath::Abs(Dir) > 1e-8f ? Dir : (Dir < 0.f ? -1e-8f : 1e-8f));
+		}
+	}
+
+	OriginX = VectorLoad(O[0]);
+	OriginY = VectorLoad(O[1]);
+	OriginZ = VectorLoad(O[2]);
+	DirX = VectorLoad(D[0]);
+	DirY = VectorLoad(D[1]);
+	DirZ = VectorLoad(D[2]);
+	InvDirX = VectorLoad(I[0]);
+	InvDirY = VectorLoad(I[1]);
+	InvDirZ = VectorLoad(I[2]);
+	TMax = VectorSetFloat1(InTMax);
+	ActiveMask = (1 << NumRays) - 1;
+}
+
+int32 FRayPacket4::IntersectBox(const FVector3f& Min, const FVector3f& Max) const
+{
+	const VectorRegister4Float T0X = VectorMultiply(VectorSubtract(VectorSetFloat1(Min.X), OriginX), InvDirX);
+	const VectorRegister4Float T1X = VectorMultiply(VectorSubtract(VectorSetFloat1(Max.X), OriginX), InvDirX);
+	const VectorRegister4Float T0Y = VectorMultiply(VectorSubtract(VectorSetFloat1(Min.Y), OriginY), InvDirY);
+	const VectorRegister4Float T1Y = VectorMultiply(VectorSubtract(VectorSetFloat1(Max.Y), OriginY), InvDirY);
+	const VectorRegister4Float T0Z = VectorMultiply(VectorSubtract(VectorSetFloat1(Min.Z), OriginZ), InvDirZ);
+	const VectorRegister4Float T1Z = VectorMultiply(VectorSubtract(VectorSetFloat1(Max.Z), OriginZ), InvDirZ);
+
+	const VectorRegister4Float Near = VectorMax(
+		VectorMax(VectorMin(T0X, T1X), VectorMin(T0Y, T1Y)),
+		VectorMax(VectorMin(T0Z, T1Z), VectorZeroFloat()));
+	const VectorRegister4Float Far = VectorMin(
+		VectorMin(VectorMax(T0X, T1X), VectorMax(T0Y, T1Y)),
+		VectorMin(VectorMax(T0Z, T1Z), TMax));
+
+	return VectorMaskBits(VectorCompareLE(Near, Far)) & ActiveMask;
+}
+
+void FSceneBVH::GatherMeshTriangles(const UStaticMesh* Mesh, int32 LODIndex, TArray<FVector3f>& OutVertices)
+{
+	if (!Mesh) return;
+
+	TArray<FVector3f> Scratch;
+	SceneBVH::AddStaticMesh(Mesh, FTransform::Identity, FVector::ZeroVector, LODIndex, OutVertices, Scratch);
+}
+
+int32 FSceneBVH::GatherWorldTriangles(UWorld* World, const FVector& InOrigin, TArray<FVector3f>& OutVertices
+	, const TArray<AActor*>& IgnoredActors, int32 LODIndex)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SceneBVHGather);
+
+	if (!World) return 0;
+
+	int32 NumMeshes = 0;
+	TArray<FVector3f> Scratch;
+	for (TActorIterator<AActor> It(World); It; ++It)
+	{
+		AActor* Actor = *It;
+		if (IgnoredActors.Contains(Actor)) continue;
+
+		TInlineComponentArray<UStaticMeshComponent*> Components(Actor);
+		for (UStaticMeshComponent* Component : Components)
+		{
+			const UStaticMesh* Mesh = Component->GetStaticMesh();
+			if (!Mesh || !Component->IsVisible() || !Component->CastShadow) continue;
+
+			if (const UInstancedStaticMeshComponent* Instanced = Cast<UInstancedStaticMeshComponent>(Component))
+			{
+				for (int32 i = 0; i < Instanced->GetInstanceCount(); ++i)
+				{
+					FTransform InstanceTransform;
+					if (Instanced->GetInstanceTransform(i, InstanceTransform, true))
+					{
+						SceneBVH::AddStaticMesh(Mesh, InstanceTransform, InOrigin, LODIndex, OutVertices, Scratch);
+						++NumMeshes;
+					}
+				}
+			}
+			else
+			{
+				SceneBVH::AddStaticMesh(Mesh, Component->GetComponentTransform(), InOrigin, LODIndex, OutVertices, Scratch);
+				++NumMeshes;
+			}
+		}
+	}
+	return NumMeshes;
+}
+
+void FSceneBVH::BuildFromWorld(UWorld* World, const FVector& InOrigin, const TArray<AActor*>& IgnoredActors, int32 LODIndex)
+{
+	TArray<FVector3f> Vertices;
+	GatherWorldTriangles(World, InOrigin, Vertices, IgnoredActors, LODIndex);
+	Build(MoveTemp(Vertices), InOrigin);
+}
+
+void FSceneBVH::Reset()
+{
+	Nodes.Reset();
+	Triangles.Reset();
+	SET_DWORD_STAT(STAT_SceneBVHTriangles, 0);
+}
+
+void FSceneBVH::Build(TArray<FVector3f>&& TriangleVertices, const FVector& InOrigin)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SceneBVHBuild);
+	using namespace SceneBVH;
+
+	Reset();
+	Origin = InOrigin;
+
+	const int32 NumTriangles = TriangleVertices.Num() / 3;
+	if (NumTriangles == 0) return;
+
+	TArray<FVector3f> BoundsMin, BoundsMax, Centroids;
+	BoundsMin.SetNumUninitialized(NumTriangles);
+	BoundsMax.SetNumUninitialized(NumTriangles);
+	Centroids.SetNumUninitialized(NumTriangles);
+
+	TArray<int32> Order;
+	Order.SetNumUninitialized(NumTriangles);
+
+	for (int32 t = 0; t < NumTriangles; ++t)
+	{
+		const FVector3f& A = TriangleVertices[t * 3];
+		const FVector3f& B = TriangleVertices[t * 3 + 1];
+		const FVector3f& C = TriangleVertices[t * 3 + 2];
+		BoundsMin[t] = A.ComponentMin(B).ComponentMin(C);
+		BoundsMax[t] = A.ComponentMax(B).ComponentMax(C);
+		Centroids[t] = (BoundsMin[t] + BoundsMax[t]) * 0.5f;
+		Order[t] = t;
+	}
+
+	struct FBuildTask
+	{
+		int32 Node;
+		int32 First;
+		int32 Count;
+		int32 Depth;
+	};
+
+	TArray<FBuildTask> Stack;
+	Nodes.Reserve(NumTriangles * 2);
+	Nodes.AddDefaulted();
+	Stack.Add({ 0, 0, NumTriangles, 0 });
+
+	while (Stack.Num() > 0)
+	{
+		const FBuildTask Task = Stack.Pop(false);
+
+		FVector3f Min(MAX_flt), Max(-MAX_flt), CentroidMin(MAX_flt), CentroidMax(-MAX_flt);
+		for (int32 i = Task.First; i < Task.First + Task.Count; ++i)
+		{
+			const int32 t = Order[i];
+			Min = Min.ComponentMin(BoundsMin[t]);
+			Max = Max.ComponentMax(BoundsMax[t]);
+			CentroidMin = CentroidMin.ComponentMin(Centroids[t]);
+			CentroidMax = CentroidMax.ComponentMax(Centroids[t]);
+		}
+		Nodes[Task.Node].Min = Min;
+		Nodes[Task.Node].Max = Max;
+
+		if (Task.Count <= MinSplitTriangles || Task.Depth >= MaxDepth)
+		{
+			Nodes[Task.Node].LeftOrFirst = Task.First;
+			Nodes[Task.Node].NumTriangles = Task.Count;
+			continue;
+		}
+
+		//binned SAH: cost of a split is the area of each side times its triangle count
+		int32 BestAxis = INDEX_NONE;
+		int32 BestSplit = 0;
+		float BestCost = MAX_flt;
+		for (int32 Axis = 0; Axis < 3; ++Axis)
+		{
+			const float Extent = CentroidMax[Axis] - CentroidMin[Axis];
+			if (Extent <= 0.f) continue;
+
+			const float Scale = NumBins / Extent;
+			int32 BinCount[NumBins] = {};
+			FVector3f BinMin[NumBins], BinMax[NumBins];
+			for (int32 b = 0; b < NumBins; ++b)
+			{
+				BinMin[b] = FVector3f(MAX_flt);
+				BinMax[b] = FVector3f(-MAX_flt);
+			}
+
+			for (int32 i = Task.First; i < Task.First + Task.Count; ++i)
+			{
+				const int32 t = Order[i];
+				const int32 Bin = FMath::Min(int32((Centroids[t][Axis] - CentroidMin[Axis]) * Scale), NumBins - 1);
+				++BinCount[Bin];
+				BinMin[Bin] = BinMin[Bin].ComponentMin(BoundsMin[t]);
+				BinMax[Bin] = BinMax[Bin].ComponentMax(BoundsMax[t]);
+			}
+
+			//right side of every split plane, swept from the last bin
+			float RightArea[NumBins];
+			int32 RightCount[NumBins];
+			FVector3f SweepMin(MAX_flt), SweepMax(-MAX_flt);
+			int32 SweepCount = 0;
+			for (int32 b = NumBins - 1; b > 0; --b)
+			{
+				SweepMin = SweepMin.ComponentMin(BinMin[b]);
+				SweepMax = SweepMax.ComponentMax(BinMax[b]);
+				SweepCount += BinCount[b];
+				RightArea[b] = SweepCount > 0 ? HalfArea(SweepMin, SweepMax) : 0.f;
+				RightCount[b] = SweepCount;
+			}
+
+			SweepMin = FVector3f(MAX_flt);
+			SweepMax = FVector3f(-MAX_flt);
+			SweepCount = 0;
+			for (int32 b = 1; b < NumBins; ++b)
+			{
+				SweepMin = SweepMin.ComponentMin(BinMin[b - 1]);
+				SweepMax = SweepMax.ComponentMax(BinMax[b - 1]);
+				SweepCount += BinCount[b - 1];
+				if (SweepCount == 0 || RightCount[b] == 0) continue;
+
+				const float Cost = HalfArea(SweepMin, SweepMax) * SweepCount + RightArea[b] * RightCount[b];
+				if (Cost < BestCost)
+				{
+					BestCost = Cost;
+					BestAxis = Axis;
+					BestSplit = b;
+				}
+			}
+		}
+
+		const float LeafCost = HalfArea(Min, Max) * Task.Count;
+		if (Task.Count <= MaxLeafTriangles && (BestAxis == INDEX_NONE || BestCost >= LeafCost))
+		{
+			Nodes[Task.Node].LeftOrFirst = Task.First;
+			Nodes[Task.Node].NumTriangles = Task.Count;
+			continue;
+		}
+
+		int32 Mid = Task.First + Task.Count / 2;
+		if (BestAxis != INDEX_NONE)
+		{
+			const float Scale = NumBins / (CentroidMax[BestAxis] - CentroidMin[BestAxis]);
+			const float AxisMin = CentroidMin[BestAxis];
+			const int32 NumLeft = Algo::Partition(Order.GetData() + Task.First, Task.Count, [&](int32 t)
+			{
+				return FMath::Min(int32((Centroids[t][BestAxis] - AxisMin) * Scale), NumBins - 1) < BestSplit;
+			});
+
+			//all centroids in one bin (or identical), split in the middle of the list instead
+			if (NumLeft > 0 && NumLeft < Task.Count)
+				Mid = Task.First + NumLeft;
+		}
+
+		const int32 Left = Nodes.Num();
+		Nodes.AddDefaulted(2);
+		Nodes[Task.Node].LeftOrFirst = Left;
+		Nodes[Task.Node].NumTriangles = 0;
+
+		Stack.Add({ Left, Task.First, Mid - Task.First, Task.Depth + 1 });
+		Stack.Add({ Left + 1, Mid, Task.First + Task.Count - Mid, Task.Depth + 1 });
+	}
+
+	//leaves reference ranges of Order, store the triangles in that order so that leaves are contiguous
+	Triangles.SetNumUninitialized(NumTriangles);
+	for (int32 i = 0; i < NumTriangles; ++i)
+	{
+		const int32 t = Order[i];
+		const FVector3f& V0 = TriangleVertices[t * 3];
+		Triangles[i].V0 = V0;
+		Triangles[i].Edge1 = TriangleVertices[t * 3 + 1] - V0;
+		Triangles[i].Edge2 = TriangleVertices[t * 3 + 2] - V0;
+	}
+	Nodes.Shrink();
+
+	SET_DWORD_STAT(STAT_SceneBVHTriangles, NumTriangles);
+}
+
+int32 FSceneBVH::Occluded4(const FRayPacket4& Packet) const
+{
+	if (Nodes.Num() == 0 || Packet.ActiveMask == 0) return 0;
+
+	int32 Occluded = 0;
+	int32 Stack[SceneBVH::MaxDepth + 2];
+	int32 StackSize = 0;
+	Stack[StackSize++] = 0;
+
+	while (StackSize > 0)
+	{
+		const FNode& Node = Nodes[Stack[--StackSize]];
+
+		//slab test of the 4 rays against the node bounds
+		const int32 Hit = Packet.IntersectBox(Node.Min, Node.Max) & ~Occluded;
+		if (!Hit) continue;
+
+		if (Node.IsLeaf())
+		{
+			for (int32 t = Node.LeftOrFirst; t < Node.LeftOrFirst + Node.NumTriangles; ++t)
+			{
+				const FTriangle& Triangle = Triangles[t];
+				Occluded |= SceneBVH::IntersectTriangle4(Triangle.V0, Triangle.Edge1, Triangle.Edge2, Packet) & Hit;
+			}
+
+			//shadow rays are done at the first hit
+			if (Occluded == Packet.ActiveMask)
+				return Occluded;
+		}
+		else
+		{
+			Stack[StackSize++] = Node.LeftOrFirst + 1;
+			Stack[StackSize++] = Node.LeftOrFirst;
+		}
+	}
+
+	return Occluded;
+}
+
+bool FSceneBVH::Occluded(const FVector3f& RayOrigin, const FVector3f& Direction, float TMax) const
+{
+	FRayPacket4 Packet;
+	Packet.Set(&RayOrigin, &Direction, 1, TMax);
+	return Occluded4(Packet) != 0;
+}
+
+bool FSceneBVH::Raycast(const FVector3f& RayOrigin, const FVector3f& Direction, float TMax, float& OutDistance, FVector3f& OutNormal) const
+{
+	if (Nodes.Num() == 0) return false;
+
+	const FVector3f InvDirection(
+		1.f / (FMath::Abs(Direction.X) > 1e-8f ? Direction.X : (Direction.X < 0.f ? -1e-8f : 1e-8f)),
+		1.f / (FMath::Abs(Direction.Y) > 1e-8f ? Direction.Y : (Direction.Y < 0.f ? -1e-8f : 1e-8f)),
+		1.f / (FMath::Abs(Direction.Z) > 1e-8f ? Direction.Z : (Direction.Z < 0.f ? -1e-8f : 1e-8f)));
+
+	//entry distance of the ray into a node, MAX_flt if it misses or enters beyond the closest hit so far
+	auto EntryDistance = [&](const FNode& Node)
+	{
+		const FVector3f T0 = (Node.Min - RayOrigin) * InvDirection;
+		const FVector3f T1 = (Node.Max - RayOrigin) * InvDirection;
+		const float Near = FMath::Max(FMath::Max3(FMath::Min(T0.X, T1.X), FMath::Min(T0.Y, T1.Y), FMath::Min(T0.Z, T1.Z)), 0.f);
+		const float Far = FMath::Min(FMath::Min3(FMath::Max(T0.X, T1.X), FMath::Max(T0.Y, T1.Y), FMath::Max(T0.Z, T1.Z)), TMax);
+		return Near <= Far ? Near : MAX_flt;
+	};
+
+	int32 HitTriangle = INDEX_NONE;
+	int32 Stack[SceneBVH::MaxDepth + 2];
+	int32 StackSize = 0;
+	if (EntryDistance(Nodes[0]) != MAX_flt)
+		Stack[StackSize++] = 0;
+
+	while (StackSize > 0)
+	{
+		const FNode& Node = Nodes[Stack[--StackSize]];
+		if (Node.IsLeaf())
+		{
+			for (int32 t = Node.LeftOrFirst; t < Node.LeftOrFirst + Node.NumTriangles; ++t)
+			{
+				//Moller-Trumbore, both sides
+				const FTriangle& Triangle = Triangles[t];
+				const FVector3f P = FVector3f::CrossProduct(Direction, Triangle.Edge2);
+				const float Det = FVector3f::DotProduct(Triangle.Edge1, P);
+				if (FMath::Abs(Det) <= 1e-8f) continue;
+
+				const float InvDet = 1.f / Det;
+				const FVector3f T = RayOrigin - Triangle.V0;
+				const float U = FVector3f::DotProduct(T, P) * InvDet;
+				if (U < 0.f || U > 1.f) continue;
+
+				const FVector3f Q = FVector3f::CrossProduct(T, Triangle.Edge1);
+				const float V = FVector3f::DotProduct(Direction, Q) * InvDet;
+				if (V < 0.f || U + V > 1.f) continue;
+
+				const float Distance = FVector3f::DotProduct(Triangle.Edge2, Q) * InvDet;
+				if (Distance > SceneBVH::HitEpsilon && Distance < TMax)
+				{
+					TMax = Distance;
+					HitTriangle = t;
+				}
+			}
+		}
+		else
+		{
+			//nearer child first, so that far subtrees are culled by the shrinking TMax
+			int32 Near = Node.LeftOrFirst;
+			int32 Far = Node.LeftOrFirst + 1;
+			float NearDistance = EntryDistance(Nodes[Near]);
+			float FarDistance = EntryDistance(Nodes[Far]);
+			if (FarDistance < NearDistance)
+			{
+				Swap(Near, Far);
+				Swap(NearDistance, FarDistance);
+			}
+
+			if (FarDistance != MAX_flt)
+				Stack[StackSize++] = Far;
+			if (NearDistance != MAX_flt)
+				Stack[StackSize++] = Near;
+		}
+	}
+
+	if (HitTriangle == INDEX_NONE) return false;
+
+	const FTriangle& Triangle = Triangles[HitTriangle];
+	OutDistance = TMax;
+	OutNormal = FVector3f::CrossProduct(Triangle.Edge1, Triangle.Edge2);
+	if (FVector3f::DotProduct(OutNormal, Direction) > 0.f)
+		OutNormal = -OutNormal;
+	return true;
+}
+
+void FSceneBVH::GetBounds(FVector3f& OutMin, FVector3f& OutMax) const
+{
+	OutMin = Nodes.Num() > 0 ? Nodes[0].Min : FVector3f::ZeroVector;
+	OutMax = Nodes.Num() > 0 ? Nodes[0].Max : FVector3f::ZeroVector;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AActor;
+class UStaticMesh;
+class UWorld;
+
+/**
+ * Four rays traced together, one per SIMD lane, stored component wise.
+ * Lanes without a ray are masked out by ActiveMask.
+ */
+struct FRayPacket4
+{
+	VectorRegister4Float OriginX, OriginY, OriginZ;
+	VectorRegister4Float DirX, DirY, DirZ;
+	VectorRegister4Float InvDirX, InvDirY, InvDirZ;
+	VectorRegister4Float TMax;
+
+	// Bit i is set if lane i carries a ray
+	int32 ActiveMask = 0;
+
+	// Fills the first NumRays (at most 4) lanes. TMax and hit distances are in multiples of the directions
+	void Set(const FVector3f* Origins, const FVector3f* Directions, int32 NumRays, float InTMax);
+
+	// Mask of the lanes that enter the box before their TMax (slab test)
+	int32 IntersectBox(const FVector3f& Min, const FVector3f& Max) const;
+};
+
+/**
+ * Geometry shadow rays can be traced through on the CPU (see FSolarVisibility).
+ * Positions and rays are relative to GetOrigin.
+ */
+class ROTATEOBJECTS_API ISceneOccluder
+{
+public:
+
+	virtual ~ISceneOccluder() {}
+
+	// Mask of the active rays of the packet that hit something closer than their TMax
+	virtual int32 Occluded4(const FRayPacket4& Packet) const = 0;
+
+	virtual const FVector& GetOrigin() const = 0;
+
+	FVector3f ToLocal(const FVector& WorldPosition) const { return FVector3f(WorldPosition - GetOrigin()); }
+};
+
+/**
+ * Bounding volume hierarchy over the triangles of a scene, for shadow rays on the CPU.
+ *
+ * Does not depend on rendering or physics: the triangles are read from the static mesh LODs,
+ * so it works headless (-nullrhi) as well. Coordinates are floats relative to an Origin,
+ * which keeps the precision of large (georeferenced) sites.
+ *
+ * Nodes are a flat array, the children of an inner node are next to each other.
+ * The tree is built with a binned surface area heuristic and traversed with 4 ray packets.
+ */
+class ROTATEOBJECTS_API FSceneBVH : public ISceneOccluder
+{
+public:
+
+	struct FNode
+	{
+		FVector3f Min;
+		// First child (the second one follows it) for inner nodes, first triangle for leaves
+		int32 LeftOrFirst = 0;
+		FVector3f Max;
+		// 0 for inner nodes
+		int32 NumTriangles = 0;
+
+		bool IsLeaf() const { return NumTriangles > 0; }
+	};
+
+	/**
+	 * Collects the triangles of every visible, shadow casting static mesh component (and every instance of
+	 * instanced components) in the world, 3 vertices per triangle relative to Origin.
+	 * Meshes without CPU side data (cooked without Allow CPU Access) are skipped.
+	 * @return the number of mesh instances that were added
+	 */
+	static int32 GatherWorldTriangles(UWorld* World, const FVector& Origin, TArray<FVector3f>& OutVertices
+		, const TArray<AActor*>& IgnoredActors = TArray<AActor*>(), int32 LODIndex = 0);
+
+	// Appends the triangles of a static mesh LOD in mesh space, 3 vertices per triangle
+	static void GatherMeshTriangles(const UStaticMesh* Mesh, int32 LODIndex, TArray<FVector3f>& OutVertices);
+
+	// Builds the tree from a triangle list (3 vertices per triangle, relative to InOrigin)
+	void Build(TArray<FVector3f>&& TriangleVertices, const FVector& InOrigin);
+
+	// Gathers the world with GatherWorldTriangles and builds the tree
+	void BuildFromWorld(UWorld* World, const FVector& InOrigin
+		, const TArray<AActor*>& IgnoredActors = TArray<AActor*>(), int32 LODIndex = 0);
+
+	void Reset();
+
+	// Mask of the active rays of the packet that hit a triangle closer than their TMax
+	virtual int32 Occluded4(const FRayPacket4& Packet) const override;
+
+	// Single shadow ray, Origin relative to GetOrigin
+	bool Occluded(const FVector3f& RayOrigin, const FVector3f& Direction, float TMax) const;
+
+	/**
+	 * Closest hit of a single ray, Origin relative to GetOrigin. Direction does not have to be normalized,
+	 * distances are in multiples of it.
+	 * @param OutNormal - unnormalized geometric normal of the triangle hit, facing the ray
+	 */
+	bool Raycast(const FVector3f& RayOrigin, const FVector3f& Direction, float TMax, float& OutDistance, FVector3f& OutNormal) const;
+
+	// Bounds of every triangle, relative to GetOrigin
+	void GetBounds(FVector3f& OutMin, FVector3f& OutMax) const;
+
+	bool IsEmpty() const { return Nodes.Num() == 0; }
+	int32 GetNumTriangles() const { return Triangles.Num(); }
+	int32 GetNumNodes() const { return Nodes.Num(); }
+	virtual const FVector& GetOrigin() const override { return Origin; }
+
+private:
+
+	// Precomputed for the Moller-Trumbore test
+	struct FTriangle
+	{
+		FVector3f V0;
+		FVector3f Edge1;
+		FVector3f Edge2;
+	};
+
+	TArray<FNode> Nodes;
+	TArray<FTriangle> Triangles;
+	FVector Origin = FVector::ZeroVector;
+};
@@ -0,0 +1,227 @@
+#include "SceneChangeTracker.h"
+#include "BuildingBVHSubsystem.h"
+#include "SensorGrid.h"
+#include "../RotateObjects.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+
+DECLARE_CYCLE_STAT(TEXT("Scene Change Commit"), STAT_SceneChangeCommit, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Scene Change Preview"), STAT_SceneChangePreview, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Scene Changes Committed"), STAT_SceneChangesCommitted, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sensors Invalidated"), STAT_SensorsInvalidated, STATGROUP_LuminaCity);
+
+USceneChangeTracker::USceneChangeTracker()
+{
+	SettleDelay = 0.2f;
+	bLivePreview = true;
+	PreviewStride = 4;
+	PreviewBudgetMs = 2.f;
+	LastMoveTime = 0.0;
+	bDragInProgress = false;
+}
+
+FBox USceneChangeTracker::GetMovedBounds(const USceneComponent* Component)
+{
+	if (!Component) return FBox(ForceInit);
+
+	const AActor* Owner = Component->GetOwner();
+	if (Owner && Owner->GetRootComponent() == Component)
+		return Owner->GetComponentsBoundingBox(true);
+
+	if (const UPrimitiveComponent* Primitive = Cast<UPrimitiveComponent>(Component))
+		return Primitive->Bounds.GetBox();
+
+	return Component->CalcBounds(Component->GetComponentTransform()).GetBox();
+}
+
+FBox USceneChangeTracker::GetInstanceBounds(const UInstancedStaticMeshComponent* Component, int32 InstanceIndex)
+{
+	FTransform InstanceTransform;
+	if (!Component || !Component->GetStaticMesh() || !Component->GetInstanceTransform(InstanceIndex, InstanceTransform, true))
+		return FBox(ForceInit);
+
+	return Component->GetStaticMesh()->GetBounds().TransformBy(InstanceTransform).GetBox();
+}
+
+FBox USceneChangeTracker::GetBounds(const FSceneChangeKey& Key)
+{
+	if (Key.Item == INDEX_NONE)
+		return GetMovedBounds(Key.Component.Get());
+
+	return GetInstanceBounds(Cast<UInstancedStaticMeshComponent>(Key.Component.Get()), Key.Item);
+}
+
+void USceneChangeTracker::NotifyMoving(USceneComponent* Component)
+{
+	if (!Component) return;
+
+	const FSceneChangeKey Key{ Component, INDEX_NONE };
+	RecordChange(Key, PendingChanges.Contains(Key) ? FBox(ForceInit) : GetMovedBounds(Component));
+}
+
+void USceneChangeTracker::NotifyInstanceMoving(UInstancedStaticMeshComponent* Component, int32 InstanceIndex)
+{
+	if (!Component || InstanceIndex == INDEX_NONE) return;
+
+	const FSceneChangeKey Key{ Component, InstanceIndex };
+	RecordChange(Key, PendingChanges.Contains(Key) ? FBox(ForceInit) : GetInstanceBounds(Component, InstanceIndex));
+}
+
+void USceneChangeTracker::NotifyInstanceAdded(UInstancedStaticMeshComponent* Component, int32 InstanceIndex)
+{
+	if (!Component || InstanceIndex == INDEX_NONE) return;
+
+	RecordChange({ Component, InstanceIndex }, FBox(ForceInit));
+}
+
+void USceneChangeTracker::RecordChange(const FSceneChangeKey& Key, const FBox& OldBounds)
+{
+	UWorld* World = GetWorld();
+
+	FSceneChange* Change = PendingChanges.Find(Key);
+	if (!Change)
+	{
+		//NewBounds is read on the next refresh, the BVH refits the component on its next use
+		Change = &PendingChanges.Add(Key, { OldBounds, OldBounds });
+		UnpreviewedBounds.Add(OldBounds);
+		if (UBuildingBVHSubsystem* Buildings = World ? World->GetSubsystem<UBuildingBVHSubsystem>() : nullptr)
+			Buildings->NotifyComponentMoved(Key.Component.Get());
+	}
+	if (!Change->bMoved)
+	{
+		Change->bMoved = true;
+		MovedKeys.Add(Key);
+	}
+
+	if (World)
+		LastMoveTime = World->GetRealTimeSeconds();
+}
+
+void USceneChangeTracker::RefreshMovedBounds()
+{
+	for (const FSceneChangeKey& Key : MovedKeys)
+	{
+		if (FSceneChange* Change = PendingChanges.Find(Key))
+		{
+			const FBox NewBounds = GetBounds(Key);
+			if (NewBounds != Change->NewBounds)
+			{
+				Change->NewBounds = NewBounds;
+				UnpreviewedBounds.Add(NewBounds);
+			}
+			Change->bMoved = false;
+		}
+	}
+	MovedKeys.Reset();
+}
+
+void USceneChangeTracker::CommitChanges()
+{
+	SCOPE_CYCLE_COUNTER(STAT_SceneChangeCommit);
+
+	UWorld* World = GetWorld();
+	if (!World || PendingChanges.Num() == 0) return;
+
+	RefreshMovedBounds();
+
+	//moves after the first one of a key were not passed on yet
+	if (UBuildingBVHSubsystem* Buildings = World->GetSubsystem<UBuildingBVHSubsystem>())
+	{
+		//the instances of a component are refitted together
+		TSet<USceneComponent*> Notified;
+		for (const TPair<FSceneChangeKey, FSceneChange>& Change : PendingChanges)
+		{
+			bool bAlreadyNotified = false;
+			USceneComponent* Component = Change.Key.Component.Get();
+			Notified.Add(Component, &bAlreadyNotified);
+			if (Component && !bAlreadyNotified)
+				Buildings->NotifyComponentMoved(Component);
+		}
+	}
+
+	for (TActorIterator<ASensorGrid> It(World); It; ++It)
+	{
+		ASensorGrid* Grid = *It;
+
+		int32 NumInvalidated = 0;
+		for (const TPair<FSceneChangeKey, FSceneChange>& Change : PendingChanges)
+		{
+			NumInvalidated += Grid->InvalidateBounds(Change.Value.OldBounds, true);
+			NumInvalidated += Grid->InvalidateBounds(Change.Value.NewBounds, true);
+		}
+		INC_DWORD_STAT_BY(STAT_SensorsInvalidated, NumInvalidated);
+
+		if (NumInvalidated > 0)
+			Grid->EvaluateAsync();
+	}
+
+	INC_DWORD_STAT_BY(STAT_SceneChangesCommitted, PendingChanges.Num());
+	PendingChanges.Reset();
+	UnpreviewedBounds.Reset();
+}
+
+void USceneChangeTracker::HandleGizmoStateChange(ETransformationType GizmoType, bool bTransformInProgress, ETransformationDomain Domain)
+{
+	bDragInProgress = bTransformInProgress;
+	if (!bDragInProgress)
+		CommitChanges();
+}
+
+void USceneChangeTracker::UpdatePreview()
+{
+	SCOPE_CYCLE_COUNTER(STAT_SceneChangePreview);
+
+	UWorld* World = GetWorld();
+	if (!World) return;
+
+	TArray<ASensorGrid*> Grids;
+	for (TActorIterator<ASensorGrid> It(World); It; ++It)
+		Grids.Add(*It);
+	if (Grids.Num() == 0) return;
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	//sensors swept over during the drag stay dirty until the commit, only the bounds moved into since the last frame are invalidated
+	RefreshMovedBounds();
+	for (ASensorGrid* Grid : Grids)
+	{
+		for (const FBox& Bounds : UnpreviewedBounds)
+			Grid->InvalidateBounds(Bounds, true);
+	}
+	UnpreviewedBounds.Reset();
+
+	//reading the bounds and invalidating count against the budget
+	const float RemainingMs = PreviewBudgetMs - (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	if (RemainingMs <= 0.f) return;
+
+	const float GridBudgetMs = RemainingMs / Grids.Num();
+	for (ASensorGrid* Grid : Grids)
+		Grid->EvaluatePreview(PreviewStride, GridBudgetMs);
+}
+
+void USceneChangeTracker::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (PendingChanges.Num() == 0) return;
+
+	//a drag is committed when it ends, holding still during one does not count
+	if (bDragInProgress)
+	{
+		if (bLivePreview)
+			UpdatePreview();
+		return;
+	}
+
+	const UWorld* World = GetWorld();
+	if (World && World->GetRealTimeSeconds() - LastMoveTime >= SettleDelay)
+		CommitChanges();
+}
+
+TStatId USceneChangeTracker::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USceneChangeTracker, STATGROUP_Tickables);
+}
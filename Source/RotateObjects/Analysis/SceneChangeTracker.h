@@ -0,0 +1,138 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "../TransformerTool.h"
+#include "SceneChangeTracker.generated.h"
+
+/**
+ * Records which actors (or components) were moved and where their bounds went, and brings the analysis up to date.
+ * The bounds before a move are read when it is first reported, where it went is read only when the preview or the commit
+ * needs it, so reporting the same component every frame of a drag costs a map lookup.
+ * The Building BVH is told on the first move and on the commit, it refits them the next time it is traced.
+ *
+ * The Transformer Tool reports every component before it transforms it. The analysis runs in two tiers:
+ * - while a gizmo drag is in progress (see HandleGizmoStateChange) the affected sensors get a coarse, sun only
+ *   preview within a per frame budget (ASensorGrid::EvaluatePreview)
+ * - when the drag ends, or no move arrived for SettleDelay seconds outside of a drag, the changes are committed: every Sensor Grid
+ *   invalidates the sensors whose sun or sky rays could cross the old or the new bounds and evaluates only those, asynchronously.
+ *   Grids in the Scene BVH mode trace the refitted Building BVH from then on, instead of gathering the whole world again
+ */
+UCLASS()
+class ROTATEOBJECTS_API USceneChangeTracker : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	USceneChangeTracker();
+
+	/**
+	 * Component is about to move (or to be destroyed), call it before every move. The bounds it has now are kept until the changes
+	 * are committed, the bounds it moves to are read when they are needed. A destroyed component has none.
+	 */
+	void NotifyMoving(USceneComponent* Component);
+
+	/**
+	 * One instance of an instanced component is about to move (or to be removed), merged per instance like NotifyMoving.
+	 * Index reuse after a removal is not tracked: the instance moved into the slot is only evaluated again where it is.
+	 */
+	void NotifyInstanceMoving(class UInstancedStaticMeshComponent* Component, int32 InstanceIndex);
+
+	// An instance was added, it had no bounds before
+	void NotifyInstanceAdded(class UInstancedStaticMeshComponent* Component, int32 InstanceIndex);
+
+	//Invalidates and re-evaluates the sensor grids for every recorded move
+	UFUNCTION(BlueprintCallable, Category = "Scene Changes")
+	void CommitChanges();
+
+	UFUNCTION(BlueprintPure, Category = "Scene Changes")
+	bool HasPendingChanges() const { return PendingChanges.Num() > 0; }
+
+	/**
+	 * Switches between the preview and the full tier, bound to ABaseGizmo::OnGizmoStateChange by the Transformer Tool.
+	 * A finished transform commits the recorded changes.
+	 */
+	UFUNCTION()
+	void HandleGizmoStateChange(ETransformationType GizmoType, bool bTransformInProgress, ETransformationDomain Domain);
+
+	UFUNCTION(BlueprintPure, Category = "Scene Changes")
+	bool IsPreviewing() const { return bDragInProgress && bLivePreview; }
+
+	//Whether sensor grids get a coarse preview while a building is dragged
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Scene Changes")
+	bool bLivePreview;
+
+	//One sensor of every PreviewStride x PreviewStride cell is traced for the preview
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Scene Changes", meta = (ClampMin = "1"))
+	int32 PreviewStride;
+
+	//Time the preview may take per frame, for every grid together, in milliseconds
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Scene Changes", meta = (ClampMin = "0"))
+	float PreviewBudgetMs;
+
+	//Seconds without a move after which recorded moves are committed on their own
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Scene Changes", meta = (ClampMin = "0"))
+	float SettleDelay;
+
+	// Bounds of what moving Component moves: the whole actor for a root component
+	static FBox GetMovedBounds(const USceneComponent* Component);
+
+	// World bounds of one instance of an instanced component, invalid if there is no such instance
+	static FBox GetInstanceBounds(const class UInstancedStaticMeshComponent* Component, int32 InstanceIndex);
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+private:
+
+	// What moved: a component, or one instance of an instanced component
+	struct FSceneChangeKey
+	{
+		TWeakObjectPtr<USceneComponent> Component;
+		int32 Item = INDEX_NONE;
+
+		bool operator==(const FSceneChangeKey& Other) const { return Component == Other.Component && Item == Other.Item; }
+		friend uint32 GetTypeHash(const FSceneChangeKey& Key) { return HashCombine(GetTypeHash(Key.Component), ::GetTypeHash(Key.Item)); }
+	};
+
+	struct FSceneChange
+	{
+		FBox OldBounds;
+
+		// As of the last RefreshMovedBounds
+		FBox NewBounds;
+
+		// Moved since NewBounds was read, the key is in MovedKeys
+		bool bMoved = false;
+	};
+
+	TMap<FSceneChangeKey, FSceneChange> PendingChanges;
+
+	// Changes whose NewBounds are out of date
+	TArray<FSceneChangeKey> MovedKeys;
+
+	// Bounds the preview has not invalidated yet: the OldBounds of new changes and NewBounds that changed when refreshed
+	TArray<FBox> UnpreviewedBounds;
+
+	/**
+	 * Merges a move into PendingChanges. A key seen for the first time since the last commit keeps OldBounds
+	 * and is passed on to the Building BVH.
+	 */
+	void RecordChange(const FSceneChangeKey& Key, const FBox& OldBounds);
+
+	// Reads the NewBounds of every change in MovedKeys, the ones that changed are added to UnpreviewedBounds
+	void RefreshMovedBounds();
+
+	// Current world bounds of what Key moves
+	static FBox GetBounds(const FSceneChangeKey& Key);
+
+	// Previews the pending changes on every grid
+	void UpdatePreview();
+
+	// World time of the last move reported
+	double LastMoveTime;
+
+	// A gizmo transform is in progress
+	bool bDragInProgress;
+};
@@ -0,0 +1,749 @@
+#include "SensorGrid.h"
+#include "SceneBVH.h"
+#include "BuildingBVHSubsystem.h"
+#include "../RotateObjects.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Components/LightComponent.h"
+#include "DrawDebugHelpers.h"
+#include "Engine/DirectionalLight.h"
+#include "Engine/World.h"
+#include "HAL/PlatformTime.h"
+
+DECLARE_CYCLE_STAT(TEXT("Sensor Grid Evaluate"), STAT_SensorGridEvaluate, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Sensor Grid Invalidate"), STAT_SensorGridInvalidate, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Sensor Grid Daylight"), STAT_SensorGridDaylight, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Sensor Grid Evaluate Async"), STAT_SensorGridEvaluateAsync, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Sensor Grid Preview"), STAT_SensorGridPreview, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sensor Grid Preview Cells"), STAT_SensorGridPreviewCells, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sensors Evaluated"), STAT_SensorsEvaluated, STATGROUP_LuminaCity);
+
+namespace SensorGrid
+{
+	// Sensors handled by one task of a ParallelFor, large enough to amortize the task overhead
+	static const int32 SensorsPerTask = 256;
+
+	// Upper bound of the sensor count, a typo in Spacing should not allocate gigabytes
+	static const int32 MaxSensors = 4 * 1024 * 1024;
+
+	// Preview cells handled between two checks of the time budget
+	static const int32 PreviewCellsPerBlock = 4 * SensorsPerTask;
+
+	// Runs Body(Task, Begin, End) over [0, Num) in tasks of SensorsPerTask
+	template<typename FunctionType>
+	void ForEachChunk(int32 Num, const FunctionType& Body)
+	{
+		const int32 NumTasks = FMath::DivideAndRoundUp(Num, SensorsPerTask);
+		ParallelFor(NumTasks, [&](int32 Task)
+		{
+			const int32 Begin = Task * SensorsPerTask;
+			Body(Task, Begin, FMath::Min(Begin + SensorsPerTask, Num));
+		});
+	}
+}
+
+void FSensorGridBuffer::SetNum(int32 NumSensors)
+{
+	PositionX.SetNumZeroed(NumSensors);
+	PositionY.SetNumZeroed(NumSensors);
+	PositionZ.SetNumZeroed(NumSensors);
+	Illuminance.SetNumZeroed(NumSensors);
+	DirectIlluminance.SetNumZeroed(NumSensors);
+	DiffuseIlluminance.SetNumZeroed(NumSensors);
+	SkyFactor.SetNumZeroed(NumSensors);
+	DaylightFactor.SetNumZeroed(NumSensors);
+	SunHours.SetNumZeroed(NumSensors);
+	Dirty.Init(1, NumSensors);
+}
+
+ASensorGrid::ASensorGrid()
+{
+	PrimaryActorTick.bCanEverTick = false;
+
+	RootScene = CreateDefaultSubobject<USceneComponent>(TEXT("RootScene"));
+	RootComponent = RootScene;
+
+	Extent = FVector2D(2000.f, 2000.f);
+	Spacing = 100.f;
+	Height = 80.f;
+	Sun = nullptr;
+	SkyIlluminance = 10000.f;
+	TraceDistance = 100000.f;
+	TraceChannel = ECC_Visibility;
+	VisibilityMode = ESensorVisibilityMode::SV_PhysicsTrace;
+	SkyDomeBands = 8;
+	DaylightSkyModel = EDaylightSkyModel::DS_CIEOvercast;
+	SceneBVHLOD = 0;
+	bSceneBVHStale = false;
+	bSceneBVHRefitted = false;
+	bAsyncEvaluationRunning = false;
+	bEvaluateAgain = false;
+	AsyncEvaluationSerial = 0;
+	PreviewCursor = 0;
+
+	GridSize = FIntPoint::ZeroValue;
+	EvaluatedSunDirection = FVector::ZeroVector;
+	EvaluatedSunIntensity = -1.f;
+	EvaluatedSkyIlluminance = -1.f;
+}
+
+void ASensorGrid::OnConstruction(const FTransform& Transform)
+{
+	Super::OnConstruction(Transform);
+	BuildGrid();
+}
+
+void ASensorGrid::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	CancelSunHours();
+	Super::EndPlay(EndPlayReason);
+}
+
+void ASensorGrid::BuildGrid()
+{
+	GridTransform = FTransform(GetActorQuat(), GetActorLocation());
+	++AsyncEvaluationSerial;
+
+	const float Step = FMath::Max(Spacing, 1.f);
+	GridSize.X = FMath::FloorToInt(FMath::Max(Extent.X, 0.f) / Step) + 1;
+	GridSize.Y = FMath::FloorToInt(FMath::Max(Extent.Y, 0.f) / Step) + 1;
+	if (int64(GridSize.X) * GridSize.Y > SensorGrid::MaxSensors)
+	{
+		UE_LOG(LogLuminaCity, Warning, TEXT("%s: %d x %d sensors is too many, increase the Spacing"), *GetName(), GridSize.X, GridSize.Y);
+		GridSize = FIntPoint::ZeroValue;
+	}
+
+	Sensors.SetNum(GridSize.X * GridSize.Y);
+
+	//centered on the actor
+	const FVector AxisX = GridTransform.GetUnitAxis(EAxis::X);
+	const FVector AxisY = GridTransform.GetUnitAxis(EAxis::Y);
+	const FVector Offset = GridTransform.GetUnitAxis(EAxis::Z) * Height
+		- AxisX * (0.5f * (GridSize.X - 1) * Step)
+		- AxisY * (0.5f * (GridSize.Y - 1) * Step);
+
+	for (int32 y = 0; y < GridSize.Y; ++y)
+	{
+		for (int32 x = 0; x < GridSize.X; ++x)
+		{
+			const int32 Index = y * GridSize.X + x;
+			const FVector Position = Offset + AxisX * (x * Step) + AxisY * (y * Step);
+			Sensors.PositionX[Index] = Position.X;
+			Sensors.PositionY[Index] = Position.Y;
+			Sensors.PositionZ[Index] = Position.Z;
+		}
+	}
+}
+
+bool ASensorGrid::GetSunState(FVector& OutDirection, float& OutIntensity) const
+{
+	const ULightComponent* Light = Sun ? Sun->GetLightComponent() : nullptr;
+	if (!Light || !Light->IsVisible())
+	{
+		OutDirection = FVector::ZeroVector;
+		OutIntensity = 0.f;
+		return false;
+	}
+
+	//the light travels along the forward vector
+	OutDirection = -Light->GetForwardVector();
+	OutIntensity = Light->Intensity;
+	return true;
+}
+
+void ASensorGrid::PrepareEvaluation(FVector& OutSunDirection, float& OutSunIntensity)
+{
+	if (!GridTransform.Equals(FTransform(GetActorQuat(), GetActorLocation())))
+		BuildGrid();
+
+	GetSunState(OutSunDirection, OutSunIntensity);
+
+	if (!OutSunDirection.Equals(EvaluatedSunDirection, 1e-4f)
+		|| OutSunIntensity != EvaluatedSunIntensity
+		|| SkyIlluminance != EvaluatedSkyIlluminance)
+	{
+		MarkAllDirty();
+		EvaluatedSunDirection = OutSunDirection;
+		EvaluatedSunIntensity = OutSunIntensity;
+		EvaluatedSkyIlluminance = SkyIlluminance;
+	}
+}
+
+int32 ASensorGrid::Evaluate()
+{
+	SCOPE_CYCLE_COUNTER(STAT_SensorGridEvaluate);
+
+	FVector SunDirection;
+	float SunIntensity;
+	PrepareEvaluation(SunDirection, SunIntensity);
+
+	TArray<int32> DirtyIndices;
+	for (int32 i = 0; i < Sensors.Num(); ++i)
+	{
+		if (Sensors.Dirty[i])
+			DirtyIndices.Add(i);
+	}
+
+	if (DirtyIndices.Num() == 0) return 0;
+
+	if (VisibilityMode == ESensorVisibilityMode::SV_PhysicsTrace)
+		EvaluatePhysicsTrace(DirtyIndices, SunDirection, SunIntensity);
+	else
+		EvaluateSceneBVH(DirtyIndices, SunDirection, SunIntensity);
+
+	INC_DWORD_STAT_BY(STAT_SensorsEvaluated, DirtyIndices.Num());
+	return DirtyIndices.Num();
+}
+
+bool ASensorGrid::EvaluateAsync()
+{
+	SCOPE_CYCLE_COUNTER(STAT_SensorGridEvaluateAsync);
+
+	if (bAsyncEvaluationRunning)
+	{
+		bEvaluateAgain = true;
+		return false;
+	}
+
+	//physics traces have to stay in sync with the physics scene
+	if (VisibilityMode == ESensorVisibilityMode::SV_PhysicsTrace)
+	{
+		OnEvaluated.Broadcast(Evaluate());
+		return true;
+	}
+
+	FVector SunDirection;
+	float SunIntensity;
+	PrepareEvaluation(SunDirection, SunIntensity);
+
+	TArray<int32> DirtyIndices;
+	for (int32 i = 0; i < Sensors.Num(); ++i)
+	{
+		if (Sensors.Dirty[i])
+		{
+			DirtyIndices.Add(i);
+			Sensors.Dirty[i] = 2;
+		}
+	}
+
+	if (DirtyIndices.Num() == 0)
+	{
+		OnEvaluated.Broadcast(0);
+		return true;
+	}
+
+	//the world is only read here, on the Game Thread; a Scene BVH is built from this snapshot on the thread pool,
+	//the Building BVH is refitted here and traced as an immutable snapshot
+	TSharedPtr<const ISceneOccluder, ESPMode::ThreadSafe> Occluder;
+	TSharedPtr<FSceneBVH, ESPMode::ThreadSafe> NewBVH;
+	TArray<FVector3f> Vertices;
+	if (TracesBuildingBVH())
+	{
+		Occluder = GetOccluder();
+	}
+	else if (!SceneBVH.IsValid() || bSceneBVHStale || bSceneBVHRefitted)
+	{
+		FSceneBVH::GatherWorldTriangles(GetWorld(), GetActorLocation(), Vertices, { this }, SceneBVHLOD);
+		NewBVH = MakeShared<FSceneBVH, ESPMode::ThreadSafe>();
+		bSceneBVHStale = false;
+		bSceneBVHRefitted = false;
+	}
+	else
+	{
+		Occluder = SceneBVH;
+	}
+	const FVector BVHOrigin = NewBVH.IsValid() ? GetActorLocation() : Occluder->GetOrigin();
+
+	if (SkyDome.Num() == 0 || SkyDome.Num() != FSkyDome::NumPatches(SkyDomeBands))
+		SkyDome.Build(SkyDomeBands);
+
+	const FVector Origin = GridTransform.GetLocation();
+	TArray<FVector3f> Points;
+	Points.SetNumUninitialized(DirtyIndices.Num());
+	for (int32 j = 0; j < DirtyIndices.Num(); ++j)
+		Points[j] = FVector3f(Origin + Sensors.GetRelativePosition(DirtyIndices[j]) - BVHOrigin);
+
+	const FVector Normal = GetPlaneNormal();
+	const float CosSun = FVector::DotProduct(Normal, SunDirection);
+	const FVector3f TraceSunDirection = SunIntensity > 0.f ? FVector3f(SunDirection) : FVector3f::ZeroVector;
+	FSolarVisibility::FSettings Settings;
+	Settings.MaxDistance = TraceDistance;
+
+	bAsyncEvaluationRunning = true;
+	Async(EAsyncExecution::ThreadPool, [WeakThis = TWeakObjectPtr<ASensorGrid>(this), Serial = AsyncEvaluationSerial, Occluder, NewBVH
+		, Vertices = MoveTemp(Vertices), BVHOrigin, Points = MoveTemp(Points), DirtyIndices = MoveTemp(DirtyIndices)
+		, Normal = FVector3f(Normal), TraceSunDirection, Sky = SkyDome, Settings, SunIntensity, CosSun]() mutable
+	{
+		if (NewBVH.IsValid())
+		{
+			NewBVH->Build(MoveTemp(Vertices), BVHOrigin);
+			Occluder = NewBVH;
+		}
+
+		TArray<uint8> SunVisible;
+		TArray<float> SkyFactor;
+		SunVisible.SetNumUninitialized(Points.Num());
+		SkyFactor.SetNumUninitialized(Points.Num());
+		FSolarVisibility::Evaluate(*Occluder, Points, Normal, TraceSunDirection, Sky, Settings, SunVisible, SkyFactor);
+
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Serial, NewBVH, DirtyIndices = MoveTemp(DirtyIndices)
+			, SunVisible = MoveTemp(SunVisible), SkyFactor = MoveTemp(SkyFactor), SunIntensity, CosSun]()
+		{
+			if (ASensorGrid* Grid = WeakThis.Get())
+				Grid->FinishAsyncEvaluation(Serial, NewBVH, DirtyIndices, SunVisible, SkyFactor, SunIntensity, CosSun);
+		});
+	});
+	return true;
+}
+
+void ASensorGrid::FinishAsyncEvaluation(int32 Serial, const TSharedPtr<FSceneBVH, ESPMode::ThreadSafe>& BuiltBVH, const TArray<int32>& DirtyIndices
+	, const TArray<uint8>& SunVisible, const TArray<float>& SkyFactor, float SunIntensity, float CosSun)
+{
+	bAsyncEvaluationRunning = false;
+
+	//the stale flags were cleared when the BVH was dispatched, it matches the world of then even if the results are dropped
+	if (BuiltBVH.IsValid())
+		SceneBVH = BuiltBVH;
+
+	//the grid was rebuilt meanwhile, its sensors are all dirty again
+	if (Serial == AsyncEvaluationSerial)
+	{
+		int32 NumEvaluated = 0;
+		for (int32 j = 0; j < DirtyIndices.Num(); ++j)
+		{
+			//0: evaluated synchronously in the meantime, 1: invalidated again, written but kept dirty
+			const int32 i = DirtyIndices[j];
+			if (Sensors.Dirty[i] == 0) continue;
+
+			const float Direct = SunVisible[j] ? SunIntensity * CosSun : 0.f;
+			const float Diffuse = SkyIlluminance * SkyFactor[j];
+			Sensors.DirectIlluminance[i] = Direct;
+			Sensors.DiffuseIlluminance[i] = Diffuse;
+			Sensors.SkyFactor[i] = SkyFactor[j];
+			Sensors.Illuminance[i] = Direct + Diffuse;
+			if (Sensors.Dirty[i] == 2)
+				Sensors.Dirty[i] = 0;
+			++NumEvaluated;
+		}
+
+		INC_DWORD_STAT_BY(STAT_SensorsEvaluated, NumEvaluated);
+		OnEvaluated.Broadcast(NumEvaluated);
+	}
+
+	if (bEvaluateAgain)
+	{
+		bEvaluateAgain = false;
+		EvaluateAsync();
+	}
+}
+
+int32 ASensorGrid::EvaluatePreview(int32 Stride, float BudgetMs)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SensorGridPreview);
+
+	UWorld* World = GetWorld();
+	if (!World || Sensors.Num() == 0) return 0;
+
+	//the grid itself is being moved, its sensors are replaced on the next full evaluation
+	if (!GridTransform.Equals(FTransform(GetActorQuat(), GetActorLocation()))) return 0;
+
+	Stride = FMath::Max(Stride, 1);
+	const FIntPoint NumCells(FMath::DivideAndRoundUp(GridSize.X, Stride), FMath::DivideAndRoundUp(GridSize.Y, Stride));
+	const int32 CellCount = NumCells.X * NumCells.Y;
+	if (PreviewCursor >= CellCount)
+		PreviewCursor = 0;
+
+	FVector SunDirection;
+	float SunIntensity;
+	const bool bSun = GetSunState(SunDirection, SunIntensity) && SunIntensity > 0.f;
+	const FVector Origin = GridTransform.GetLocation();
+	const float CosSun = FVector::DotProduct(GetPlaneNormal(), SunDirection);
+
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(SensorGridPreview), false, this);
+
+	const double EndTime = FPlatformTime::Seconds() + BudgetMs / 1000.0;
+	int32 NumTraced = 0;
+	for (int32 Visited = 0; Visited < CellCount && FPlatformTime::Seconds() < EndTime; )
+	{
+		const int32 First = PreviewCursor;
+		const int32 Num = FMath::Min(SensorGrid::PreviewCellsPerBlock, CellCount - First);
+
+		TArray<int32> TaskCounts;
+		TaskCounts.SetNumZeroed(FMath::DivideAndRoundUp(Num, SensorGrid::SensorsPerTask));
+
+		SensorGrid::ForEachChunk(Num, [&](int32 Task, int32 Begin, int32 End)
+		{
+			for (int32 c = Begin; c < End; ++c)
+			{
+				const int32 Cell = First + c;
+				const int32 X0 = (Cell % NumCells.X) * Stride;
+				const int32 Y0 = (Cell / NumCells.X) * Stride;
+				const int32 X1 = FMath::Min(X0 + Stride, GridSize.X);
+				const int32 Y1 = FMath::Min(Y0 + Stride, GridSize.Y);
+
+				//only cells with a dirty sensor are previewed
+				bool bCellDirty = false;
+				for (int32 y = Y0; y < Y1 && !bCellDirty; ++y)
+				{
+					for (int32 x = X0; x < X1 && !bCellDirty; ++x)
+						bCellDirty = Sensors.Dirty[y * GridSize.X + x] != 0;
+				}
+				if (!bCellDirty) continue;
+
+				float Direct = 0.f;
+				if (bSun && CosSun > 0.f)
+				{
+					const FVector Start = Origin + Sensors.GetRelativePosition(Y0 * GridSize.X + X0) + SunDirection;
+					if (!World->LineTraceTestByChannel(Start, Start + SunDirection * TraceDistance, TraceChannel, Params))
+						Direct = SunIntensity * CosSun;
+				}
+
+				for (int32 y = Y0; y < Y1; ++y)
+				{
+					for (int32 x = X0; x < X1; ++x)
+					{
+						const int32 i = y * GridSize.X + x;
+						if (!Sensors.Dirty[i]) continue;
+
+						Sensors.DirectIlluminance[i] = Direct;
+						Sensors.Illuminance[i] = Direct + Sensors.DiffuseIlluminance[i];
+					}
+				}
+				++TaskCounts[Task];
+			}
+		});
+
+		for (int32 Count : TaskCounts)
+			NumTraced += Count;
+
+		PreviewCursor = (First + Num) % CellCount;
+		Visited += Num;
+	}
+
+	INC_DWORD_STAT_BY(STAT_SensorGridPreviewCells, NumTraced);
+	return NumTraced;
+}
+
+void ASensorGrid::EvaluatePhysicsTrace(const TArray<int32>& DirtyIndices, const FVector& SunDirection, float SunIntensity)
+{
+	UWorld* World = GetWorld();
+	if (!World) return;
+
+	const FVector Origin = GridTransform.GetLocation();
+	const FVector Normal = GetPlaneNormal();
+	const float CosSun = FVector::DotProduct(Normal, SunDirection);
+
+	//isotropic sky seen by a plane tilted away from up
+	const float ViewFactor = 0.5f * (1.f + Normal.Z);
+	const float Diffuse = SkyIlluminance * ViewFactor;
+
+	FCollisionQueryParams Params(SCENE_QUERY_STAT(SensorGridSun), false, this);
+
+	//scene queries only read the physics scene, the Game Thread waits in ParallelFor meanwhile
+	SensorGrid::ForEachChunk(DirtyIndices.Num(), [&](int32, int32 Begin, int32 End)
+	{
+		for (int32 j = Begin; j < End; ++j)
+		{
+			const int32 i = DirtyIndices[j];
+
+			float Direct = 0.f;
+			if (SunIntensity > 0.f && CosSun > 0.f)
+			{
+				//nudged towards the sun so that the plane the sensor sits on does not block it
+				const FVector Start = Origin + Sensors.GetRelativePosition(i) + SunDirection;
+				if (!World->LineTraceTestByChannel(Start, Start + SunDirection * TraceDistance, TraceChannel, Params))
+					Direct = SunIntensity * CosSun;
+			}
+
+			Sensors.DirectIlluminance[i] = Direct;
+			Sensors.DiffuseIlluminance[i] = Diffuse;
+			Sensors.SkyFactor[i] = ViewFactor;
+			Sensors.Illuminance[i] = Direct + Diffuse;
+			Sensors.Dirty[i] = 0;
+		}
+	});
+}
+
+void ASensorGrid::EvaluateSceneBVH(const TArray<int32>& DirtyIndices, const FVector& SunDirection, float SunIntensity)
+{
+	const TSharedPtr<const ISceneOccluder, ESPMode::ThreadSafe> Occluder = GetOccluder();
+
+	if (SkyDome.Num() == 0 || SkyDome.Num() != FSkyDome::NumPatches(SkyDomeBands))
+		SkyDome.Build(SkyDomeBands);
+
+	const FVector Origin = GridTransform.GetLocation();
+	const FVector Normal = GetPlaneNormal();
+	const float CosSun = FVector::DotProduct(Normal, SunDirection);
+
+	TArray<FVector3f> Points;
+	Points.SetNumUninitialized(DirtyIndices.Num());
+	for (int32 j = 0; j < DirtyIndices.Num(); ++j)
+		Points[j] = Occluder->ToLocal(Origin + Sensors.GetRelativePosition(DirtyIndices[j]));
+
+	TArray<uint8> SunVisible;
+	TArray<float> SkyFactor;
+	SunVisible.SetNumUninitialized(Points.Num());
+	SkyFactor.SetNumUninitialized(Points.Num());
+
+	FSolarVisibility::FSettings Settings;
+	Settings.MaxDistance = TraceDistance;
+	FSolarVisibility::Evaluate(*Occluder, Points, FVector3f(Normal), SunIntensity > 0.f ? FVector3f(SunDirection) : FVector3f::ZeroVector
+		, SkyDome, Settings, SunVisible, SkyFactor);
+
+	for (int32 j = 0; j < DirtyIndices.Num(); ++j)
+	{
+		const int32 i = DirtyIndices[j];
+		const float Direct = SunVisible[j] ? SunIntensity * CosSun : 0.f;
+		const float Diffuse = SkyIlluminance * SkyFactor[j];
+
+		Sensors.DirectIlluminance[i] = Direct;
+		Sensors.DiffuseIlluminance[i] = Diffuse;
+		Sensors.SkyFactor[i] = SkyFactor[j];
+		Sensors.Illuminance[i] = Direct + Diffuse;
+		Sensors.Dirty[i] = 0;
+	}
+}
+
+int32 ASensorGrid::EvaluateDaylightMetrics()
+{
+	SCOPE_CYCLE_COUNTER(STAT_SensorGridDaylight);
+
+	if (!GridTransform.Equals(FTransform(GetActorQuat(), GetActorLocation())))
+		BuildGrid();
+
+	if (Sensors.Num() == 0) return 0;
+
+	const TSharedPtr<const ISceneOccluder, ESPMode::ThreadSafe> Occluder = GetOccluder();
+
+	FVector SunDirection;
+	float SunIntensity;
+	if (!GetSunState(SunDirection, SunIntensity))
+		SunDirection = FVector::UpVector;
+	if (!DaylightSky.Matches(DaylightSkyModel, FVector3f(SunDirection)))
+		DaylightSky.Build(DaylightSkyModel, FVector3f(SunDirection));
+
+	const FVector Origin = GridTransform.GetLocation();
+	TArray<FVector3f> Points;
+	Points.SetNumUninitialized(Sensors.Num());
+	for (int32 i = 0; i < Sensors.Num(); ++i)
+		Points[i] = Occluder->ToLocal(Origin + Sensors.GetRelativePosition(i));
+
+	FSolarVisibility::FSettings Settings;
+	Settings.MaxDistance = TraceDistance;
+	FSolarVisibility::EvaluateDaylight(*Occluder, Points, FVector3f(GetPlaneNormal()), DaylightSky, Settings
+		, Sensors.SkyFactor, Sensors.DaylightFactor);
+
+	return Sensors.Num();
+}
+
+float ASensorGrid::GetDaylightFactor(int32 Index) const
+{
+	return Sensors.DaylightFactor.IsValidIndex(Index) ? Sensors.DaylightFactor[Index] : 0.f;
+}
+
+float ASensorGrid::GetSkyViewFactor(int32 Index) const
+{
+	return Sensors.SkyFactor.IsValidIndex(Index) ? Sensors.SkyFactor[Index] : 0.f;
+}
+
+void ASensorGrid::RebuildSceneBVH()
+{
+	TSharedPtr<FSceneBVH, ESPMode::ThreadSafe> NewBVH = MakeShared<FSceneBVH, ESPMode::ThreadSafe>();
+	NewBVH->BuildFromWorld(GetWorld(), GetActorLocation(), { this }, SceneBVHLOD);
+	SetSceneBVH(NewBVH);
+}
+
+bool ASensorGrid::TracesBuildingBVH() const
+{
+	//a move the Building BVH was not told about needs the rebuild
+	return VisibilityMode == ESensorVisibilityMode::SV_BuildingBVH
+		|| (VisibilityMode == ESensorVisibilityMode::SV_SceneBVH && bSceneBVHRefitted && !bSceneBVHStale);
+}
+
+TSharedPtr<const ISceneOccluder, ESPMode::ThreadSafe> ASensorGrid::GetOccluder()
+{
+	if (TracesBuildingBVH())
+	{
+		if (UBuildingBVHSubsystem* Buildings = GetWorld() ? GetWorld()->GetSubsystem<UBuildingBVHSubsystem>() : nullptr)
+			return Buildings->GetBVH();
+	}
+
+	if (!SceneBVH.IsValid() || bSceneBVHStale || bSceneBVHRefitted)
+		RebuildSceneBVH();
+	return SceneBVH;
+}
+
+void ASensorGrid::SetSceneBVH(const TSharedPtr<FSceneBVH, ESPMode::ThreadSafe>& InSceneBVH)
+{
+	SceneBVH = InSceneBVH;
+	bSceneBVHStale = false;
+	bSceneBVHRefitted = false;
+	if (VisibilityMode == ESensorVisibilityMode::SV_SceneBVH)
+		MarkAllDirty();
+}
+
+bool ASensorGrid::StartSunHours(const FSunHoursSettings& Settings)
+{
+	if (IsSunHoursRunning()) return false;
+
+	const TSharedPtr<const ISceneOccluder, ESPMode::ThreadSafe> Occluder = GetOccluder();
+
+	const FVector Origin = GridTransform.GetLocation();
+	TArray<FVector3f> Points;
+	Points.SetNumUninitialized(Sensors.Num());
+	for (int32 i = 0; i < Sensors.Num(); ++i)
+		Points[i] = Occluder->ToLocal(Origin + Sensors.GetRelativePosition(i));
+
+	SunHoursSimulation = MakeShared<FSunHoursSimulation, ESPMode::ThreadSafe>(
+		Occluder, MoveTemp(Points), FVector3f(GetPlaneNormal()), Settings);
+
+	TWeakObjectPtr<ASensorGrid> WeakThis(this);
+	TWeakPtr<FSunHoursSimulation, ESPMode::ThreadSafe> WeakSimulation(SunHoursSimulation);
+	SunHoursSimulation->RunAsync([WeakThis, WeakSimulation](bool bCompleted)
+	{
+		ASensorGrid* Grid = WeakThis.Get();
+		TSharedPtr<FSunHoursSimulation, ESPMode::ThreadSafe> Simulation = WeakSimulation.Pin();
+		if (!Grid || !Simulation.IsValid() || Grid->SunHoursSimulation != Simulation) return;
+
+		//the grid may have been rebuilt in the meantime
+		if (bCompleted && Simulation->GetSunHours().Num() == Grid->Sensors.Num())
+			Grid->Sensors.SunHours = Simulation->GetSunHours();
+
+		Grid->SunHoursSimulation.Reset();
+		Grid->OnSunHoursFinished.Broadcast(bCompleted);
+	});
+	return true;
+}
+
+void ASensorGrid::CancelSunHours()
+{
+	if (SunHoursSimulation.IsValid())
+		SunHoursSimulation->Cancel();
+}
+
+float ASensorGrid::GetSunHoursProgress() const
+{
+	return SunHoursSimulation.IsValid() ? SunHoursSimulation->GetProgress() : 0.f;
+}
+
+bool ASensorGrid::IsSunHoursRunning() const
+{
+	return SunHoursSimulation.IsValid();
+}
+
+float ASensorGrid::GetSunHours(int32 Index) const
+{
+	if (Index < 0 || Index >= Sensors.Num()) return 0.f;
+	return Sensors.SunHours[Index];
+}
+
+int32 ASensorGrid::InvalidateBounds(const FBox& Bounds, bool bBuildingBVHNotified)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SensorGridInvalidate);
+
+	if (!Bounds.IsValid || Sensors.Num() == 0) return 0;
+
+	const FBox Box = Bounds.ExpandBy(1.f);
+	const FVector Origin = GridTransform.GetLocation();
+
+	FVector SunDirection;
+	float SunIntensity;
+	const bool bSun = GetSunState(SunDirection, SunIntensity) && SunIntensity > 0.f;
+	const FVector SunRay = SunDirection * TraceDistance;
+
+	//with sky rays a box shades the sensors it hides a patch ray from. The rays are about a patch (HALF_PI / Bands) apart,
+	//a box seen under an angular radius of half a patch hides about one of them. The reach is taken at a quarter patch,
+	//twice as far, as a margin for smaller boxes lined up with a ray; farther sensors are left as they are
+	const bool bSkyRays = VisibilityMode != ESensorVisibilityMode::SV_PhysicsTrace;
+	const FVector BoxCenter = Box.GetCenter();
+	const float BoxRadius = Box.GetExtent().Size();
+	const float SkyReach = BoxRadius / FMath::Sin(0.25f * HALF_PI / FMath::Max(SkyDomeBands, 1));
+	const FVector Normal = GetPlaneNormal();
+	if (bSkyRays)
+	{
+		//gathering every triangle of the world again costs more than tracing the few dirty sensors
+		if (bBuildingBVHNotified)
+			bSceneBVHRefitted = true;
+		else
+			bSceneBVHStale = true;
+	}
+
+	TArray<int32> TaskCounts;
+	TaskCounts.SetNumZeroed(FMath::DivideAndRoundUp(Sensors.Num(), SensorGrid::SensorsPerTask));
+
+	SensorGrid::ForEachChunk(Sensors.Num(), [&](int32 Task, int32 Begin, int32 End)
+	{
+		for (int32 i = Begin; i < End; ++i)
+		{
+			if (Sensors.Dirty[i] == 1) continue;
+
+			const FVector Position = Origin + Sensors.GetRelativePosition(i);
+			const FVector ToBox = BoxCenter - Position;
+			const bool bAffected = Box.IsInside(Position)
+				|| (bSun && FMath::LineBoxIntersection(Box, Position, Position + SunRay, SunRay))
+				|| (bSkyRays && ToBox.SizeSquared() < FMath::Square(SkyReach)
+					&& FVector::DotProduct(ToBox, Normal) > -BoxRadius);
+
+			if (bAffected)
+			{
+				Sensors.Dirty[i] = 1;
+				++TaskCounts[Task];
+			}
+		}
+	});
+
+	int32 NumDirty = 0;
+	for (int32 Count : TaskCounts)
+		NumDirty += Count;
+	return NumDirty;
+}
+
+void ASensorGrid::MarkAllDirty()
+{
+	for (uint8& Dirty : Sensors.Dirty)
+		Dirty = 1;
+}
+
+FVector ASensorGrid::GetSensorLocation(int32 Index) const
+{
+	if (Index < 0 || Index >= Sensors.Num()) return FVector::ZeroVector;
+	return GridTransform.GetLocation() + Sensors.GetRelativePosition(Index);
+}
+
+float ASensorGrid::GetIlluminance(int32 Index) const
+{
+	if (Index < 0 || Index >= Sensors.Num()) return 0.f;
+	return Sensors.Illuminance[Index];
+}
+
+void ASensorGrid::GetIlluminanceRange(float& OutAverage, float& OutMin, float& OutMax) const
+{
+	OutAverage = OutMin = OutMax = 0.f;
+	if (Sensors.Num() == 0) return;
+
+	double Sum = 0.0;
+	OutMin = TNumericLimits<float>::Max();
+	OutMax = TNumericLimits<float>::Lowest();
+	for (float Value : Sensors.Illuminance)
+	{
+		Sum += Value;
+		OutMin = FMath::Min(OutMin, Value);
+		OutMax = FMath::Max(OutMax, Value);
+	}
+	OutAverage = Sum / Sensors.Num();
+}
+
+void ASensorGrid::DrawSensors(float MinLux, float MaxLux, float Duration) const
+{
+	UWorld* World = GetWorld();
+	if (!World) return;
+
+	const FVector Origin = GridTransform.GetLocation();
+	const float Range = FMath::Max(MaxLux - MinLux, KINDA_SMALL_NUMBER);
+	for (int32 i = 0; i < Sensors.Num(); ++i)
+	{
+		const float Alpha = FMath::Clamp((Sensors.Illuminance[i] - MinLux) / Range, 0.f, 1.f);
+		const FColor Color = FLinearColor::LerpUsingHSV(FLinearColor::Blue, FLinearColor::Red, Alpha).ToFColor(true);
+		DrawDebugPoint(World, Origin + Sensors.GetRelativePosition(i), 8.f, Color, false, Duration);
+	}
+}
@@ -0,0 +1,327 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "DaylightSky.h"
+#include "SolarVisibility.h"
+#include "SunHours.h"
+#include "SensorGrid.generated.h"
+
+class FSceneBVH;
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FSunHoursFinishedDelegate, bool, bCompleted);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FSensorGridEvaluatedDelegate, int32, NumEvaluated);
+
+//How a Sensor Grid decides whether sun and sky are visible
+UENUM(BlueprintType)
+enum class ESensorVisibilityMode : uint8
+{
+	//Line traces against the physics scene for the sun, unobstructed isotropic sky
+	SV_PhysicsTrace		UMETA(DisplayName = "Physics Trace"),
+	//Sun and sky dome rays traced on the CPU through a BVH of the static meshes, works headless.
+	//Rebuilt from the whole world after a move, unless the move was passed to the Building BVH (see InvalidateBounds)
+	SV_SceneBVH			UMETA(DisplayName = "Scene BVH"),
+	//Like Scene BVH, through the Building BVH of the world, which is refitted instead of rebuilt when buildings move
+	SV_BuildingBVH		UMETA(DisplayName = "Building BVH"),
+};
+
+/**
+ * Per sensor data of a grid, one contiguous array per field (structure of arrays),
+ * so passes over a single field (e.g. all illuminance values) stay in cache.
+ * Positions are relative to the grid actor, in world orientation.
+ */
+struct FSensorGridBuffer
+{
+	TArray<float> PositionX;
+	TArray<float> PositionY;
+	TArray<float> PositionZ;
+
+	// lux, Direct + Diffuse
+	TArray<float> Illuminance;
+	TArray<float> DirectIlluminance;
+	TArray<float> DiffuseIlluminance;
+
+	// Visible part of the sky, cosine weighted (1 for an unobstructed horizontal sensor)
+	TArray<float> SkyFactor;
+
+	// Percent, filled by EvaluateDaylightMetrics
+	TArray<float> DaylightFactor;
+
+	// Hours of direct sun over a year, filled by a sun hours simulation
+	TArray<float> SunHours;
+
+	// 1 if the sensor has to be evaluated again, 2 while an asynchronous evaluation of it is running
+	TArray<uint8> Dirty;
+
+	int32 Num() const { return Illuminance.Num(); }
+
+	void SetNum(int32 NumSensors);
+
+	FVector GetRelativePosition(int32 Index) const
+	{
+		return FVector(PositionX[Index], PositionY[Index], PositionZ[Index]);
+	}
+};
+
+/**
+ * A regular grid of illuminance sensors on an analysis plane.
+ *
+ * The plane is the local XY plane of the actor: unrotated it is a floor or site plane,
+ * pitched by 90 degrees a facade. Sensors are placed every Spacing cm inside Extent,
+ * Height cm above the plane along its normal.
+ *
+ * Illuminance is direct sun plus sky diffuse, see ESensorVisibilityMode for how visibility is found.
+ * Evaluation only touches dirty sensors, InvalidateBounds marks the sensors a moved building could shade.
+ */
+UCLASS()
+class ROTATEOBJECTS_API ASensorGrid : public AActor
+{
+	GENERATED_BODY()
+
+public:
+
+	ASensorGrid();
+
+	//Size of the grid along the local X and Y axes, in cm
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor Grid", meta = (ClampMin = "0"))
+	FVector2D Extent;
+
+	//Distance between two sensors, in cm
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor Grid", meta = (ClampMin = "1"))
+	float Spacing;
+
+	//Offset of the sensors from the plane along its normal, in cm (e.g. 80 for a work plane)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor Grid")
+	float Height;
+
+	//Directional light used as the sun. Its intensity is taken as the direct normal illuminance in lux
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor Grid")
+	class ADirectionalLight* Sun;
+
+	//Diffuse illuminance of the sky on an unobstructed horizontal plane, in lux
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor Grid", meta = (ClampMin = "0"))
+	float SkyIlluminance;
+
+	//How far sun rays are traced, in cm
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor Grid", meta = (ClampMin = "0"))
+	float TraceDistance;
+
+	//Only used with the Physics Trace visibility mode
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor Grid")
+	TEnumAsByte<ECollisionChannel> TraceChannel;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor Grid")
+	ESensorVisibilityMode VisibilityMode;
+
+	//Altitude bands the sky dome is split into for the Scene BVH mode, the patch count grows with the square of this
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor Grid", meta = (ClampMin = "1", ClampMax = "32"))
+	int32 SkyDomeBands;
+
+	//Static mesh LOD the Scene BVH is built from, coarser LODs build and trace faster
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor Grid", meta = (ClampMin = "0"))
+	int32 SceneBVHLOD;
+
+	//Sky the daylight metrics are computed under, the clear sky takes its sun from Sun
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Daylight")
+	EDaylightSkyModel DaylightSkyModel;
+
+	//Builds the Scene BVH from the static meshes of the world. Done on the first Scene BVH evaluation as well
+	UFUNCTION(BlueprintCallable, Category = "Sensor Grid")
+	void RebuildSceneBVH();
+
+	/**
+	 * Starts computing the hours of direct sun of every sensor over a year, on the thread pool.
+	 * Traces the same BVH as the evaluation: the Building BVH in that mode, else the Scene BVH (built first if there is none). The results arrive in the Sun Hours of the sensors
+	 * and OnSunHoursFinished is called on the Game Thread.
+
+	 * @return false if a simulation is already running
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Sun Hours")
+	bool StartSunHours(const FSunHoursSettings& Settings);
+
+	/**
+	 * Computes the sky view factor and daylight factor of every sensor on the 145 Tregenza patches of DaylightSkyModel,
+	 * tracing the Building BVH in that mode, else the Scene BVH (built first if there is none), in parallel. The sky view factor replaces the Sky Factor of the sensors.
+	 * @return the number of sensors evaluated
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Daylight")
+	int32 EvaluateDaylightMetrics();
+
+	//Daylight factor of a sensor in percent, 0 for an invalid index
+	UFUNCTION(BlueprintPure, Category = "Daylight")
+	float GetDaylightFactor(int32 Index) const;
+
+	//Visible part of the sky of a sensor, cosine weighted (1 for an unobstructed horizontal sensor), 0 for an invalid index
+	UFUNCTION(BlueprintPure, Category = "Daylight")
+	float GetSkyViewFactor(int32 Index) const;
+
+	//Stops a running sun hours simulation, OnSunHoursFinished is called with false
+	UFUNCTION(BlueprintCallable, Category = "Sun Hours")
+	void CancelSunHours();
+
+	//0 to 1, 0 if no simulation is running
+	UFUNCTION(BlueprintPure, Category = "Sun Hours")
+	float GetSunHoursProgress() const;
+
+	UFUNCTION(BlueprintPure, Category = "Sun Hours")
+	bool IsSunHoursRunning() const;
+
+	//Hours of direct sun of a sensor from the last completed simulation, 0 for an invalid index
+	UFUNCTION(BlueprintPure, Category = "Sun Hours")
+	float GetSunHours(int32 Index) const;
+
+	UPROPERTY(BlueprintAssignable, Category = "Sun Hours")
+	FSunHoursFinishedDelegate OnSunHoursFinished;
+
+	//Uses a BVH built elsewhere, e.g. one shared by every grid of a study
+	void SetSceneBVH(const TSharedPtr<FSceneBVH, ESPMode::ThreadSafe>& InSceneBVH);
+
+	//(Re)places the sensors from Extent, Spacing and Height. Every sensor is dirty afterwards
+	UFUNCTION(BlueprintCallable, Category = "Sensor Grid")
+	void BuildGrid();
+
+	/**
+	 * Evaluates the dirty sensors, in parallel.
+	 * If the sun or sky changed since the last evaluation, every sensor is evaluated.
+	 * @return the number of sensors that were evaluated
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Sensor Grid")
+	int32 Evaluate();
+
+	/**
+	 * Evaluates the dirty sensors without blocking the Game Thread: with the Scene BVH mode the BVH
+	 * (if stale) is rebuilt and the rays are traced on the thread pool, the results are written back on the
+	 * Game Thread and OnEvaluated is called. The Building BVH mode traces a refitted snapshot of the Building BVH the same way,
+	 * the Physics Trace mode evaluates right away.
+	 * Sensors invalidated while an evaluation runs stay dirty, a call during one starts another when it finishes.
+	 * @return false if an evaluation was already running
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Sensor Grid")
+	bool EvaluateAsync();
+
+	UFUNCTION(BlueprintPure, Category = "Sensor Grid")
+	bool IsEvaluating() const { return bAsyncEvaluationRunning; }
+
+	/**
+	 * Coarse, sun only update of the dirty sensors for a live preview (e.g. while a building is dragged).
+	 * One sensor of every Stride x Stride cell is traced against the physics scene and its direct illuminance
+	 * is copied to the dirty sensors of the cell. The sensors stay dirty for the full evaluation.
+	 * Stops after BudgetMs and continues where it stopped on the next call.
+	 * @return the number of cells traced
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Sensor Grid")
+	int32 EvaluatePreview(int32 Stride = 4, float BudgetMs = 2.f);
+
+	//Called when EvaluateAsync wrote its results
+	UPROPERTY(BlueprintAssignable, Category = "Sensor Grid")
+	FSensorGridEvaluatedDelegate OnEvaluated;
+
+	/**
+	 * Marks the sensors a building inside Bounds could shade or have shaded.
+	 * Call with the old and the new bounds of a moved building, then Evaluate.
+	 * In the Scene BVH mode the next evaluation rebuilds the BVH from every triangle of the world, unless bBuildingBVHNotified:
+	 * the move was passed to UBuildingBVHSubsystem::NotifyComponentMoved (the Scene Change Tracker does), and the refitted
+	 * Building BVH is traced instead until RebuildSceneBVH is called.
+	 * @return the number of sensors that became dirty
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Sensor Grid")
+	int32 InvalidateBounds(const FBox& Bounds, bool bBuildingBVHNotified = false);
+
+	UFUNCTION(BlueprintCallable, Category = "Sensor Grid")
+	void MarkAllDirty();
+
+	UFUNCTION(BlueprintPure, Category = "Sensor Grid")
+	int32 GetNumSensors() const { return Sensors.Num(); }
+
+	//Number of sensors along the local X and Y axes, sensor (x, y) has index y * GridSize.X + x
+	UFUNCTION(BlueprintPure, Category = "Sensor Grid")
+	FIntPoint GetGridSize() const { return GridSize; }
+
+	UFUNCTION(BlueprintPure, Category = "Sensor Grid")
+	FVector GetSensorLocation(int32 Index) const;
+
+	//Illuminance of a sensor in lux, 0 for an invalid index
+	UFUNCTION(BlueprintPure, Category = "Sensor Grid")
+	float GetIlluminance(int32 Index) const;
+
+	//Average, minimum and maximum illuminance of the grid, in lux
+	UFUNCTION(BlueprintCallable, Category = "Sensor Grid")
+	void GetIlluminanceRange(float& OutAverage, float& OutMin, float& OutMax) const;
+
+	//Draws every sensor as a point, blue at MinLux to red at MaxLux
+	UFUNCTION(BlueprintCallable, Category = "Sensor Grid")
+	void DrawSensors(float MinLux, float MaxLux, float Duration = 0.f) const;
+
+	const FSensorGridBuffer& GetSensors() const { return Sensors; }
+
+	//Normal of the analysis plane
+	FVector GetPlaneNormal() const { return GetActorUpVector(); }
+
+protected:
+
+	virtual void OnConstruction(const FTransform& Transform) override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+
+	// Sun direction (towards the sun) and intensity, false if there is no sun
+	bool GetSunState(FVector& OutDirection, float& OutIntensity) const;
+
+	// Replaces the sensors if the actor moved and marks every sensor dirty if the sun or sky changed
+	void PrepareEvaluation(FVector& OutSunDirection, float& OutSunIntensity);
+
+	// Game Thread end of EvaluateAsync
+	void FinishAsyncEvaluation(int32 Serial, const TSharedPtr<FSceneBVH, ESPMode::ThreadSafe>& BuiltBVH, const TArray<int32>& DirtyIndices
+		, const TArray<uint8>& SunVisible, const TArray<float>& SkyFactor, float SunIntensity, float CosSun);
+
+	// Evaluates the dirty sensors of DirtyIndices with the given visibility mode
+	void EvaluatePhysicsTrace(const TArray<int32>& DirtyIndices, const FVector& SunDirection, float SunIntensity);
+	void EvaluateSceneBVH(const TArray<int32>& DirtyIndices, const FVector& SunDirection, float SunIntensity);
+
+	// What the CPU visibility modes trace: the Building BVH of the world or the Scene BVH (rebuilt first if needed)
+	TSharedPtr<const ISceneOccluder, ESPMode::ThreadSafe> GetOccluder();
+
+	// The Building BVH mode, or the Scene BVH mode after moves the Building BVH was told about
+	bool TracesBuildingBVH() const;
+
+	UPROPERTY(VisibleAnywhere, Category = "Sensor Grid")
+	class USceneComponent* RootScene;
+
+	FSensorGridBuffer Sensors;
+	FIntPoint GridSize;
+
+	// Sun and sky of the last evaluation, a change invalidates every sensor
+	FVector EvaluatedSunDirection;
+	float EvaluatedSunIntensity;
+	float EvaluatedSkyIlluminance;
+
+	// Transform the sensors were placed with
+	FTransform GridTransform;
+
+	TSharedPtr<FSceneBVH, ESPMode::ThreadSafe> SceneBVH;
+
+	// Set by InvalidateBounds, the BVH no longer matches the scene
+	bool bSceneBVHStale;
+
+	// Set by InvalidateBounds for moves the Building BVH was told about: it is traced until the Scene BVH is rebuilt
+	bool bSceneBVHRefitted;
+
+	FSkyDome SkyDome;
+
+	// Shared by every sensor, rebuilt when the model or the sun changes
+	FDaylightSky DaylightSky;
+
+	TSharedPtr<FSunHoursSimulation, ESPMode::ThreadSafe> SunHoursSimulation;
+
+	bool bAsyncEvaluationRunning;
+
+	// EvaluateAsync was called while one was running
+	bool bEvaluateAgain;
+
+	// Bumped by BuildGrid, results of evaluations started before are dropped
+	int32 AsyncEvaluationSerial;
+
+	// Cell EvaluatePreview continues at
+	int32 PreviewCursor;
+};
@@ -0,0 +1,127 @@
+#include "SolarPosition.h"
+#include "../RotateObjects.h"
+
+DECLARE_CYCLE_STAT(TEXT("Solar Ephemeris Build"), STAT_SolarEphemerisBuild, STATGROUP_LuminaCity);
+
+FSolarPosition FSolarPosition::Compute(const FDateTime& UTCTime, double Latitude, double Longitude)
+{
+	const int32 Year = UTCTime.GetYear();
+	const int32 Month = UTCTime.GetMonth();
+	const int32 Day = UTCTime.GetDay();
+	const double DecimalHours = UTCTime.GetHour() + (UTCTime.GetMinute() + (UTCTime.GetSecond() + UTCTime.GetMillisecond() / 1000.0) / 60.0) / 60.0;
+
+	//days since J2000.0, integer divisions as in the reference implementation
+	const int32 Aux1 = (Month - 14) / 12;
+	const int32 Aux2 = (1461 * (Year + 4800 + Aux1)) / 4 + (367 * (Month - 2 - 12 * Aux1)) / 12
+		- (3 * ((Year + 4900 + Aux1) / 100)) / 4 + Day - 32075;
+	const double JulianDate = Aux2 - 0.5 + DecimalHours / 24.0;
+	const double ElapsedDays = JulianDate - 2451545.0;
+
+	//ecliptic coordinates, radians
+	const double Omega = 2.1429 - 0.0010394594 * ElapsedDays;
+	const double MeanLongitude = 4.8950630 + 0.017202791698 * ElapsedDays;
+	const double MeanAnomaly = 6.2400600 + 0.0172019699 * ElapsedDays;
+	const double EclipticLongitude = MeanLongitude + 0.03341607 * FMath::Sin(MeanAnomaly)
+		+ 0.00034894 * FMath::Sin(2.0 * MeanAnomaly) - 0.0001134 - 0.0000203 * FMath::Sin(Omega);
+	const double EclipticObliquity = 0.4090928 - 6.2140e-9 * ElapsedDays + 0.0000396 * FMath::Cos(Omega);
+
+	//celestial coordinates
+	const double SinEclipticLongitude = FMath::Sin(EclipticLongitude);
+	double RightAscension = FMath::Atan2(FMath::Cos(EclipticObliquity) * SinEclipticLongitude, FMath::Cos(EclipticLongitude));
+	if (RightAscension < 0.0)
+		RightAscension += 2.0 * DOUBLE_PI;
+	const double Declination = FMath::Asin(FMath::Sin(EclipticObliquity) * SinEclipticLongitude);
+
+	//local coordinates
+	const double GreenwichMeanSiderealTime = 6.6974243242 + 0.0657098283 * ElapsedDays + DecimalHours;
+	const double LocalMeanSiderealTime = FMath::DegreesToRadians(GreenwichMeanSiderealTime * 15.0 + Longitude);
+	const double HourAngle = LocalMeanSiderealTime - RightAscension;
+	const double Phi = FMath::DegreesToRadians(Latitude);
+	const double CosPhi = FMath::Cos(Phi);
+	const double SinPhi = FMath::Sin(Phi);
+	const double CosHourAngle = FMath::Cos(HourAngle);
+
+	double Zenith = FMath::Acos(FMath::Clamp(
+		CosPhi * CosHourAngle * FMath::Cos(Declination) + FMath::Sin(Declination) * SinPhi, -1.0, 1.0));
+	double Azimuth = FMath::Atan2(-FMath::Sin(HourAngle), FMath::Tan(Declination) * CosPhi - SinPhi * CosHourAngle);
+	if (Azimuth < 0.0)
+		Azimuth += 2.0 * DOUBLE_PI;
+
+	//parallax, earth mean radius over astronomical unit (km)
+	Zenith += (6371.01 / 149597890.0) * FMath::Sin(Zenith);
+
+	FSolarPosition Position;
+	Position.Azimuth = FMath::RadiansToDegrees(Azimuth);
+	Position.Elevation = 90.0 - FMath::RadiansToDegrees(Zenith);
+	return Position;
+}
+
+FVector3f FSolarPosition::ToDirectionENU() const
+{
+	const double AzimuthRadians = FMath::DegreesToRadians(Azimuth);
+	const double ElevationRadians = FMath::DegreesToRadians(Elevation);
+	return FVector3f(FVector(
+		FMath::Cos(ElevationRadians) * FMath::Sin(AzimuthRadians),
+		FMath::Cos(ElevationRadians) * FMath::Cos(AzimuthRadians),
+		FMath::Sin(ElevationRadians)));
+}
+
+FVector3f FSolarPosition::ENUToScene(const FVector3f& ENU, double NorthYaw)
+{
+	//east is clockwise from north seen from above, i.e. +90 yaw
+	const double Yaw = FMath::DegreesToRadians(NorthYaw);
+	const FVector North(FMath::Cos(Yaw), FMath::Sin(Yaw), 0.0);
+	const FVector East(-FMath::Sin(Yaw), FMath::Cos(Yaw), 0.0);
+	return FVector3f(East * ENU.X + North * ENU.Y + FVector::UpVector * ENU.Z);
+}
+
+void FSolarEphemeris::Build(int32 InYear, double InLatitude, double InLongitude, double InUTCOffset, int32 InStepMinutes)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SolarEphemerisBuild);
+
+	Year = InYear;
+	Latitude = InLatitude;
+	Longitude = InLongitude;
+	UTCOffset = InUTCOffset;
+	StepMinutes = FMath::Clamp(InStepMinutes, 1, 1440);
+
+	NumDays = FDateTime::DaysInYear(Year);
+	SamplesPerDay = FMath::DivideAndRoundUp(1440, StepMinutes) + 1;
+	Directions.SetNumUninitialized(NumDays * SamplesPerDay);
+
+	const FDateTime Start = FDateTime(Year, 1, 1) - FTimespan::FromHours(UTCOffset);
+	for (int32 Day = 0; Day < NumDays; ++Day)
+	{
+		for (int32 Sample = 0; Sample < SamplesPerDay; ++Sample)
+		{
+			const int32 Minutes = FMath::Min(Sample * StepMinutes, 1440);
+			const FDateTime UTCTime = Start + FTimespan(Day, 0, Minutes, 0);
+			Directions[Day * SamplesPerDay + Sample] = FSolarPosition::Compute(UTCTime, Latitude, Longitude).ToDirectionENU();
+		}
+	}
+}
+
+bool FSolarEphemeris::Matches(int32 InYear, double InLatitude, double InLongitude, double InUTCOffset, int32 InStepMinutes) const
+{
+	return IsValid() && Year == InYear && Latitude == InLatitude && Longitude == InLongitude
+		&& UTCOffset == InUTCOffset && StepMinutes == FMath::Clamp(InStepMinutes, 1, 1440);
+}
+
+FVector3f FSolarEphemeris::GetDirectionENU(int32 DayOfYear, double LocalHours) const
+{
+	if (!IsValid()) return FVector3f::UpVector;
+
+	const int32 Day = FMath::Clamp(DayOfYear - 1, 0, NumDays - 1);
+	const double Minutes = FMath::Clamp(LocalHours, 0.0, 24.0) * 60.0;
+
+	//the last sample of a day is 24:00, so Sample + 1 always exists. The interval before it is shorter
+	//for steps that do not divide a day
+	const int32 Sample = FMath::Min(FMath::FloorToInt(Minutes / StepMinutes), SamplesPerDay - 2);
+	const int32 SampleMinutes = Sample * StepMinutes;
+	const int32 IntervalMinutes = FMath::Min(SampleMinutes + StepMinutes, 1440) - SampleMinutes;
+	const float Alpha = FMath::Clamp(float((Minutes - SampleMinutes) / IntervalMinutes), 0.f, 1.f);
+
+	const FVector3f& A = Directions[Day * SamplesPerDay + Sample];
+	const FVector3f& B = Directions[Day * SamplesPerDay + Sample + 1];
+	return FMath::Lerp(A, B, Alpha).GetSafeNormal();
+}
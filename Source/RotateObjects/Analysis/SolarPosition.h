@@ -0,0 +1,88 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Position of the sun in the sky for a place and time, and its direction in the scene.
+ *
+ * Azimuth is measured clockwise from north, elevation up from the horizon, both in degrees.
+ * The scene is oriented by NorthYaw, the yaw of geographic north in the scene:
+ * -90 (north along -Y, east along +X) matches the Cesium georeference.
+ */
+struct ROTATEOBJECTS_API FSolarPosition
+{
+	double Azimuth = 0.0;
+	double Elevation = 0.0;
+
+	/**
+	 * Computes the sun position with the PSA algorithm (Blanco-Muriel et al. 2001),
+	 * within about 0.01 degrees for 1999-2015 and a few hundredths of a degree decades around it.
+	 * The elevation is geometric (parallax corrected, no atmospheric refraction).
+	 * NREL SPA reference: 2003-10-17 19:30:30 UTC at 39.742476, -105.1786 gives azimuth 194.34 and elevation 39.87.
+	 *
+	 * @param UTCTime - the time in UTC
+	 * @param Latitude - degrees, north positive
+	 * @param Longitude - degrees, east positive
+	 */
+	static FSolarPosition Compute(const FDateTime& UTCTime, double Latitude, double Longitude);
+
+	// Unit vector towards the sun in east, north, up coordinates
+	FVector3f ToDirectionENU() const;
+
+	// Unit vector towards the sun in scene space
+	FVector3f ToSceneDirection(double NorthYaw) const { return ENUToScene(ToDirectionENU(), NorthYaw); }
+
+	// Rotates an east, north, up vector into the scene
+	static FVector3f ENUToScene(const FVector3f& ENU, double NorthYaw);
+
+	bool IsAboveHorizon() const { return Elevation > 0.0; }
+};
+
+/**
+ * The sun direction of every StepMinutes of a year at one location, precomputed.
+ *
+ * Looking up a day and time of day interpolates the two neighbouring samples (normalized lerp),
+ * so scrubbing a time of day slider costs no trigonometry. With the default 10 minutes the table
+ * is 365 x 145 directions (about 640 KB) and the interpolation error stays below 0.05 degrees.
+ */
+class ROTATEOBJECTS_API FSolarEphemeris
+{
+public:
+
+	/**
+	 * @param UTCOffset - hours local standard time is ahead of UTC, lookups are in local standard time
+	 */
+	void Build(int32 InYear, double InLatitude, double InLongitude, double InUTCOffset, int32 InStepMinutes = 10);
+
+	// Whether the table was built with exactly these parameters
+	bool Matches(int32 InYear, double InLatitude, double InLongitude, double InUTCOffset, int32 InStepMinutes) const;
+
+	bool IsValid() const { return Directions.Num() > 0; }
+
+	/**
+	 * Direction towards the sun in east, north, up coordinates (Z < 0 below the horizon).
+	 * @param DayOfYear - 1 for January 1st, clamped to the year
+	 * @param LocalHours - local standard time, 0 to 24
+	 */
+	FVector3f GetDirectionENU(int32 DayOfYear, double LocalHours) const;
+
+	FVector3f GetSceneDirection(int32 DayOfYear, double LocalHours, double NorthYaw) const
+	{
+		return FSolarPosition::ENUToScene(GetDirectionENU(DayOfYear, LocalHours), NorthYaw);
+	}
+
+	int32 GetNumDays() const { return NumDays; }
+
+private:
+
+	// Day * SamplesPerDay + Sample, the samples of a day run from 0:00 to 24:00 inclusive, the last step may be shorter
+	TArray<FVector3f> Directions;
+	int32 NumDays = 0;
+	int32 SamplesPerDay = 0;
+
+	int32 Year = 0;
+	double Latitude = 0.0;
+	double Longitude = 0.0;
+	double UTCOffset = 0.0;
+	int32 StepMinutes = 0;
+};
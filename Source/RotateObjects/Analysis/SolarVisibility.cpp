@@ -0,0 +1,295 @@
+#include "SolarVisibility.h"
+#include "SceneBVH.h"
+#include "DaylightSky.h"
+#include "../RotateObjects.h"
+#include "Async/ParallelFor.h"
+
+DECLARE_CYCLE_STAT(TEXT("Solar Visibility Evaluate"), STAT_SolarVisibilityEvaluate, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Solar Visibility Daylight"), STAT_SolarVisibilityDaylight, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Solar Visibility Accumulate Sun"), STAT_SolarVisibilityAccumulate, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Solar Visibility Rays"), STAT_SolarVisibilityRays, STATGROUP_LuminaCity);
+
+namespace SolarVisibility
+{
+	// Points per ParallelFor task, a multiple of the packet size
+	static const int32 PointsPerTask = 64;
+
+	// Patches of band Band of a dome with NumBands bands, about square in angular size so fewer towards the zenith
+	static int32 NumBandPatches(int32 Band, int32 NumBands)
+	{
+		const float Altitude = (Band + 0.5f) * HALF_PI / NumBands;
+		return FMath::Max(1, FMath::RoundToInt(4.f * NumBands * FMath::Cos(Altitude)));
+	}
+}
+
+int32 FSkyDome::NumPatches(int32 NumBands)
+{
+	NumBands = FMath::Max(NumBands, 1);
+
+	int32 Count = 0;
+	for (int32 Band = 0; Band < NumBands; ++Band)
+		Count += SolarVisibility::NumBandPatches(Band, NumBands);
+	return Count;
+}
+
+void FSkyDome::Build(int32 NumBands)
+{
+	Directions.Reset();
+	SolidAngles.Reset();
+
+	NumBands = FMath::Max(NumBands, 1);
+	const float BandHeight = HALF_PI / NumBands;
+	for (int32 Band = 0; Band < NumBands; ++Band)
+	{
+		const float AltitudeMin = Band * BandHeight;
+		const float AltitudeMax = AltitudeMin + BandHeight;
+		const float Altitude = AltitudeMin + 0.5f * BandHeight;
+
+		const int32 NumPatches = SolarVisibility::NumBandPatches(Band, NumBands);
+		const float SolidAngle = 2.f * PI * (FMath::Sin(AltitudeMax) - FMath::Sin(AltitudeMin)) / NumPatches;
+
+		for (int32 Patch = 0; Patch < NumPatches; ++Patch)
+		{
+			const float Azimuth = 2.f * PI * (Patch + 0.5f) / NumPatches;
+			Directions.Add(FVector3f(
+				FMath::Cos(Altitude) * FMath::Cos(Azimuth),
+				FMath::Cos(Altitude) * FMath::Sin(Azimuth),
+				FMath::Sin(Altitude)));
+			SolidAngles.Add(SolidAngle);
+		}
+	}
+}
+
+void FSkyDome::BuildTregenza()
+{
+	static const int32 BandPatches[] = { 30, 30, 24, 24, 18, 12, 6 };
+	const float BandHeight = FMath::DegreesToRadians(12.f);
+
+	Directions.Reset(145);
+	SolidAngles.Reset(145);
+
+	for (int32 Band = 0; Band < UE_ARRAY_COUNT(BandPatches); ++Band)
+	{
+		const float AltitudeMin = Band * BandHeight;
+		const float Altitude = AltitudeMin + 0.5f * BandHeight;
+		const int32 NumPatches = BandPatches[Band];
+		const float SolidAngle = 2.f * PI * (FMath::Sin(AltitudeMin + BandHeight) - FMath::Sin(AltitudeMin)) / NumPatches;
+
+		for (int32 Patch = 0; Patch < NumPatches; ++Patch)
+		{
+			const float Azimuth = 2.f * PI * Patch / NumPatches;
+			Directions.Add(FVector3f(
+				FMath::Cos(Altitude) * FMath::Cos(Azimuth),
+				FMath::Cos(Altitude) * FMath::Sin(Azimuth),
+				FMath::Sin(Altitude)));
+			SolidAngles.Add(SolidAngle);
+		}
+	}
+
+	//the cap above 84 degrees
+	Directions.Add(FVector3f::UpVector);
+	SolidAngles.Add(2.f * PI * (1.f - FMath::Sin(7.f * BandHeight)));
+}
+
+void FSolarVisibility::Evaluate(const ISceneOccluder& BVH, TArrayView<const FVector3f> Points, const FVector3f& Normal
+	, const FVector3f& SunDirection, const FSkyDome& Sky, const FSettings& Settings
+	, TArrayView<uint8> OutSunVisible, TArrayView<float> OutSkyFactor)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SolarVisibilityEvaluate);
+	check(OutSunVisible.Num() == Points.Num() && OutSkyFactor.Num() == Points.Num());
+
+	const FVector3f Bias = Normal * Settings.NormalBias;
+	const bool bSunAbovePlane = !SunDirection.IsNearlyZero() && FVector3f::DotProduct(Normal, SunDirection) > 0.f;
+
+	//only the patches in front of the plane contribute, with their projected solid angle
+	TArray<FVector3f> SkyDirections;
+	TArray<float> SkyWeights;
+	for (int32 i = 0; i < Sky.Num(); ++i)
+	{
+		const float Cosine = FVector3f::DotProduct(Normal, Sky.Directions[i]);
+		if (Cosine <= 0.f) continue;
+
+		SkyDirections.Add(Sky.Directions[i]);
+		SkyWeights.Add(Cosine * Sky.SolidAngles[i] / PI);
+	}
+
+	const int32 NumTasks = FMath::DivideAndRoundUp(Points.Num(), SolarVisibility::PointsPerTask);
+	ParallelFor(NumTasks, [&](int32 Task)
+	{
+		const int32 Begin = Task * SolarVisibility::PointsPerTask;
+		const int32 End = FMath::Min(Begin + SolarVisibility::PointsPerTask, Points.Num());
+
+		FRayPacket4 Packet;
+		FVector3f Origins[4];
+		FVector3f Directions[4];
+
+		//sun: neighbouring points towards the same direction are a coherent packet
+		for (int32 First = Begin; First < End; First += 4)
+		{
+			const int32 NumRays = FMath::Min(4, End - First);
+			if (!bSunAbovePlane)
+			{
+				for (int32 i = 0; i < NumRays; ++i)
+					OutSunVisible[First + i] = 0;
+				continue;
+			}
+
+			for (int32 i = 0; i < NumRays; ++i)
+			{
+				Origins[i] = Points[First + i] + Bias;
+				Directions[i] = SunDirection;
+			}
+			Packet.Set(Origins, Directions, NumRays, Settings.MaxDistance);
+
+			const int32 Occluded = BVH.Occluded4(Packet);
+			for (int32 i = 0; i < NumRays; ++i)
+				OutSunVisible[First + i] = (Occluded & (1 << i)) ? 0 : 1;
+		}
+
+		//sky: 4 patches of one point at a time
+		for (int32 p = Begin; p < End; ++p)
+		{
+			const FVector3f Origin = Points[p] + Bias;
+			for (int32 i = 0; i < 4; ++i)
+				Origins[i] = Origin;
+
+			float Factor = 0.f;
+			for (int32 First = 0; First < SkyDirections.Num(); First += 4)
+			{
+				const int32 NumRays = FMath::Min(4, SkyDirections.Num() - First);
+				for (int32 i = 0; i < NumRays; ++i)
+					Directions[i] = SkyDirections[First + i];
+				Packet.Set(Origins, Directions, NumRays, Settings.MaxDistance);
+
+				const int32 Occluded = BVH.Occluded4(Packet);
+				for (int32 i = 0; i < NumRays; ++i)
+				{
+					if (!(Occluded & (1 << i)))
+						Factor += SkyWeights[First + i];
+				}
+			}
+			OutSkyFactor[p] = Factor;
+		}
+	});
+
+	INC_DWORD_STAT_BY(STAT_SolarVisibilityRays, Points.Num() * ((bSunAbovePlane ? 1 : 0) + SkyDirections.Num()));
+}
+
+void FSolarVisibility::EvaluateDaylight(const ISceneOccluder& BVH, TArrayView<const FVector3f> Points, const FVector3f& Normal
+	, const FDaylightSky& Sky, const FSettings& Settings
+	, TArrayView<float> OutSkyViewFactor, TArrayView<float> OutDaylightFactor)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SolarVisibilityDaylight);
+	check(OutSkyViewFactor.Num() == Points.Num() && OutDaylightFactor.Num() == Points.Num());
+
+	const FVector3f Bias = Normal * Settings.NormalBias;
+
+	//per patch in front of the plane: projected solid angle and share of the horizontal illuminance
+	TArray<FVector3f> SkyDirections;
+	TArray<float> ViewWeights;
+	TArray<float> DaylightWeights;
+	for (int32 i = 0; i < Sky.Num(); ++i)
+	{
+		const float Cosine = FVector3f::DotProduct(Normal, Sky.Dome.Directions[i]);
+		if (Cosine <= 0.f) continue;
+
+		SkyDirections.Add(Sky.Dome.Directions[i]);
+		ViewWeights.Add(Cosine * Sky.Dome.SolidAngles[i] / PI);
+		DaylightWeights.Add(Cosine * Sky.Weights[i] * 100.f);
+	}
+
+	const int32 NumTasks = FMath::DivideAndRoundUp(Points.Num(), SolarVisibility::PointsPerTask);
+	ParallelFor(NumTasks, [&](int32 Task)
+	{
+		const int32 Begin = Task * SolarVisibility::PointsPerTask;
+		const int32 End = FMath::Min(Begin + SolarVisibility::PointsPerTask, Points.Num());
+
+		FRayPacket4 Packet;
+		FVector3f Origins[4];
+		FVector3f Directions[4];
+
+		for (int32 p = Begin; p < End; ++p)
+		{
+			const FVector3f Origin = Points[p] + Bias;
+			for (int32 i = 0; i < 4; ++i)
+				Origins[i] = Origin;
+
+			float ViewFactor = 0.f;
+			float DaylightFactor = 0.f;
+			for (int32 First = 0; First < SkyDirections.Num(); First += 4)
+			{
+				const int32 NumRays = FMath::Min(4, SkyDirections.Num() - First);
+				for (int32 i = 0; i < NumRays; ++i)
+					Directions[i] = SkyDirections[First + i];
+				Packet.Set(Origins, Directions, NumRays, Settings.MaxDistance);
+
+				const int32 Occluded = BVH.Occluded4(Packet);
+				for (int32 i = 0; i < NumRays; ++i)
+				{
+					if (!(Occluded & (1 << i)))
+					{
+						ViewFactor += ViewWeights[First + i];
+						DaylightFactor += DaylightWeights[First + i];
+					}
+				}
+			}
+			OutSkyViewFactor[p] = ViewFactor;
+			OutDaylightFactor[p] = DaylightFactor;
+		}
+	});
+
+	INC_DWORD_STAT_BY(STAT_SolarVisibilityRays, Points.Num() * SkyDirections.Num());
+}
+
+void FSolarVisibility::AccumulateSun(const ISceneOccluder& BVH, TArrayView<const FVector3f> Points, const FVector3f& Normal
+	, TArrayView<const FVector3f> SunDirections, TArrayView<const float> Weights, const FSettings& Settings
+	, TArrayView<float> InOutAccumulated)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SolarVisibilityAccumulate);
+	check(InOutAccumulated.Num() == Points.Num() && Weights.Num() == SunDirections.Num());
+
+	const FVector3f Bias = Normal * Settings.NormalBias;
+
+	TArray<int32, TInlineAllocator<64>> FrontDirections;
+	for (int32 d = 0; d < SunDirections.Num(); ++d)
+	{
+		if (FVector3f::DotProduct(Normal, SunDirections[d]) > 0.f)
+			FrontDirections.Add(d);
+	}
+	if (FrontDirections.Num() == 0) return;
+
+	//each task owns its points, so the accumulators need no synchronization
+	const int32 NumTasks = FMath::DivideAndRoundUp(Points.Num(), SolarVisibility::PointsPerTask);
+	ParallelFor(NumTasks, [&](int32 Task)
+	{
+		const int32 Begin = Task * SolarVisibility::PointsPerTask;
+		const int32 End = FMath::Min(Begin + SolarVisibility::PointsPerTask, Points.Num());
+
+		FRayPacket4 Packet;
+		FVector3f Origins[4];
+		FVector3f Directions[4];
+
+		for (int32 First = Begin; First < End; First += 4)
+		{
+			const int32 NumRays = FMath::Min(4, End - First);
+			for (int32 i = 0; i < NumRays; ++i)
+				Origins[i] = Points[First + i] + Bias;
+
+			for (int32 d : FrontDirections)
+			{
+				for (int32 i = 0; i < NumRays; ++i)
+					Directions[i] = SunDirections[d];
+				Packet.Set(Origins, Directions, NumRays, Settings.MaxDistance);
+
+				const int32 Occluded = BVH.Occluded4(Packet);
+				for (int32 i = 0; i < NumRays; ++i)
+				{
+					if (!(Occluded & (1 << i)))
+						InOutAccumulated[First + i] += Weights[d];
+				}
+			}
+		}
+	});
+
+	INC_DWORD_STAT_BY(STAT_SolarVisibilityRays, Points.Num() * FrontDirections.Num());
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ISceneOccluder;
+struct FDaylightSky;
+
+/**
+ * The sky hemisphere split into patches, each with the direction to its center and its solid angle.
+ * Bands of equal altitude, with about as many patches per band as fit at that altitude.
+ */
+struct ROTATEOBJECTS_API FSkyDome
+{
+	TArray<FVector3f> Directions;
+	TArray<float> SolidAngles;
+
+	// Splits the hemisphere above the horizon into NumBands altitude bands
+	void Build(int32 NumBands);
+
+	// The 145 patches of Tregenza: 7 bands of 12 degrees with 30, 30, 24, 24, 18, 12 and 6 patches, and a zenith cap
+	void BuildTregenza();
+
+	int32 Num() const { return Directions.Num(); }
+
+	// Number of patches Build(NumBands) creates
+	static int32 NumPatches(int32 NumBands);
+};
+
+/**
+ * Sun and sky visibility of sensor points, shadow rays traced through an FSceneBVH (or any other ISceneOccluder).
+ * Runs on the CPU without rendering (headless builds included).
+ */
+class ROTATEOBJECTS_API FSolarVisibility
+{
+public:
+
+	struct FSettings
+	{
+		// How far shadow rays are traced, in cm
+		float MaxDistance = 100000.f;
+
+		// Ray origins are moved this far along the normal, so that the surface a sensor sits on does not shade it
+		float NormalBias = 1.f;
+	};
+
+	/**
+	 * Evaluates a batch of points that share a normal (e.g. one sensor grid), in parallel.
+	 * Sun rays of 4 neighbouring points are traced as one packet, sky rays of one point 4 directions at a time.
+
+	 * @param Points - positions relative to the BVH origin
+	 * @param Normal - surface normal of the points
+	 * @param SunDirection - normalized direction towards the sun, zero for no sun
+	 * @param Sky - sky patches to trace, may be empty
+	 * @param OutSunVisible - 1 if the sun is visible from the point (and above its plane), else 0
+	 * @param OutSkyFactor - visible part of the sky weighted by cosine and solid angle, divided by pi:
+	 *        1 for an unobstructed horizontal point, 0.5 for an unobstructed vertical one
+	 */
+	static void Evaluate(const ISceneOccluder& BVH, TArrayView<const FVector3f> Points, const FVector3f& Normal
+		, const FVector3f& SunDirection, const FSkyDome& Sky, const FSettings& Settings
+		, TArrayView<uint8> OutSunVisible, TArrayView<float> OutSkyFactor);
+
+	/**
+	 * Sky view factor and daylight factor of a batch of points that share a normal, in parallel.
+	 * Every point traces the patches of Sky in front of its plane.
+
+	 * @param Points - positions relative to the BVH origin
+	 * @param OutSkyViewFactor - visible part of the sky weighted by cosine and solid angle, divided by pi
+	 * @param OutDaylightFactor - illuminance from the visible sky over the illuminance of an unobstructed
+	 *        horizontal plane under the same sky, in percent (direct sun and reflections excluded)
+	 */
+	static void EvaluateDaylight(const ISceneOccluder& BVH, TArrayView<const FVector3f> Points, const FVector3f& Normal
+		, const FDaylightSky& Sky, const FSettings& Settings
+		, TArrayView<float> OutSkyViewFactor, TArrayView<float> OutDaylightFactor);
+
+	/**
+	 * Traces a batch of sun directions for every point and adds the Weight of each direction
+	 * the point sees the sun in to its accumulator, e.g. the hours the sun spends there.
+	 * Directions behind the plane of the points are skipped.
+
+	 * @param Points - positions relative to the BVH origin
+	 * @param InOutAccumulated - one value per point, added to
+	 */
+	static void AccumulateSun(const ISceneOccluder& BVH, TArrayView<const FVector3f> Points, const FVector3f& Normal
+		, TArrayView<const FVector3f> SunDirections, TArrayView<const float> Weights, const FSettings& Settings
+		, TArrayView<float> InOutAccumulated);
+};
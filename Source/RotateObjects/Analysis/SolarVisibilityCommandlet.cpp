@@ -0,0 +1,122 @@
+#include "SolarVisibilityCommandlet.h"
+#include "SceneBVH.h"
+#include "SensorGrid.h"
+#include "../RotateObjects.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "UObject/Package.h"
+
+USolarVisibilityCommandlet::USolarVisibilityCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+int32 USolarVisibilityCommandlet::Main(const FString& Params)
+{
+	FString MapName;
+	FString OutputPath;
+	int32 NumBands = 8;
+	int32 LODIndex = 0;
+	FString Daylight;
+	FParse::Value(*Params, TEXT("Map="), MapName);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+	FParse::Value(*Params, TEXT("Bands="), NumBands);
+	FParse::Value(*Params, TEXT("LOD="), LODIndex);
+	FParse::Value(*Params, TEXT("Daylight="), Daylight);
+
+	if (MapName.IsEmpty() || OutputPath.IsEmpty())
+	{
+		UE_LOG(LogLuminaCity, Error, TEXT("Usage: -run=SolarVisibility -Map=/Game/Maps/Site -Output=Site.csv [-Bands=8] [-LOD=0] [-Daylight=Overcast|Clear]"));
+		return 1;
+	}
+
+	UPackage* Package = LoadPackage(nullptr, *MapName, LOAD_None);
+	UWorld* World = Package ? UWorld::FindWorldInPackage(Package) : nullptr;
+	if (!World)
+	{
+		UE_LOG(LogLuminaCity, Error, TEXT("Could not load map %s"), *MapName);
+		return 1;
+	}
+
+	//only component transforms are needed, no physics, rendering or gameplay
+	World->AddToRoot();
+	if (!World->bIsWorldInitialized)
+	{
+		World->InitWorld(UWorld::InitializationValues()
+			.CreatePhysicsScene(false)
+			.ShouldSimulatePhysics(false)
+			.EnableTraceCollision(false)
+			.CreateNavigation(false)
+			.CreateAISystem(false)
+			.AllowAudioPlayback(false)
+			.CreateFXSystem(false));
+	}
+	World->UpdateWorldComponents(true, false);
+
+	TArray<ASensorGrid*> Grids;
+	for (TActorIterator<ASensorGrid> It(World); It; ++It)
+		Grids.Add(*It);
+
+	int32 Result = 0;
+	if (Grids.Num() == 0)
+	{
+		UE_LOG(LogLuminaCity, Warning, TEXT("%s has no Sensor Grids"), *MapName);
+	}
+	else
+	{
+		//one BVH for every grid of the map
+		double StartTime = FPlatformTime::Seconds();
+		TSharedPtr<FSceneBVH, ESPMode::ThreadSafe> SceneBVH = MakeShared<FSceneBVH, ESPMode::ThreadSafe>();
+		SceneBVH->BuildFromWorld(World, Grids[0]->GetActorLocation(), TArray<AActor*>(Grids), LODIndex);
+		UE_LOG(LogLuminaCity, Display, TEXT("Scene BVH: %d triangles, %d nodes, %.2f s")
+			, SceneBVH->GetNumTriangles(), SceneBVH->GetNumNodes(), FPlatformTime::Seconds() - StartTime);
+
+		TArray<FString> Lines;
+		Lines.Add(TEXT("Grid,Index,X,Y,Z,Illuminance,Direct,Diffuse,SkyFactor,DaylightFactor"));
+
+		for (ASensorGrid* Grid : Grids)
+		{
+			StartTime = FPlatformTime::Seconds();
+			Grid->VisibilityMode = ESensorVisibilityMode::SV_SceneBVH;
+			Grid->SkyDomeBands = NumBands;
+			Grid->BuildGrid();
+			Grid->SetSceneBVH(SceneBVH);
+			const int32 NumEvaluated = Grid->Evaluate();
+			UE_LOG(LogLuminaCity, Display, TEXT("%s: %d sensors, %.2f s"), *Grid->GetName(), NumEvaluated, FPlatformTime::Seconds() - StartTime);
+
+			//the daylight sky view factor replaces the sky factor of the band dome
+			if (!Daylight.IsEmpty())
+			{
+				StartTime = FPlatformTime::Seconds();
+				Grid->DaylightSkyModel = Daylight == TEXT("Clear") ? EDaylightSkyModel::DS_CIEClear : EDaylightSkyModel::DS_CIEOvercast;
+				Grid->EvaluateDaylightMetrics();
+				UE_LOG(LogLuminaCity, Display, TEXT("%s: daylight metrics, %.2f s"), *Grid->GetName(), FPlatformTime::Seconds() - StartTime);
+			}
+
+			const FSensorGridBuffer& Sensors = Grid->GetSensors();
+			for (int32 i = 0; i < Sensors.Num(); ++i)
+			{
+				const FVector Location = Grid->GetSensorLocation(i);
+				Lines.Add(FString::Printf(TEXT("%s,%d,%.1f,%.1f,%.1f,%.3f,%.3f,%.3f,%.5f,%.3f")
+					, *Grid->GetName(), i, Location.X, Location.Y, Location.Z
+					, Sensors.Illuminance[i], Sensors.DirectIlluminance[i], Sensors.DiffuseIlluminance[i], Sensors.SkyFactor[i], Sensors.DaylightFactor[i]));
+			}
+		}
+
+		if (!FFileHelper::SaveStringArrayToFile(Lines, *OutputPath))
+		{
+			UE_LOG(LogLuminaCity, Error, TEXT("Could not write %s"), *OutputPath);
+			Result = 1;
+		}
+	}
+
+	World->RemoveFromRoot();
+	World->CleanupWorld();
+	return Result;
+}
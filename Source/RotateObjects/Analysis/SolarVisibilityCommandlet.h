@@ -0,0 +1,23 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SolarVisibilityCommandlet.generated.h"
+
+/**
+ * Evaluates every Sensor Grid of a map with the CPU Scene BVH and writes the results to a CSV file.
+ * Needs no GPU, for batch runs of design variants and regression tests of the numbers on build machines:
+ *
+ * UnrealEditor-Cmd LuminaCity2.uproject -run=SolarVisibility -Map=/Game/Maps/Site -Output=Site.csv [-Bands=8] [-LOD=0] [-Daylight=Overcast|Clear] -nullrhi
+ */
+UCLASS()
+class USolarVisibilityCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	USolarVisibilityCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
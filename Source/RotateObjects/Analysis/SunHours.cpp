@@ -0,0 +1,127 @@
+#include "SunHours.h"
+#include "SceneBVH.h"
+#include "SolarPosition.h"
+#include "SolarVisibility.h"
+#include "../RotateObjects.h"
+#include "Async/Async.h"
+
+DECLARE_CYCLE_STAT(TEXT("Sun Hours Directions"), STAT_SunHoursDirections, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Sun Hours Run"), STAT_SunHoursRun, STATGROUP_LuminaCity);
+
+namespace SunHours
+{
+	// Directions traced between two progress updates / cancellation checks
+	static const int32 DirectionsPerBatch = 32;
+}
+
+FSunHoursSimulation::FSunHoursSimulation(const TSharedPtr<const ISceneOccluder, ESPMode::ThreadSafe>& InSceneBVH, TArray<FVector3f>&& InPoints
+	, const FVector3f& InNormal, const FSunHoursSettings& InSettings)
+	: SceneBVH(InSceneBVH)
+	, Points(MoveTemp(InPoints))
+	, Normal(InNormal)
+	, Settings(InSettings)
+{
+}
+
+void FSunHoursSimulation::BuildSunDirections(const FSunHoursSettings& Settings, TArray<FVector3f>& OutDirections, TArray<float>& OutHours)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SunHoursDirections);
+
+	OutDirections.Reset();
+	OutHours.Reset();
+
+	const int32 StepMinutes = FMath::Clamp(Settings.StepMinutes, 1, 1440);
+	const float StepHours = StepMinutes / 60.f;
+	const double CellSize = Settings.ClusterAngle;
+
+	//direction sums per cell, normalized at the end
+	TMap<FIntPoint, int32> Cells;
+	TArray<FVector> Sums;
+
+	//each step stands for the interval around it
+	const FDateTime Start(Settings.Year, 1, 1);
+	const FDateTime End(Settings.Year + 1, 1, 1);
+	const FTimespan Step = FTimespan::FromMinutes(StepMinutes);
+	for (FDateTime Time = Start + Step * 0.5; Time < End; Time += Step)
+	{
+		const FSolarPosition Position = FSolarPosition::Compute(Time, Settings.Latitude, Settings.Longitude);
+		if (!Position.IsAboveHorizon()) continue;
+
+		const FVector3f Direction = Position.ToSceneDirection(Settings.NorthYaw);
+		if (CellSize <= 0.0)
+		{
+			OutDirections.Add(Direction);
+			OutHours.Add(StepHours);
+			continue;
+		}
+
+		const FIntPoint Cell(FMath::FloorToInt(Position.Azimuth / CellSize), FMath::FloorToInt(Position.Elevation / CellSize));
+		if (int32* Index = Cells.Find(Cell))
+		{
+			Sums[*Index] += FVector(Direction);
+			OutHours[*Index] += StepHours;
+		}
+		else
+		{
+			Cells.Add(Cell, Sums.Num());
+			Sums.Add(FVector(Direction));
+			OutHours.Add(StepHours);
+		}
+	}
+
+	if (CellSize > 0.0)
+	{
+		OutDirections.SetNumUninitialized(Sums.Num());
+		for (int32 i = 0; i < Sums.Num(); ++i)
+			OutDirections[i] = FVector3f(Sums[i].GetSafeNormal());
+	}
+}
+
+bool FSunHoursSimulation::Run()
+{
+	SCOPE_CYCLE_COUNTER(STAT_SunHoursRun);
+
+	bRunning = true;
+	Progress = 0.f;
+
+	BuildSunDirections(Settings, Directions, DirectionHours);
+	SunHours.Init(0.f, Points.Num());
+
+	UE_LOG(LogLuminaCity, Log, TEXT("Sun hours: %d points, %d directions"), Points.Num(), Directions.Num());
+
+	FSolarVisibility::FSettings TraceSettings;
+	TraceSettings.MaxDistance = Settings.MaxDistance;
+
+	bool bCompleted = SceneBVH.IsValid();
+	for (int32 First = 0; bCompleted && First < Directions.Num(); First += SunHours::DirectionsPerBatch)
+	{
+		if (bCancelled)
+		{
+			bCompleted = false;
+			break;
+		}
+
+		const int32 Num = FMath::Min(SunHours::DirectionsPerBatch, Directions.Num() - First);
+		FSolarVisibility::AccumulateSun(*SceneBVH, Points, Normal
+			, MakeArrayView(Directions.GetData() + First, Num), MakeArrayView(DirectionHours.GetData() + First, Num)
+			, TraceSettings, SunHours);
+
+		Progress = float(First + Num) / Directions.Num();
+	}
+
+	bRunning = false;
+	return bCompleted;
+}
+
+void FSunHoursSimulation::RunAsync(TFunction<void(bool bCompleted)> OnFinished)
+{
+	bRunning = true;
+	Async(EAsyncExecution::ThreadPool, [This = AsShared(), OnFinished = MoveTemp(OnFinished)]() mutable
+	{
+		const bool bCompleted = This->Run();
+		AsyncTask(ENamedThreads::GameThread, [This, OnFinished = MoveTemp(OnFinished), bCompleted]()
+		{
+			OnFinished(bCompleted);
+		});
+	});
+}
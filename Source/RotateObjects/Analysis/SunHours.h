@@ -0,0 +1,106 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+#include "SunHours.generated.h"
+
+class ISceneOccluder;
+
+//Where, when and how finely a sun hours simulation samples the sun
+USTRUCT(BlueprintType)
+struct FSunHoursSettings
+{
+	GENERATED_BODY()
+
+	// Degrees, north positive
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Hours")
+	double Latitude = 52.0;
+
+	// Degrees, east positive
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Hours")
+	double Longitude = 4.4;
+
+	// Yaw of geographic north in the scene, -90 matches the Cesium georeference
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Hours")
+	double NorthYaw = -90.0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Hours")
+	int32 Year = 2023;
+
+	// Minutes between two time steps
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Hours", meta = (ClampMin = "1", ClampMax = "1440"))
+	int32 StepMinutes = 15;
+
+	// Time steps whose sun directions fall into the same cell of this size (degrees of azimuth and elevation)
+	// are traced as one direction with their hours added up. 0 traces every step
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Hours", meta = (ClampMin = "0"))
+	float ClusterAngle = 0.5f;
+
+	// How far shadow rays are traced, in cm
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Hours", meta = (ClampMin = "0"))
+	float MaxDistance = 100000.f;
+};
+
+/**
+ * Hours of direct sunlight per point over a year.
+ *
+ * The year is sampled every StepMinutes, steps with the sun below the horizon are dropped and
+ * steps with nearly the same sun direction are merged. Every remaining direction is traced through
+ * one Scene BVH for all points, and the hours are added straight into a per point accumulator,
+ * so memory does not grow with the number of steps.
+ *
+ * Run blocks the calling thread, RunAsync runs on the thread pool. Both report progress and can be cancelled.
+ */
+class ROTATEOBJECTS_API FSunHoursSimulation : public TSharedFromThis<FSunHoursSimulation, ESPMode::ThreadSafe>
+{
+public:
+
+	/**
+	 * @param InSceneBVH - geometry to trace, kept alive by the simulation
+	 * @param InPoints - positions relative to the BVH origin
+	 * @param InNormal - surface normal of the points, the sun only counts in front of it
+	 */
+	FSunHoursSimulation(const TSharedPtr<const ISceneOccluder, ESPMode::ThreadSafe>& InSceneBVH, TArray<FVector3f>&& InPoints
+		, const FVector3f& InNormal, const FSunHoursSettings& InSettings);
+
+	/**
+	 * Samples the sun over the year and merges nearly identical directions.
+	 * @param OutDirections - unit vectors towards the sun, in scene space
+	 * @param OutHours - hours of the year the sun is in each direction
+	 */
+	static void BuildSunDirections(const FSunHoursSettings& Settings, TArray<FVector3f>& OutDirections, TArray<float>& OutHours);
+
+	// Runs the simulation on the calling thread. Returns false if it was cancelled
+	bool Run();
+
+	// Runs the simulation on the thread pool and calls OnFinished on the Game Thread (with false if cancelled)
+	void RunAsync(TFunction<void(bool bCompleted)> OnFinished);
+
+	void Cancel() { bCancelled = true; }
+
+	// 0 to 1
+	float GetProgress() const { return Progress; }
+
+	bool IsRunning() const { return bRunning; }
+
+	// Hours of sun per point, complete once Run returned true
+	const TArray<float>& GetSunHours() const { return SunHours; }
+
+	// Number of traced directions after merging
+	int32 GetNumDirections() const { return Directions.Num(); }
+
+private:
+
+	TSharedPtr<const ISceneOccluder, ESPMode::ThreadSafe> SceneBVH;
+	TArray<FVector3f> Points;
+	FVector3f Normal;
+	FSunHoursSettings Settings;
+
+	TArray<FVector3f> Directions;
+	TArray<float> DirectionHours;
+	TArray<float> SunHours;
+
+	std::atomic<float> Progress { 0.f };
+	std::atomic<bool> bCancelled { false };
+	std::atomic<bool> bRunning { false };
+};
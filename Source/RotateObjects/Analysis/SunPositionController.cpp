@@ -0,0 +1,89 @@
+#include "SunPositionController.h"
+#include "../RotateObjects.h"
+#include "Components/SceneComponent.h"
+#include "Engine/DirectionalLight.h"
+
+ASunPositionController::ASunPositionController()
+{
+	PrimaryActorTick.bCanEverTick = false;
+
+	RootScene = CreateDefaultSubobject<USceneComponent>(TEXT("RootScene"));
+	RootComponent = RootScene;
+
+	Sun = nullptr;
+	Latitude = 52.0;
+	Longitude = 4.4;
+	UTCOffset = 1.0;
+	NorthYaw = -90.0;
+	Year = 2023;
+	Month = 6;
+	Day = 21;
+	TimeOfDay = 12.f;
+	bUseEphemeris = true;
+	EphemerisStepMinutes = 10;
+}
+
+void ASunPositionController::OnConstruction(const FTransform& Transform)
+{
+	Super::OnConstruction(Transform);
+	UpdateSun();
+}
+
+void ASunPositionController::SetTimeOfDay(float Hours)
+{
+	TimeOfDay = FMath::Clamp(Hours, 0.f, 24.f);
+	UpdateSun();
+}
+
+void ASunPositionController::SetDate(int32 InYear, int32 InMonth, int32 InDay)
+{
+	Year = FMath::Clamp(InYear, 1, 9999);
+	Month = FMath::Clamp(InMonth, 1, 12);
+	Day = FMath::Clamp(InDay, 1, FDateTime::DaysInMonth(Year, Month));
+	UpdateSun();
+}
+
+void ASunPositionController::UpdateSun()
+{
+	if (!Sun) return;
+
+	//a light shines along its forward vector, away from the sun
+	const FVector Direction = GetSunDirection();
+	Sun->SetActorRotation(FRotationMatrix::MakeFromX(-Direction).Rotator());
+}
+
+FVector ASunPositionController::GetSunDirection() const
+{
+	if (bUseEphemeris)
+	{
+		//the table is rebuilt only when the location or year changes
+		if (!Ephemeris.Matches(Year, Latitude, Longitude, UTCOffset, EphemerisStepMinutes))
+			Ephemeris.Build(Year, Latitude, Longitude, UTCOffset, EphemerisStepMinutes);
+
+		return FVector(Ephemeris.GetSceneDirection(GetDayOfYear(), TimeOfDay, NorthYaw));
+	}
+
+	return FVector(FSolarPosition::Compute(GetUTCTime(), Latitude, Longitude).ToSceneDirection(NorthYaw));
+}
+
+void ASunPositionController::GetSolarPosition(double& Azimuth, double& Elevation) const
+{
+	const FSolarPosition Position = FSolarPosition::Compute(GetUTCTime(), Latitude, Longitude);
+	Azimuth = Position.Azimuth;
+	Elevation = Position.Elevation;
+}
+
+FDateTime ASunPositionController::GetUTCTime() const
+{
+	const int32 SafeYear = FMath::Clamp(Year, 1, 9999);
+	const int32 SafeMonth = FMath::Clamp(Month, 1, 12);
+	const int32 SafeDay = FMath::Clamp(Day, 1, FDateTime::DaysInMonth(SafeYear, SafeMonth));
+	return FDateTime(SafeYear, SafeMonth, SafeDay) + FTimespan::FromHours(FMath::Clamp(TimeOfDay, 0.f, 24.f) - UTCOffset);
+}
+
+int32 ASunPositionController::GetDayOfYear() const
+{
+	const int32 SafeYear = FMath::Clamp(Year, 1, 9999);
+	const int32 SafeMonth = FMath::Clamp(Month, 1, 12);
+	return FDateTime(SafeYear, SafeMonth, FMath::Clamp(Day, 1, FDateTime::DaysInMonth(SafeYear, SafeMonth))).GetDayOfYear();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "SolarPosition.h"
+#include "SunPositionController.generated.h"
+
+/**
+ * Points a directional light at the sun for a location, date and time of day.
+ *
+ * With bUseEphemeris the sun directions of the whole year are computed once (see FSolarEphemeris),
+ * after that moving the time of day or date only interpolates the table. Sensor grids and the luminance
+ * meter that reference the same light follow it.
+ */
+UCLASS()
+class ROTATEOBJECTS_API ASunPositionController : public AActor
+{
+	GENERATED_BODY()
+
+public:
+
+	ASunPositionController();
+
+	//Directional light that is rotated to the sun
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Position")
+	class ADirectionalLight* Sun;
+
+	//Degrees, north positive
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Position", meta = (ClampMin = "-90", ClampMax = "90"))
+	double Latitude;
+
+	//Degrees, east positive
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Position", meta = (ClampMin = "-180", ClampMax = "180"))
+	double Longitude;
+
+	//Hours local standard time is ahead of UTC, no daylight saving
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Position", meta = (ClampMin = "-12", ClampMax = "14"))
+	double UTCOffset;
+
+	//Yaw of geographic north in the scene, -90 matches the Cesium georeference
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Position")
+	double NorthYaw;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Position", meta = (ClampMin = "1", ClampMax = "9999"))
+	int32 Year;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Position", meta = (ClampMin = "1", ClampMax = "12"))
+	int32 Month;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Position", meta = (ClampMin = "1", ClampMax = "31"))
+	int32 Day;
+
+	//Local standard time in hours
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Position", meta = (ClampMin = "0", ClampMax = "24", UIMin = "0", UIMax = "24"))
+	float TimeOfDay;
+
+	//Interpolate a precomputed table of the year instead of computing the sun position on every change
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Position")
+	bool bUseEphemeris;
+
+	//Minutes between two samples of the table
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sun Position", meta = (ClampMin = "1", ClampMax = "60", EditCondition = "bUseEphemeris"))
+	int32 EphemerisStepMinutes;
+
+	/**
+	 * Moves the sun to a time of the current date.
+	 * @param Hours - local standard time, 0 to 24
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Sun Position")
+	void SetTimeOfDay(float Hours);
+
+	UFUNCTION(BlueprintCallable, Category = "Sun Position")
+	void SetDate(int32 InYear, int32 InMonth, int32 InDay);
+
+	//Rotates the Sun to the current location, date and time
+	UFUNCTION(BlueprintCallable, Category = "Sun Position")
+	void UpdateSun();
+
+	//Unit vector towards the sun in the scene
+	UFUNCTION(BlueprintPure, Category = "Sun Position")
+	FVector GetSunDirection() const;
+
+	//Exact azimuth and elevation in degrees for the current location, date and time
+	UFUNCTION(BlueprintPure, Category = "Sun Position")
+	void GetSolarPosition(double& Azimuth, double& Elevation) const;
+
+protected:
+
+	virtual void OnConstruction(const FTransform& Transform) override;
+
+private:
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
+	class USceneComponent* RootScene;
+
+	// Built lazily by the first lookup after a change of location, year or step
+	mutable FSolarEphemeris Ephemeris;
+
+	// The current date and time in UTC
+	FDateTime GetUTCTime() const;
+
+	int32 GetDayOfYear() const;
+};
@@ -0,0 +1,276 @@
+#include "BuildingInstanceManager.h"
+#include "RotateObjects.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "TimerManager.h"
+
+/* Analysis */
+#include "Analysis/BuildingBVHSubsystem.h"
+#include "Analysis/SceneChangeTracker.h"
+
+DECLARE_CYCLE_STAT(TEXT("Building Instance Convert"), STAT_BuildingInstanceConvert, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Building Actors Converted"), STAT_BuildingActorsConverted, STATGROUP_LuminaCity);
+
+bool FBuildingInstance::IsValid() const
+{
+	return ::IsValid(Component) && Component->IsValidInstance(Index);
+}
+
+bool FBuildingInstance::GetTransform(FTransform& OutTransform) const
+{
+	return IsValid() && Component->GetInstanceTransform(Index, OutTransform, true);
+}
+
+ABuildingInstanceManager* FBuildingInstance::GetManager() const
+{
+	return Component ? Cast<ABuildingInstanceManager>(Component->GetOwner()) : nullptr;
+}
+
+ABuildingInstanceManager::ABuildingInstanceManager()
+{
+	PrimaryActorTick.bCanEverTick = false;
+
+	RootScene = CreateDefaultSubobject<USceneComponent>(TEXT("RootScene"));
+	RootComponent = RootScene;
+
+	Pivot = CreateDefaultSubobject<USceneComponent>(TEXT("Pivot"));
+	Pivot->SetupAttachment(RootScene);
+}
+
+void ABuildingInstanceManager::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (ConvertedClasses.Num() == 0 && ConvertedMeshes.Num() == 0) return;
+
+	if (bConvertSpawnedActors)
+		ActorSpawnedHandle = GetWorld()->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &ABuildingInstanceManager::HandleActorSpawned));
+
+	TArray<AActor*> Actors;
+	for (TActorIterator<AActor> It(GetWorld()); It; ++It)
+	{
+		if (ShouldConvert(*It))
+			Actors.Add(*It);
+	}
+
+	const int32 NumConverted = ConvertActors(Actors);
+	UE_LOG(LogLuminaCity, Log, TEXT("Building instances: %d of %d actors converted, %d instances of %d meshes")
+		, NumConverted, Actors.Num(), GetNumBuildings(), MeshComponents.Num());
+}
+
+void ABuildingInstanceManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (ActorSpawnedHandle.IsValid())
+	{
+		GetWorld()->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+		ActorSpawnedHandle.Reset();
+	}
+	SpawnedActors.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+FBuildingInstance ABuildingInstanceManager::AddBuilding(UStaticMesh* Mesh, const FTransform& Transform)
+{
+	UHierarchicalInstancedStaticMeshComponent* Component = Mesh ? GetMeshComponent(Mesh, nullptr) : nullptr;
+	if (!Component) return FBuildingInstance();
+
+	const FBuildingInstance Instance(Component, Component->AddInstance(Transform, true));
+	RebuildBuildingBVH();
+
+	//sensors the new building could shade are evaluated again
+	if (USceneChangeTracker* ChangeTracker = GetWorld()->GetSubsystem<USceneChangeTracker>())
+		ChangeTracker->NotifyInstanceAdded(Component, Instance.Index);
+
+	return Instance;
+}
+
+int32 ABuildingInstanceManager::ConvertActors(const TArray<AActor*>& Actors)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BuildingInstanceConvert);
+
+	//world transforms per component, added with one AddInstances each so every cluster tree is built once
+	TMap<UHierarchicalInstancedStaticMeshComponent*, TArray<FTransform>> Transforms;
+	TArray<AActor*> Converted;
+	TArray<UStaticMeshComponent*> MeshComponentsOfActor;
+	for (AActor* Actor : Actors)
+	{
+		if (!::IsValid(Actor) || Actor == this) continue;
+		if (!GetConvertibleMeshes(Actor, MeshComponentsOfActor)) continue;
+
+		for (const UStaticMeshComponent* MeshComponent : MeshComponentsOfActor)
+		{
+			UHierarchicalInstancedStaticMeshComponent* Component = GetMeshComponent(MeshComponent->GetStaticMesh(), MeshComponent);
+			Transforms.FindOrAdd(Component).Add(MeshComponent->GetComponentTransform());
+		}
+		Converted.Add(Actor);
+	}
+	if (Converted.Num() == 0) return 0;
+
+	for (TPair<UHierarchicalInstancedStaticMeshComponent*, TArray<FTransform>>& Pair : Transforms)
+		Pair.Key->AddInstances(Pair.Value, false, true);
+
+	//the same geometry stays in the same place, the sensors do not change
+	for (AActor* Actor : Converted)
+		Actor->Destroy();
+	RebuildBuildingBVH();
+
+	INC_DWORD_STAT_BY(STAT_BuildingActorsConverted, Converted.Num());
+	return Converted.Num();
+}
+
+void ABuildingInstanceManager::RemoveBuildings(const TArray<FBuildingInstance>& Instances)
+{
+	USceneChangeTracker* ChangeTracker = GetWorld()->GetSubsystem<USceneChangeTracker>();
+
+	TMap<UHierarchicalInstancedStaticMeshComponent*, TArray<int32>> Indices;
+	for (const FBuildingInstance& Instance : Instances)
+	{
+		if (Instance.GetManager() != this || !Instance.IsValid()) continue;
+
+		if (ChangeTracker)
+			ChangeTracker->NotifyInstanceMoving(Instance.Component, Instance.Index);
+		Indices.FindOrAdd(Instance.Component).AddUnique(Instance.Index);
+	}
+	if (Indices.Num() == 0) return;
+
+	//RemoveInstances removes from the highest index down, so the indices in the list stay valid while it runs
+	for (TPair<UHierarchicalInstancedStaticMeshComponent*, TArray<int32>>& Pair : Indices)
+	{
+		//the other indices of the component may change
+		if (Pair.Key == PivotInstance.Component)
+			PivotInstance = FBuildingInstance();
+		Pair.Key->RemoveInstances(Pair.Value);
+	}
+	RebuildBuildingBVH();
+}
+
+int32 ABuildingInstanceManager::GetNumBuildings() const
+{
+	int32 NumBuildings = 0;
+	for (const TPair<UStaticMesh*, UHierarchicalInstancedStaticMeshComponent*>& Pair : MeshComponents)
+	{
+		if (Pair.Value)
+			NumBuildings += Pair.Value->GetInstanceCount();
+	}
+	return NumBuildings;
+}
+
+USceneComponent* ABuildingInstanceManager::PlacePivot(const FBuildingInstance& Instance)
+{
+	if (Instance.GetManager() != this) return nullptr;
+
+	PivotInstance = Instance;
+	UpdatePivot();
+	return Pivot;
+}
+
+void ABuildingInstanceManager::UpdatePivot()
+{
+	FTransform InstanceTransform;
+	if (PivotInstance.GetTransform(InstanceTransform))
+		Pivot->SetWorldTransform(InstanceTransform);
+}
+
+UHierarchicalInstancedStaticMeshComponent* ABuildingInstanceManager::GetMeshComponent(UStaticMesh* Mesh, const UStaticMeshComponent* Template)
+{
+	if (UHierarchicalInstancedStaticMeshComponent** Found = MeshComponents.Find(Mesh))
+		return *Found;
+
+	//the Transformer Tool moves the instances, so the component has to be movable
+	UHierarchicalInstancedStaticMeshComponent* Component = NewObject<UHierarchicalInstancedStaticMeshComponent>(this);
+	Component->SetMobility(EComponentMobility::Movable);
+	Component->SetStaticMesh(Mesh);
+	if (Template)
+	{
+		for (int32 i = 0; i < Template->GetNumOverrideMaterials(); ++i)
+			Component->SetMaterial(i, Template->OverrideMaterials[i]);
+		Component->SetCollisionProfileName(Template->GetCollisionProfileName());
+	}
+	Component->SetupAttachment(RootScene);
+	Component->RegisterComponent();
+	AddInstanceComponent(Component);
+
+	MeshComponents.Add(Mesh, Component);
+	return Component;
+}
+
+bool ABuildingInstanceManager::GetConvertibleMeshes(const AActor* Actor, TArray<UStaticMeshComponent*>& OutMeshComponents)
+{
+	OutMeshComponents.Reset();
+
+	TInlineComponentArray<UPrimitiveComponent*> Primitives(Actor);
+	for (UPrimitiveComponent* Primitive : Primitives)
+	{
+		if (Primitive->IsEditorOnly()) continue;
+
+		//instanced components and any other primitive would be lost with the actor
+		UStaticMeshComponent* MeshComponent = Cast<UStaticMeshComponent>(Primitive);
+		if (!MeshComponent || MeshComponent->IsA<UInstancedStaticMeshComponent>()) return false;
+
+		if (MeshComponent->GetStaticMesh())
+			OutMeshComponents.Add(MeshComponent);
+	}
+	return OutMeshComponents.Num() > 0;
+}
+
+bool ABuildingInstanceManager::ShouldConvert(const AActor* Actor) const
+{
+	if (ConvertedClasses.ContainsByPredicate([Actor](const TSubclassOf<AActor>& Class) { return Class && Actor->IsA(Class); }))
+		return true;
+
+	const AStaticMeshActor* MeshActor = Cast<AStaticMeshActor>(Actor);
+	return MeshActor && MeshActor->GetStaticMeshComponent()
+		&& ConvertedMeshes.Contains(MeshActor->GetStaticMeshComponent()->GetStaticMesh());
+}
+
+void ABuildingInstanceManager::HandleActorSpawned(AActor* Actor)
+{
+	//the mesh of a Static Mesh Actor may be set after its spawn, it is checked with the class on the next tick
+	if (!Actor || Actor == this) return;
+	if (!Actor->IsA<AStaticMeshActor>()
+		&& !ConvertedClasses.ContainsByPredicate([Actor](const TSubclassOf<AActor>& Class) { return Class && Actor->IsA(Class); }))
+		return;
+
+	if (SpawnedActors.Num() == 0)
+		GetWorldTimerManager().SetTimerForNextTick(this, &ABuildingInstanceManager::ConvertSpawnedActors);
+	SpawnedActors.Add(Actor);
+}
+
+void ABuildingInstanceManager::ConvertSpawnedActors()
+{
+	SCOPE_CYCLE_COUNTER(STAT_BuildingInstanceConvert);
+
+	const TArray<TWeakObjectPtr<AActor>> Actors = MoveTemp(SpawnedActors);
+	SpawnedActors.Reset();
+
+	int32 NumConverted = 0;
+	TArray<UStaticMeshComponent*> MeshComponentsOfActor;
+	for (const TWeakObjectPtr<AActor>& WeakActor : Actors)
+	{
+		AActor* Actor = WeakActor.Get();
+		if (!::IsValid(Actor) || !ShouldConvert(Actor)) continue;
+		if (!GetConvertibleMeshes(Actor, MeshComponentsOfActor)) continue;
+
+		//a new building, unlike the ones converted on BeginPlay: AddBuilding tells the sensors it could shade.
+		//The component of a mesh placed for the first time copies the materials and collision of this one
+		for (const UStaticMeshComponent* MeshComponent : MeshComponentsOfActor)
+		{
+			GetMeshComponent(MeshComponent->GetStaticMesh(), MeshComponent);
+			AddBuilding(MeshComponent->GetStaticMesh(), MeshComponent->GetComponentTransform());
+		}
+		Actor->Destroy();
+		++NumConverted;
+	}
+
+	INC_DWORD_STAT_BY(STAT_BuildingActorsConverted, NumConverted);
+}
+
+void ABuildingInstanceManager::RebuildBuildingBVH()
+{
+	if (UBuildingBVHSubsystem* Buildings = GetWorld()->GetSubsystem<UBuildingBVHSubsystem>())
+		Buildings->Rebuild();
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "BuildingInstanceManager.generated.h"
+
+class ABuildingInstanceManager;
+class UHierarchicalInstancedStaticMeshComponent;
+class UStaticMesh;
+class UStaticMeshComponent;
+
+/**
+ * One building placed as an instance by a Building Instance Manager.
+ * Indices are not stable: removing an instance moves the last one of the component into its slot.
+ */
+USTRUCT(BlueprintType)
+struct ROTATEOBJECTS_API FBuildingInstance
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Building Instances")
+	UHierarchicalInstancedStaticMeshComponent* Component = nullptr;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Building Instances")
+	int32 Index = INDEX_NONE;
+
+	FBuildingInstance() = default;
+	FBuildingInstance(UHierarchicalInstancedStaticMeshComponent* InComponent, int32 InIndex) : Component(InComponent), Index(InIndex) {}
+
+	// The component still has an instance at Index
+	bool IsValid() const;
+
+	// World transform of the instance, false if it is not valid
+	bool GetTransform(FTransform& OutTransform) const;
+
+	// The manager owning the component, nullptr for instanced components placed any other way
+	ABuildingInstanceManager* GetManager() const;
+
+	bool operator==(const FBuildingInstance& Other) const { return Component == Other.Component && Index == Other.Index; }
+
+	friend uint32 GetTypeHash(const FBuildingInstance& Instance)
+	{
+		return HashCombine(PointerHash(Instance.Component), ::GetTypeHash(Instance.Index));
+	}
+};
+
+/**
+ * Places buildings as instances of one Hierarchical Instanced Static Mesh Component per mesh, so a district costs
+ * a few draw calls per mesh instead of a few per building, and no actor (tick, transform, collision) per building.
+ *
+ * Actors of the ConvertedClasses (e.g. HouseBP, ApartmentBP) and Static Mesh Actors of the ConvertedMeshes
+ * are replaced by instances on BeginPlay, see ConvertActors. Those spawned while playing (the Drag and Drop widget
+ * spawns HouseBP and ApartmentBP) are placed with AddBuilding once their spawn finished, see bConvertSpawnedActors.
+ * The Transformer Tool selects a traced instance on its own (@see UTransformerTool::SelectInstance),
+ * moves it in the instance buffer and places its Gizmo on the Pivot of the manager.
+ */
+UCLASS()
+class ROTATEOBJECTS_API ABuildingInstanceManager : public AActor
+{
+	GENERATED_BODY()
+
+public:
+
+	ABuildingInstanceManager();
+
+	/**
+	 * Places a building.
+	 * @param Transform - world transform of the instance
+	 * @return the new instance, invalid if Mesh is null
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Building Instances")
+	FBuildingInstance AddBuilding(UStaticMesh* Mesh, const FTransform& Transform);
+
+	/**
+	 * Replaces actors that are made only of static meshes by one instance per static mesh component, and destroys them.
+	 * Actors with any other primitive are left as they are. The instances of a mesh are added at once,
+	 * and share the materials and collision of the first component converted to it.
+	 * @return the number of actors replaced
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Building Instances")
+	int32 ConvertActors(const TArray<AActor*>& Actors);
+
+	//Removes the instances of this manager in the list, other instances of their components may change their index
+	UFUNCTION(BlueprintCallable, Category = "Building Instances")
+	void RemoveBuildings(const TArray<FBuildingInstance>& Instances);
+
+	UFUNCTION(BlueprintPure, Category = "Building Instances")
+	int32 GetNumBuildings() const;
+
+	/**
+	 * Moves the Pivot onto an instance and keeps it there (@see UpdatePivot).
+	 * The Transformer Tool attaches its Gizmo to it, instances have no component of their own.
+	 */
+	USceneComponent* PlacePivot(const FBuildingInstance& Instance);
+
+	//Moves the Pivot onto its instance again, after the instance was moved
+	void UpdatePivot();
+
+	//Actors of these classes are replaced by instances on BeginPlay
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Building Instances")
+	TArray<TSubclassOf<AActor>> ConvertedClasses;
+
+	//Static Mesh Actors showing one of these meshes are replaced by instances on BeginPlay
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Building Instances")
+	TArray<UStaticMesh*> ConvertedMeshes;
+
+	//Actors of the ConvertedClasses and ConvertedMeshes spawned while playing are replaced by instances too, on the next tick
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Building Instances")
+	bool bConvertSpawnedActors = true;
+
+protected:
+
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+
+	/**
+	 * The instanced component of Mesh, created on first use.
+	 * @param Template - a created component copies its materials and collision, may be null
+	 */
+	UHierarchicalInstancedStaticMeshComponent* GetMeshComponent(UStaticMesh* Mesh, const UStaticMeshComponent* Template);
+
+	// The static mesh components of Actor, false if it has any other primitive (or none) and cannot be converted
+	static bool GetConvertibleMeshes(const AActor* Actor, TArray<UStaticMeshComponent*>& OutMeshComponents);
+
+	// Actor is of one of the ConvertedClasses, or a Static Mesh Actor showing one of the ConvertedMeshes
+	bool ShouldConvert(const AActor* Actor) const;
+
+	/**
+	 * Queues the spawned actors that may be converted. Blueprint spawns are deferred, their components
+	 * and meshes are only known once the spawn finished, so they are converted on the next tick.
+	 */
+	void HandleActorSpawned(AActor* Actor);
+
+	// Places every static mesh of the queued actors with AddBuilding and destroys them
+	void ConvertSpawnedActors();
+
+	// Instances were added or removed, the Building BVH has to be built again
+	void RebuildBuildingBVH();
+
+	UPROPERTY(VisibleAnywhere, Category = "Building Instances")
+	USceneComponent* RootScene;
+
+	UPROPERTY(VisibleAnywhere, Category = "Building Instances")
+	USceneComponent* Pivot;
+
+	UPROPERTY()
+	TMap<UStaticMesh*, UHierarchicalInstancedStaticMeshComponent*> MeshComponents;
+
+	// The instance the Pivot is on
+	FBuildingInstance PivotInstance;
+
+	// Actors spawned since the last ConvertSpawnedActors
+	TArray<TWeakObjectPtr<AActor>> SpawnedActors;
+
+	FDelegateHandle ActorSpawnedHandle;
+};
@@ -23,11 +23,14 @@ SOFTWARE.
 */
 
 #include "BaseGizmo.h"
+#include "../RotateObjects.h"
 #include "Components/SceneComponent.h"
 #include "Components/ShapeComponent.h"
 #include "Components/BoxComponent.h"
 #include "Engine/World.h"
 
+DECLARE_DWORD_COUNTER_STAT(TEXT("Gizmo Space Teleports"), STAT_GizmoSpaceTeleports, STATGROUP_LuminaCity);
+
 // Sets default values
 ABaseGizmo::ABaseGizmo()
 {
@@ -60,9 +63,32 @@ ABaseGizmo::ABaseGizmo()
 
 	bTransformInProgress = false;
 	bIsPrevRayValid = false;
+
+	AppliedSpaceType = ESpaceType::ST_None;
+	AppliedParentRotation = FQuat::Identity;
+	AppliedRotation = FQuat::Identity;
 }
 
 void ABaseGizmo::UpdateGizmoSpace(ESpaceType SpaceType)
+{
+	const USceneComponent* parent = RootComponent ? RootComponent->GetAttachParent() : nullptr;
+	const FQuat parentRotation = parent ? parent->GetComponentQuat() : FQuat::Identity;
+
+	//rotating the Gizmo teleports all of its collision, only do it if something changed
+	if (SpaceType == AppliedSpaceType
+		&& parentRotation.Equals(AppliedParentRotation)
+		&& GetActorQuat().Equals(AppliedRotation))
+		return;
+
+	ApplyGizmoSpace(SpaceType);
+	INC_DWORD_STAT(STAT_GizmoSpaceTeleports);
+
+	AppliedSpaceType = SpaceType;
+	AppliedParentRotation = parentRotation;
+	AppliedRotation = GetActorQuat();
+}
+
+void ABaseGizmo::ApplyGizmoSpace(ESpaceType SpaceType)
 {
 	switch (SpaceType)
 	{
@@ -89,9 +115,13 @@ FTransform ABaseGizmo::GetDeltaTransform(const FVector& LookingVector
 
 void ABaseGizmo::ScaleGizmoScene(const FVector& ReferenceLocation, const FVector& ReferenceLookDirection, float FieldOfView)
 {
+	if (!ScalingScene) return;
+
 	FVector Scale = CalculateGizmoSceneScale(ReferenceLocation, ReferenceLookDirection, FieldOfView);
 	//UE_LOG(LogRuntimeTransformer, Warning, TEXT("Scale: %s"), *Scale.ToString());
-	if (ScalingScene)
+
+	//setting the scale updates the transforms of every child, skip it when nothing moved
+	if (!ScalingScene->GetComponentScale().Equals(Scale, Scale.GetAbsMax() * SceneScaleTolerance))
 		ScalingScene->SetWorldScale3D(Scale);
 }
 
@@ -118,6 +148,14 @@ ETransformationDomain ABaseGizmo::GetTransformationDomain(USceneComponent* Compo
 	return ETransformationDomain::TD_None;
 }
 
+ETransformationDomain ABaseGizmo::TraceDomain(const FVector& StartLocation, const FVector& EndLocation) const
+{
+	FHitResult hitResult;
+	if (ActorLineTraceSingle(hitResult, StartLocation, EndLocation, GizmoTraceChannel, FCollisionQueryParams()))
+		return GetTransformationDomain(hitResult.GetComponent());
+	return ETransformationDomain::TD_None;
+}
+
 FVector ABaseGizmo::CalculateGizmoSceneScale(const FVector& ReferenceLocation, const FVector& ReferenceLookDirection, float FieldOfView)
 {
 	FVector deltaLocation = (GetActorLocation() - ReferenceLocation);
@@ -145,7 +183,10 @@ void ABaseGizmo::RegisterDomainComponent(USceneComponent* Component
 	if (!Component) return;
 
 	if (UShapeComponent* ShapeComponent = Cast<UShapeComponent>(Component))
+	{
 		DomainMap.Add(ShapeComponent, Domain);
+		ShapeComponent->SetCollisionResponseToChannel(GizmoTraceChannel, ECR_Block);
+	}
 	else
 		UE_LOG(LogRuntimeTransformer, Warning, TEXT("Failed to Register Component! Component is not a Shape Component %s"), *Component->GetName());
 }
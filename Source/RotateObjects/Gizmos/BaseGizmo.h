@@ -42,7 +42,11 @@ public:
 
 	virtual ETransformationType GetGizmoType() const { return ETransformationType::TT_NoTransform; }
 
-	virtual void UpdateGizmoSpace(ESpaceType SpaceType);
+	/**
+	 * Rotates the Gizmo for the given Space (@see ApplyGizmoSpace).
+	 * Does nothing if the Space, the rotation of the parent and the Gizmo rotation are the same as when it was last applied.
+	 */
+	void UpdateGizmoSpace(ESpaceType SpaceType);
 
 	//Base Gizmo does not affect anything and returns No Delta Transform.
 	// This func is overriden by each Transform Gizmo
@@ -56,12 +60,25 @@ public:
 	 * @param Reference Location - The Location of where the Gizmo is seen (i.e. Camera Location)
 	 * @param Reference Look Direction - the direction the reference is looking (i.e. Camera Look Direction)
 	 * @param FieldOfView - Field of View of Camera, in Degrees
+	 * The Scale is only applied if it differs from the current one by more than SceneScaleTolerance
 	*/
 	void ScaleGizmoScene(const FVector& ReferenceLocation, const FVector& ReferenceLookDirection, float FieldOfView = 90.f);
 
 	UFUNCTION(BlueprintCallable, Category = "Gizmo")
 	ETransformationDomain GetTransformationDomain(class USceneComponent* ComponentHit) const;
 
+	// Relative change of the Gizmo Scene Scale below which ScaleGizmoScene leaves the scale as it is
+	static constexpr float SceneScaleTolerance = 1e-3f;
+
+	// The "Gizmo" Trace Channel (Config/DefaultEngine.ini). Only the Domain Components block it
+	static constexpr ECollisionChannel GizmoTraceChannel = ECC_GameTraceChannel2;
+
+	/**
+	 * Traces only the Components of this Gizmo, on the Gizmo Trace Channel
+	 * @return the Domain hit, TD_None if the trace missed
+	 */
+	ETransformationDomain TraceDomain(const FVector& StartLocation, const FVector& EndLocation) const;
+
 	// Returns a Snapped Transform based on how much has been accumulated, the Delta Transform and Snapping Value
 	// Also changes the Accumulated Transform based on how much was snapped
 	virtual FTransform GetSnappedTransform(FTransform& outCurrentAccumulatedTransform
@@ -79,6 +96,9 @@ public:
 
 protected:
 
+	// Sets the rotation of the Gizmo for a Space. Overriden by Gizmos that only work in one Space (e.g. Scale Gizmo)
+	virtual void ApplyGizmoSpace(ESpaceType SpaceType);
+
 	// Calculates the Gizmo Scene Scale. This can be overriden (e.g. by Rotation Gizmo)
 	// for additional/optional scaling properties.
 	virtual FVector CalculateGizmoSceneScale(const FVector& ReferenceLocation, const FVector& ReferenceLookDirection, float FieldOfView);
@@ -155,6 +175,11 @@ private:
 	//Whether Transform is in Progress or Not 
 	bool bTransformInProgress;
 
+	//What the Gizmo Space was last applied with, and the world rotation it resulted in
+	ESpaceType AppliedSpaceType;
+	FQuat AppliedParentRotation;
+	FQuat AppliedRotation;
+
 protected:
 
 	//bool to check whether the PrevRay vectors have been set
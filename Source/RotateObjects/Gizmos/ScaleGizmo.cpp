@@ -47,7 +47,7 @@ AScaleGizmo::AScaleGizmo()
 
 }
 
-void AScaleGizmo::UpdateGizmoSpace(ESpaceType SpaceType)
+void AScaleGizmo::ApplyGizmoSpace(ESpaceType SpaceType)
 {
 	//Force to always be Local
 	SetActorRelativeRotation(FQuat(EForceInit::ForceInit));
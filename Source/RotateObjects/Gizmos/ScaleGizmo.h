@@ -42,8 +42,6 @@ public:
 
 	virtual ETransformationType GetGizmoType() const final { return ETransformationType::TT_Scale; }
 
-	virtual void UpdateGizmoSpace(ESpaceType SpaceType);
-
 	virtual FTransform GetDeltaTransform(const FVector& LookingVector
 		, const FVector& RayStartPoint
 		, const FVector& RayEndPoint
@@ -62,6 +60,9 @@ public:
 
 protected:
 
+	//Force to always be Local
+	virtual void ApplyGizmoSpace(ESpaceType SpaceType) override;
+
 	//To see how much an Unreal Unit affects Scaling (e.g. how powerful the mouse scales the object!)
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Gizmo")
 	float ScalingFactor;
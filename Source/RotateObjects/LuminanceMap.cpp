@@ -0,0 +1,558 @@
+#include "LuminanceMap.h"
+#include "RotateObjects.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+DECLARE_CYCLE_STAT(TEXT("Luminance Map Convert"), STAT_LuminanceMapConvert, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Luminance Region Stats"), STAT_LuminanceRegionStats, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Luminance Summed Area Build"), STAT_LuminanceSummedAreaBuild, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Luminance Box Average"), STAT_LuminanceBoxAverage, STATGROUP_LuminaCity);
+
+namespace LuminanceMap
+{
+	// Weights in the order R, G, B
+	static FVector3f GetWeights(ELuminanceWeighting Weighting, bool bLinear = false)
+	{
+		switch (Weighting)
+		{
+		case ELuminanceWeighting::LW_Unreal:
+			return bLinear ? FVector3f(0.2126f, 0.7152f, 0.0722f) : FVector3f(0.299f, 0.587f, 0.114f);
+		case ELuminanceWeighting::LW_Radiance:
+		default:
+			return FVector3f(0.265f, 0.670f, 0.065f);
+		}
+	}
+
+	/**
+	 * Converts a row of 8 bit, 4 channel pixels to luminance, 4 pixels per iteration.
+	 * W0, W1, W2 are the weights of the first three bytes of each pixel (i.e. B, G, R for BGRA).
+	 */
+	static void ConvertRow8(const uint8* RESTRICT Src, float* RESTRICT Dst, int32 Count
+		, float W0, float W1, float W2)
+	{
+		const VectorRegister4Float Weight0 = VectorSetFloat1(W0);
+		const VectorRegister4Float Weight1 = VectorSetFloat1(W1);
+		const VectorRegister4Float Weight2 = VectorSetFloat1(W2);
+
+		int32 i = 0;
+		for (; i + 4 <= Count; i += 4)
+		{
+			const uint8* Pixel = Src + i * 4;
+			const VectorRegister4Float P0 = VectorLoadByte4(Pixel);
+			const VectorRegister4Float P1 = VectorLoadByte4(Pixel + 4);
+			const VectorRegister4Float P2 = VectorLoadByte4(Pixel + 8);
+			const VectorRegister4Float P3 = VectorLoadByte4(Pixel + 12);
+
+			//transpose so that each register holds one channel of the 4 pixels
+			const VectorRegister4Float T0 = VectorShuffle(P0, P1, 0, 1, 0, 1);
+			const VectorRegister4Float T1 = VectorShuffle(P2, P3, 0, 1, 0, 1);
+			const VectorRegister4Float T2 = VectorShuffle(P0, P1, 2, 3, 2, 3);
+			const VectorRegister4Float T3 = VectorShuffle(P2, P3, 2, 3, 2, 3);
+			const VectorRegister4Float C0 = VectorShuffle(T0, T1, 0, 2, 0, 2);
+			const VectorRegister4Float C1 = VectorShuffle(T0, T1, 1, 3, 1, 3);
+			const VectorRegister4Float C2 = VectorShuffle(T2, T3, 0, 2, 0, 2);
+
+			VectorRegister4Float Y = VectorMultiply(C0, Weight0);
+			Y = VectorMultiplyAdd(C1, Weight1, Y);
+			Y = VectorMultiplyAdd(C2, Weight2, Y);
+			VectorStore(Y, Dst + i);
+		}
+
+		for (; i < Count; ++i)
+		{
+			const uint8* Pixel = Src + i * 4;
+			Dst[i] = W0 * Pixel[0] + W1 * Pixel[1] + W2 * Pixel[2];
+		}
+	}
+
+	/**
+	 * Converts a row of half float RGBA pixels to linear luminance, 4 pixels per iteration.
+	 * Weights already include the linear scale.
+	 */
+	static void ConvertRowHalf(const uint16* RESTRICT Src, float* RESTRICT Dst, int32 Count
+		, const FVector3f& Weights)
+	{
+		const VectorRegister4Float WeightR = VectorSetFloat1(Weights.X);
+		const VectorRegister4Float WeightG = VectorSetFloat1(Weights.Y);
+		const VectorRegister4Float WeightB = VectorSetFloat1(Weights.Z);
+
+		alignas(16) float Decoded[16];
+
+		int32 i = 0;
+		for (; i + 4 <= Count; i += 4)
+		{
+			const uint16* Pixel = Src + i * 4;
+			FPlatformMath::VectorLoadHalf(Decoded, Pixel);
+			FPlatformMath::VectorLoadHalf(Decoded + 4, Pixel + 4);
+			FPlatformMath::VectorLoadHalf(Decoded + 8, Pixel + 8);
+			FPlatformMath::VectorLoadHalf(Decoded + 12, Pixel + 12);
+
+			const VectorRegister4Float P0 = VectorLoadAligned(Decoded);
+			const VectorRegister4Float P1 = VectorLoadAligned(Decoded + 4);
+			const VectorRegister4Float P2 = VectorLoadAligned(Decoded + 8);
+			const VectorRegister4Float P3 = VectorLoadAligned(Decoded + 12);
+
+			const VectorRegister4Float T0 = VectorShuffle(P0, P1, 0, 1, 0, 1);
+			const VectorRegister4Float T1 = VectorShuffle(P2, P3, 0, 1, 0, 1);
+			const VectorRegister4Float T2 = VectorShuffle(P0, P1, 2, 3, 2, 3);
+			const VectorRegister4Float T3 = VectorShuffle(P2, P3, 2, 3, 2, 3);
+			const VectorRegister4Float R = VectorShuffle(T0, T1, 0, 2, 0, 2);
+			const VectorRegister4Float G = VectorShuffle(T0, T1, 1, 3, 1, 3);
+			const VectorRegister4Float B = VectorShuffle(T2, T3, 0, 2, 0, 2);
+
+			VectorRegister4Float Y = VectorMultiply(R, WeightR);
+			Y = VectorMultiplyAdd(G, WeightG, Y);
+			Y = VectorMultiplyAdd(B, WeightB, Y);
+			VectorStore(Y, Dst + i);
+		}
+
+		for (; i < Count; ++i)
+		{
+			FPlatformMath::VectorLoadHalf(Decoded, Src + i * 4);
+			Dst[i] = Weights.X * Decoded[0] + Weights.Y * Decoded[1] + Weights.Z * Decoded[2];
+		}
+	}
+
+	//Rows handed to each task of the region reductions
+	static const int32 RowsPerTask = 16;
+
+	//Columns handed to each task of the summed-area column pass, wide enough to walk whole cache lines
+	static const int32 ColumnsPerTask = 64;
+
+	struct FPartialStats
+	{
+		float Min = MAX_flt;
+		float Max = -MAX_flt;
+		double Sum = 0.0;
+		int64 Count = 0;
+	};
+
+	/**
+	 * Calls Func(X0, X1) for every span [X0, X1) of row Y that lies inside Rect,
+	 * and inside Polygon if given (even-odd rule on the pixel centers).
+	 */
+	template<typename FuncType>
+	static void ForEachSpan(int32 Y, const FIntRect& Rect, const TArray<FVector2D>* Polygon, FuncType&& Func)
+	{
+		if (!Polygon)
+		{
+			Func(Rect.Min.X, Rect.Max.X);
+			return;
+		}
+
+		const double SampleY = Y + 0.5;
+		const TArray<FVector2D>& Points = *Polygon;
+
+		TArray<double, TInlineAllocator<16>> Crossings;
+		for (int32 i = 0, j = Points.Num() - 1; i < Points.Num(); j = i++)
+		{
+			const FVector2D& A = Points[i];
+			const FVector2D& B = Points[j];
+			if ((A.Y <= SampleY) != (B.Y <= SampleY))
+				Crossings.Add(A.X + (SampleY - A.Y) * (B.X - A.X) / (B.Y - A.Y));
+		}
+		Crossings.Sort();
+
+		for (int32 c = 0; c + 1 < Crossings.Num(); c += 2)
+		{
+			const int32 X0 = FMath::Max(Rect.Min.X, FMath::CeilToInt(static_cast<float>(Crossings[c] - 0.5)));
+			const int32 X1 = FMath::Min(Rect.Max.X, FMath::CeilToInt(static_cast<float>(Crossings[c + 1] - 0.5)));
+			if (X1 > X0)
+				Func(X0, X1);
+		}
+	}
+}
+
+float FLuminanceMap::WeightColor(const FColor& Color, ELuminanceWeighting Weighting)
+{
+	const FVector3f Weights = LuminanceMap::GetWeights(Weighting);
+	return Weights.X * Color.R + Weights.Y * Color.G + Weights.Z * Color.B;
+}
+
+float FLuminanceMap::WeightLinearColor(const FLinearColor& Color, ELuminanceWeighting Weighting)
+{
+	const FVector3f Weights = LuminanceMap::GetWeights(Weighting, true);
+	return Weights.X * Color.R + Weights.Y * Color.G + Weights.Z * Color.B;
+}
+
+float FLuminanceMap::WeightPixel(const FLuminanceReadbackResult& Result, int32 Index
+	, ELuminanceWeighting Weighting, float LinearScale)
+{
+	if (Result.IsLinear())
+		return LinearScale * WeightLinearColor(Result.GetLinearColor(Index), Weighting);
+
+	return WeightColor(Result.GetColor(Index), Weighting);
+}
+
+void FLuminanceMap::SetFrame(FLuminanceReadbackResult&& InFrame, ELuminanceWeighting Weighting)
+{
+	Frame = MoveTemp(InFrame);
+	Size = Frame.Rect.Size();
+	CurrentWeighting = Weighting;
+	Convert();
+}
+
+void FLuminanceMap::SetFrame(const TArray<FColor>& Colors, const FIntPoint& InSize, ELuminanceWeighting Weighting)
+{
+	FLuminanceReadbackResult NewFrame;
+	NewFrame.Rect = FIntRect(FIntPoint::ZeroValue, InSize);
+	NewFrame.Format = PF_B8G8R8A8; //FColor memory layout
+	NewFrame.Pixels.SetNumUninitialized(Colors.Num() * sizeof(FColor));
+	FMemory::Memcpy(NewFrame.Pixels.GetData(), Colors.GetData(), Colors.Num() * sizeof(FColor));
+	SetFrame(MoveTemp(NewFrame), Weighting);
+}
+
+void FLuminanceMap::SetFrame(const TArray<FFloat16Color>& Colors, const FIntPoint& InSize, ELuminanceWeighting Weighting)
+{
+	FLuminanceReadbackResult NewFrame;
+	NewFrame.Rect = FIntRect(FIntPoint::ZeroValue, InSize);
+	NewFrame.Format = PF_FloatRGBA;
+	NewFrame.Pixels.SetNumUninitialized(Colors.Num() * sizeof(FFloat16Color));
+	FMemory::Memcpy(NewFrame.Pixels.GetData(), Colors.GetData(), Colors.Num() * sizeof(FFloat16Color));
+	SetFrame(MoveTemp(NewFrame), Weighting);
+}
+
+void FLuminanceMap::SetWeighting(ELuminanceWeighting Weighting)
+{
+	if (Weighting == CurrentWeighting) return;
+	CurrentWeighting = Weighting;
+	Convert();
+}
+
+void FLuminanceMap::SetLinearScale(float Scale)
+{
+	if (Scale == LinearScale) return;
+	LinearScale = Scale;
+	if (IsLinear())
+		Convert();
+}
+
+void FLuminanceMap::Reset()
+{
+	Frame = FLuminanceReadbackResult();
+	Size = FIntPoint::ZeroValue;
+	Values.Reset();
+	SummedArea.Reset();
+}
+
+void FLuminanceMap::Convert()
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuminanceMapConvert);
+
+	const int32 BytesPerPixel = Frame.GetBytesPerPixel();
+	if (Size.X <= 0 || Size.Y <= 0 || Frame.Pixels.Num() < Size.X * Size.Y * BytesPerPixel)
+	{
+		Values.Reset();
+		SummedArea.Reset();
+		return;
+	}
+
+	Values.SetNumUninitialized(Size.X * Size.Y);
+
+	const FVector3f Weights = LuminanceMap::GetWeights(CurrentWeighting);
+	const int32 Width = Size.X;
+	const uint8* Src = Frame.Pixels.GetData();
+	float* Dst = Values.GetData();
+
+	switch (Frame.Format)
+	{
+	case PF_B8G8R8A8:
+		ParallelFor(Size.Y, [=](int32 y)
+		{
+			LuminanceMap::ConvertRow8(Src + y * Width * 4, Dst + y * Width, Width, Weights.Z, Weights.Y, Weights.X);
+		});
+		break;
+	case PF_R8G8B8A8:
+		ParallelFor(Size.Y, [=](int32 y)
+		{
+			LuminanceMap::ConvertRow8(Src + y * Width * 4, Dst + y * Width, Width, Weights.X, Weights.Y, Weights.Z);
+		});
+		break;
+	case PF_FloatRGBA:
+	{
+		const FVector3f LinearWeights = LuminanceMap::GetWeights(CurrentWeighting, true) * LinearScale;
+		const uint16* HalfSrc = reinterpret_cast<const uint16*>(Src);
+		ParallelFor(Size.Y, [=](int32 y)
+		{
+			LuminanceMap::ConvertRowHalf(HalfSrc + y * Width * 4, Dst + y * Width, Width, LinearWeights);
+		});
+		break;
+	}
+	default:
+		//less common formats go through the generic per pixel decode
+		ParallelFor(Size.Y, [this, Width, Dst](int32 y)
+		{
+			for (int32 x = 0; x < Width; ++x)
+				Dst[y * Width + x] = WeightPixel(Frame, y * Width + x, CurrentWeighting, LinearScale);
+		});
+		break;
+	}
+
+	BuildSummedAreaTable();
+}
+
+void FLuminanceMap::BuildSummedAreaTable()
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuminanceSummedAreaBuild);
+
+	const int32 Width = Size.X;
+	const int32 Height = Size.Y;
+	const int32 Stride = Width + 1;
+
+	SummedArea.SetNumUninitialized(Stride * (Height + 1));
+	double* Table = SummedArea.GetData();
+	const float* Data = Values.GetData();
+
+	//first row of the table stays at 0
+	FMemory::Memzero(Table, Stride * sizeof(double));
+
+	//Row pass: prefix sum of every row on its own
+	ParallelFor(Height, [=](int32 y)
+	{
+		const float* Row = Data + y * Width;
+		double* TableRow = Table + (y + 1) * Stride;
+		double Sum = 0.0;
+		TableRow[0] = 0.0;
+		for (int32 x = 0; x < Width; ++x)
+		{
+			Sum += Row[x];
+			TableRow[x + 1] = Sum;
+		}
+	});
+
+	//Column pass: accumulate the rows downwards, in bands of columns
+	const int32 NumTasks = FMath::DivideAndRoundUp(Stride, LuminanceMap::ColumnsPerTask);
+	ParallelFor(NumTasks, [=](int32 Task)
+	{
+		const int32 X0 = Task * LuminanceMap::ColumnsPerTask;
+		const int32 X1 = FMath::Min(X0 + LuminanceMap::ColumnsPerTask, Stride);
+		for (int32 y = 2; y <= Height; ++y)
+		{
+			const double* Above = Table + (y - 1) * Stride;
+			double* TableRow = Table + y * Stride;
+			for (int32 x = X0; x < X1; ++x)
+				TableRow[x] += Above[x];
+		}
+	});
+}
+
+float FLuminanceMap::BoxAverage(const FIntPoint& InMin, const FIntPoint& InMax) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuminanceBoxAverage);
+
+	if (SummedArea.Num() == 0) return 0.f;
+
+	const FIntPoint Min = FIntPoint::ComponentMax(InMin, FIntPoint::ZeroValue);
+	const FIntPoint Max = FIntPoint::ComponentMin(InMax, Size);
+	if (Max.X <= Min.X || Max.Y <= Min.Y) return 0.f;
+
+	const int32 Area = (Max.X - Min.X) * (Max.Y - Min.Y);
+	const int32 Stride = Size.X + 1;
+	const double Sum = SummedArea[Max.Y * Stride + Max.X]
+		- SummedArea[Min.Y * Stride + Max.X]
+		- SummedArea[Max.Y * Stride + Min.X]
+		+ SummedArea[Min.Y * Stride + Min.X];
+
+	return static_cast<float>(Sum / Area);
+}
+
+FLuminanceRegionStats FLuminanceMap::ComputeRegionStats(const FIntRect& InRect, const TArray<FVector2D>* Polygon) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuminanceRegionStats);
+
+	FLuminanceRegionStats Stats;
+	if (!IsValid()) return Stats;
+
+	FIntRect Rect(FIntPoint::ComponentMax(InRect.Min, FIntPoint::ZeroValue), FIntPoint::ComponentMin(InRect.Max, Size));
+
+	if (Polygon)
+	{
+		if (Polygon->Num() < 3) return Stats;
+
+		const FBox2D Bounds(*Polygon);
+		Rect.Min = FIntPoint::ComponentMax(Rect.Min
+			, FIntPoint(FMath::FloorToInt(Bounds.Min.X), FMath::FloorToInt(Bounds.Min.Y)));
+		Rect.Max = FIntPoint::ComponentMin(Rect.Max
+			, FIntPoint(FMath::CeilToInt(Bounds.Max.X), FMath::CeilToInt(Bounds.Max.Y)));
+	}
+
+	if (Rect.Width() <= 0 || Rect.Height() <= 0) return Stats;
+
+	const int32 NumTasks = FMath::DivideAndRoundUp(Rect.Height(), LuminanceMap::RowsPerTask);
+	const float* Data = Values.GetData();
+	const int32 Width = Size.X;
+
+	//Pass 1: min, max and sum
+	TArray<LuminanceMap::FPartialStats> Partials;
+	Partials.SetNum(NumTasks);
+
+	ParallelFor(NumTasks, [&](int32 Task)
+	{
+		LuminanceMap::FPartialStats& Partial = Partials[Task];
+		const int32 Y0 = Rect.Min.Y + Task * LuminanceMap::RowsPerTask;
+		const int32 Y1 = FMath::Min(Y0 + LuminanceMap::RowsPerTask, Rect.Max.Y);
+
+		for (int32 y = Y0; y < Y1; ++y)
+		{
+			const float* Row = Data + y * Width;
+			LuminanceMap::ForEachSpan(y, Rect, Polygon, [&](int32 X0, int32 X1)
+			{
+				for (int32 x = X0; x < X1; ++x)
+				{
+					const float Value = Row[x];
+					Partial.Min = FMath::Min(Partial.Min, Value);
+					Partial.Max = FMath::Max(Partial.Max, Value);
+					Partial.Sum += Value;
+				}
+				Partial.Count += X1 - X0;
+			});
+		}
+	});
+
+	LuminanceMap::FPartialStats Total;
+	for (const LuminanceMap::FPartialStats& Partial : Partials)
+	{
+		Total.Min = FMath::Min(Total.Min, Partial.Min);
+		Total.Max = FMath::Max(Total.Max, Partial.Max);
+		Total.Sum += Partial.Sum;
+		Total.Count += Partial.Count;
+	}
+
+	if (Total.Count == 0) return Stats;
+
+	Stats.PixelCount = static_cast<int32>(Total.Count);
+	Stats.Min = Total.Min;
+	Stats.Max = Total.Max;
+	Stats.Mean = static_cast<float>(Total.Sum / Total.Count);
+	Stats.GlareRatio = Stats.Mean > 0.f ? Stats.Max / Stats.Mean : 0.f;
+	Stats.UniformityRatio = Stats.Mean > 0.f ? Stats.Min / Stats.Mean : 0.f;
+
+	//Pass 2: histogram between Min and Max, one partial histogram per task
+	const int32 NumBins = FLuminanceRegionStats::NumHistogramBins;
+	const float Range = Stats.Max - Stats.Min;
+	const float BinScale = Range > 0.f ? NumBins / Range : 0.f;
+	const float MinValue = Stats.Min;
+
+	TArray<int32> PartialHistograms;
+	PartialHistograms.SetNumZeroed(NumTasks * NumBins);
+
+	ParallelFor(NumTasks, [&](int32 Task)
+	{
+		int32* Histogram = PartialHistograms.GetData() + Task * NumBins;
+		const int32 Y0 = Rect.Min.Y + Task * LuminanceMap::RowsPerTask;
+		const int32 Y1 = FMath::Min(Y0 + LuminanceMap::RowsPerTask, Rect.Max.Y);
+
+		for (int32 y = Y0; y < Y1; ++y)
+		{
+			const float* Row = Data + y * Width;
+			LuminanceMap::ForEachSpan(y, Rect, Polygon, [&](int32 X0, int32 X1)
+			{
+				for (int32 x = X0; x < X1; ++x)
+				{
+					const int32 Bin = FMath::Min(static_cast<int32>((Row[x] - MinValue) * BinScale), NumBins - 1);
+					++Histogram[Bin];
+				}
+			});
+		}
+	});
+
+	Stats.Histogram.SetNumZeroed(NumBins);
+	for (int32 Task = 0; Task < NumTasks; ++Task)
+	{
+		const int32* Histogram = PartialHistograms.GetData() + Task * NumBins;
+		for (int32 Bin = 0; Bin < NumBins; ++Bin)
+			Stats.Histogram[Bin] += Histogram[Bin];
+	}
+
+	auto Percentile = [&](double Fraction) -> float
+	{
+		if (Range <= 0.f) return Stats.Min;
+
+		const double Target = Fraction * Total.Count;
+		int64 Cumulative = 0;
+		for (int32 Bin = 0; Bin < NumBins; ++Bin)
+		{
+			const int32 BinCount = Stats.Histogram[Bin];
+			if (BinCount > 0 && Cumulative + BinCount >= Target)
+			{
+				const double InBin = (Target - Cumulative) / BinCount;
+				return Stats.Min + static_cast<float>((Bin + InBin) / BinScale);
+			}
+			Cumulative += BinCount;
+		}
+		return Stats.Max;
+	};
+
+	Stats.P5 = Percentile(0.05);
+	Stats.P50 = Percentile(0.50);
+	Stats.P95 = Percentile(0.95);
+
+	return Stats;
+}
+
+/**
+ * LuminaCity.BoxAverageBenchmark [Queries]
+ * Logs the cost of one BoxAverage query for a ProbeRadius of 0, 4, 16, 64 and 256 pixels on a random 1920x1080 frame,
+ * next to the cost of summing the same box pixel by pixel and the largest difference between the two.
+ */
+static void RunBoxAverageBenchmark(const TArray<FString>& Args)
+{
+	const int32 Queries = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 100000;
+	const FIntPoint Size(1920, 1080);
+	FRandomStream Random(1234);
+
+	TArray<FColor> Colors;
+	Colors.SetNumUninitialized(Size.X * Size.Y);
+	for (FColor& Color : Colors)
+		Color = FColor(uint8(Random.RandRange(0, 255)), uint8(Random.RandRange(0, 255)), uint8(Random.RandRange(0, 255)), 255);
+
+	FLuminanceMap Map;
+	double StartTime = FPlatformTime::Seconds();
+	Map.SetFrame(Colors, Size, ELuminanceWeighting::LW_Radiance);
+	UE_LOG(LogLuminaCity, Display, TEXT("%dx%d frame converted with its summed-area table in %.2f ms")
+		, Size.X, Size.Y, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+
+	TArray<FIntPoint> Centers;
+	Centers.SetNumUninitialized(Queries);
+	for (FIntPoint& Center : Centers)
+		Center = FIntPoint(Random.RandRange(0, Size.X - 1), Random.RandRange(0, Size.Y - 1));
+
+	for (int32 Radius : { 0, 4, 16, 64, 256 })
+	{
+		//summed so the queries are not optimized away
+		double Sum = 0.0;
+		StartTime = FPlatformTime::Seconds();
+		for (const FIntPoint& Center : Centers)
+			Sum += Map.BoxAverage(Center.X, Center.Y, Radius);
+		const double QueryNs = (FPlatformTime::Seconds() - StartTime) * 1e9 / Queries;
+
+		//what a box costs without the table, on fewer queries since it grows with the area
+		const int32 NaiveQueries = FMath::Min(Queries, 100);
+		float MaxError = 0.f;
+		StartTime = FPlatformTime::Seconds();
+		for (int32 i = 0; i < NaiveQueries; ++i)
+		{
+			const FIntPoint Min(FMath::Max(Centers[i].X - Radius, 0), FMath::Max(Centers[i].Y - Radius, 0));
+			const FIntPoint Max(FMath::Min(Centers[i].X + Radius + 1, Size.X), FMath::Min(Centers[i].Y + Radius + 1, Size.Y));
+
+			double BoxSum = 0.0;
+			for (int32 y = Min.Y; y < Max.Y; ++y)
+			{
+				for (int32 x = Min.X; x < Max.X; ++x)
+					BoxSum += Map.Sample(x, y);
+			}
+			const float Average = float(BoxSum / ((Max.X - Min.X) * (Max.Y - Min.Y)));
+			MaxError = FMath::Max(MaxError, FMath::Abs(Average - Map.BoxAverage(Centers[i].X, Centers[i].Y, Radius)));
+		}
+		const double NaiveNs = (FPlatformTime::Seconds() - StartTime) * 1e9 / NaiveQueries;
+
+		UE_LOG(LogLuminaCity, Display, TEXT("ProbeRadius %3d: BoxAverage %.1f ns per query, pixel loop %.0f ns, max difference %g (mean %.2f)")
+			, Radius, QueryNs, NaiveNs, MaxError, Sum / Queries);
+	}
+}
+
+static FAutoConsoleCommandWithArgs BoxAverageBenchmarkCommand(
+	TEXT("LuminaCity.BoxAverageBenchmark"),
+	TEXT("Logs the cost of a summed-area BoxAverage query for probe radii of 0 to 256 pixels. Optional argument: number of queries"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&RunBoxAverageBenchmark));
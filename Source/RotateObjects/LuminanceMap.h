@@ -0,0 +1,162 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Math/Float16Color.h"
+#include "LuminanceReadback.h"
+#include "LuminanceMap.generated.h"
+
+UENUM(BlueprintType)
+enum class ELuminanceWeighting : uint8
+{
+	LW_Radiance			UMETA(DisplayName = "Radiance"),
+	LW_Unreal			UMETA(DisplayName = "Unreal"),
+};
+
+/**
+ * Aggregate luminance of a region of a frame.
+ * Percentiles are interpolated from the histogram, which has linear bins between Min and Max.
+ */
+USTRUCT(BlueprintType)
+struct FLuminanceRegionStats
+{
+	GENERATED_BODY()
+
+	// Number of pixels in the region. All other values are 0 if this is 0
+	UPROPERTY(BlueprintReadOnly, Category = "Luminance")
+	int32 PixelCount = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Luminance")
+	float Mean = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Luminance")
+	float Min = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Luminance")
+	float Max = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Luminance")
+	float P5 = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Luminance")
+	float P50 = 0.f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Luminance")
+	float P95 = 0.f;
+
+	// Max / Mean. High values point to glare sources inside the region
+	UPROPERTY(BlueprintReadOnly, Category = "Luminance")
+	float GlareRatio = 0.f;
+
+	// Min / Mean, the uniformity ratio used in daylight reports
+	UPROPERTY(BlueprintReadOnly, Category = "Luminance")
+	float UniformityRatio = 0.f;
+
+	// Pixel count per bin, bins are spread linearly between Min and Max
+	UPROPERTY(BlueprintReadOnly, Category = "Luminance")
+	TArray<int32> Histogram;
+
+	static constexpr int32 NumHistogramBins = 256;
+};
+
+/**
+ * Luminance of a whole captured frame, one float per pixel.
+ *
+ * 8 bit frames (the tonemapped viewport) are weighted as they are, in 0-255 display units.
+ * Half float frames (scene referred HDR color) are weighted in linear light and scaled by
+ * the Linear Scale, which gives cd/m2 when the scene uses physical lighting units.
+ *
+ * The frame is converted once (4 pixels at a time through VectorRegister) when it is set,
+ * after that any number of point queries are plain array lookups.
+ * A summed-area table is built along with it, so the average of any box costs four reads.
+ * The captured pixels are kept so the frame can be reconverted with another weighting
+ * without reading it back from the GPU again.
+ */
+class FLuminanceMap
+{
+public:
+
+	// Weights a single 8 bit pixel, used for the blocking single pixel reads
+	static float WeightColor(const FColor& Color, ELuminanceWeighting Weighting);
+
+	// Weights a single linear pixel. The Unreal weighting uses the Rec. 709 luminance weights here, Rec. 601 only applies to gamma encoded values
+	static float WeightLinearColor(const FLinearColor& Color, ELuminanceWeighting Weighting);
+
+	// Weights a pixel of a readback, in linear light (times LinearScale) if the readback is a float format
+	static float WeightPixel(const FLuminanceReadbackResult& Result, int32 Index
+		, ELuminanceWeighting Weighting, float LinearScale);
+
+	// Takes over a full frame readback and converts it with the given weighting
+	void SetFrame(FLuminanceReadbackResult&& InFrame, ELuminanceWeighting Weighting);
+
+	// Takes over a full frame read with FViewport::ReadPixels
+	void SetFrame(const TArray<FColor>& Colors, const FIntPoint& Size, ELuminanceWeighting Weighting);
+
+	// Takes over a full HDR frame read with FRenderTarget::ReadFloat16Pixels
+	void SetFrame(const TArray<FFloat16Color>& Colors, const FIntPoint& Size, ELuminanceWeighting Weighting);
+
+	// Reconverts the stored frame if it was converted with a different weighting
+	void SetWeighting(ELuminanceWeighting Weighting);
+
+	// Sets the factor linear frames are multiplied with (e.g. scene color to cd/m2). Reconverts a linear frame if it changed
+	void SetLinearScale(float Scale);
+
+	// Whether the frame is scene referred linear color
+	bool IsLinear() const { return Frame.IsLinear(); }
+
+	void Reset();
+
+	bool IsValid() const { return Values.Num() > 0; }
+
+	int32 GetWidth() const { return Size.X; }
+	int32 GetHeight() const { return Size.Y; }
+	const FIntPoint& GetSize() const { return Size; }
+	ELuminanceWeighting GetWeighting() const { return CurrentWeighting; }
+
+	// Luminance at a pixel of the frame, clamped to the frame bounds
+	float Sample(int32 X, int32 Y) const
+	{
+		X = FMath::Clamp(X, 0, Size.X - 1);
+		Y = FMath::Clamp(Y, 0, Size.Y - 1);
+		return Values[Y * Size.X + X];
+	}
+
+	/**
+	 * Average luminance of the box [Min, Max) of the frame (clamped to the frame bounds),
+	 * four reads of the summed-area table regardless of the size of the box.
+	 */
+	float BoxAverage(const FIntPoint& Min, const FIntPoint& Max) const;
+
+	// Average luminance of the (2 * Radius + 1)^2 box centered on a pixel
+	float BoxAverage(int32 X, int32 Y, int32 Radius) const
+	{
+		return BoxAverage(FIntPoint(X - Radius, Y - Radius), FIntPoint(X + Radius + 1, Y + Radius + 1));
+	}
+
+	const TArray<float>& GetValues() const { return Values; }
+
+	/**
+	 * Computes the statistics of a region of the frame.
+	 * Rows are reduced in parallel, each task keeping its own partial histogram which are merged at the end.
+
+	 * @param Rect - the region in frame pixels (clamped to the frame)
+	 * @param Polygon - optional mask in frame pixels. If given, only pixels whose center is inside the polygon (and Rect) count.
+	 */
+	FLuminanceRegionStats ComputeRegionStats(const FIntRect& Rect, const TArray<FVector2D>* Polygon = nullptr) const;
+
+private:
+
+	void Convert();
+
+	// Builds SummedArea from Values, a parallel pass over the rows followed by one over the columns
+	void BuildSummedAreaTable();
+
+	FLuminanceReadbackResult Frame;
+	FIntPoint Size = FIntPoint::ZeroValue;
+	ELuminanceWeighting CurrentWeighting = ELuminanceWeighting::LW_Radiance;
+	float LinearScale = 1.f;
+	TArray<float> Values;
+
+	// (Width + 1) x (Height + 1) inclusive prefix sums of Values, first row and column are 0.
+	// Doubles, since a full frame of floats would lose the low bits of the sums.
+	TArray<double> SummedArea;
+};
@@ -0,0 +1,241 @@
+#include "LuminanceProbeSubsystem.h"
+#include "RotateObjects.h"
+#include "Engine/World.h"
+#include "Engine/GameViewportClient.h"
+#include "Engine/LocalPlayer.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "SceneView.h"
+#include "TextureResource.h"
+
+DECLARE_CYCLE_STAT(TEXT("Luminance Probe Readback"), STAT_LuminanceProbeReadback, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Luminance Probe Batch"), STAT_LuminanceProbeBatch, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Luminance Probe Projection"), STAT_LuminanceProbeProjection, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Luminance Probes"), STAT_LuminanceProbes, STATGROUP_LuminaCity);
+
+//Luminance of a probe that is not on screen
+static const float OffScreenLuminance = -1.f;
+
+ULuminanceProbeSubsystem::ULuminanceProbeSubsystem()
+{
+	HDRSource = nullptr;
+	LinearLuminanceScale = 1.f;
+	FrameNumber = MAX_uint64;
+	FrameSource = nullptr;
+	FrameRevision = INDEX_NONE;
+	Revision = 0;
+	ViewportSize = FIntPoint::ZeroValue;
+}
+
+FViewport* ULuminanceProbeSubsystem::FindViewport() const
+{
+	UGameViewportClient* GameViewport = GetWorld() ? GetWorld()->GetGameViewport() : nullptr;
+	return GameViewport ? GameViewport->Viewport : nullptr;
+}
+
+bool ULuminanceProbeSubsystem::UpdateFrame(ELuminanceWeighting Weighting)
+{
+	FViewport* Viewport = FindViewport();
+	if (!Viewport) return false;
+
+	ViewportSize = Viewport->GetSizeXY();
+
+	FRenderTarget* Source = HDRSource ? HDRSource->GameThread_GetRenderTargetResource() : Viewport;
+	if (!Source) return false;
+
+	const FIntPoint SourceSize = Source->GetSizeXY();
+	if (LuminanceMap.IsValid() && FrameNumber == GFrameCounter && FrameSource == Source
+		&& FrameRevision == Revision && LuminanceMap.GetSize() == SourceSize)
+	{
+		LuminanceMap.SetLinearScale(LinearLuminanceScale);
+		LuminanceMap.SetWeighting(Weighting);
+		return true;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_LuminanceProbeReadback);
+
+	//the one GPU sync of the frame, every probe after this is a lookup
+	bool bRead = false;
+	if (HDRSource)
+	{
+		TArray<FFloat16Color> Colors;
+		bRead = Source->ReadFloat16Pixels(Colors) && Colors.Num() == SourceSize.X * SourceSize.Y;
+		if (bRead)
+		{
+			LuminanceMap.SetLinearScale(LinearLuminanceScale);
+			LuminanceMap.SetFrame(Colors, SourceSize, Weighting);
+		}
+	}
+	else
+	{
+		TArray<FColor> Colors;
+		bRead = Source->ReadPixels(Colors) && Colors.Num() == SourceSize.X * SourceSize.Y;
+		if (bRead)
+			LuminanceMap.SetFrame(Colors, SourceSize, Weighting);
+	}
+
+	if (!bRead)
+	{
+		LuminanceMap.Reset();
+		return false;
+	}
+
+	FrameNumber = GFrameCounter;
+	FrameSource = Source;
+	FrameRevision = Revision;
+	return true;
+}
+
+void ULuminanceProbeSubsystem::MeasureScreenProbes(TArrayView<const FVector2D> ScreenPoints, ELuminanceWeighting Weighting
+	, int32 ProbeRadius, TArray<float>& OutLuminance)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuminanceProbeBatch);
+	INC_DWORD_STAT_BY(STAT_LuminanceProbes, ScreenPoints.Num());
+
+	OutLuminance.SetNumUninitialized(ScreenPoints.Num());
+	if (!UpdateFrame(Weighting) || ViewportSize.X <= 0 || ViewportSize.Y <= 0)
+	{
+		for (float& Value : OutLuminance)
+			Value = OffScreenLuminance;
+		return;
+	}
+
+	//the HDR Source does not have to match the viewport resolution
+	const FVector2D Scale(
+		double(LuminanceMap.GetWidth()) / ViewportSize.X,
+		double(LuminanceMap.GetHeight()) / ViewportSize.Y);
+
+	for (int32 i = 0; i < ScreenPoints.Num(); ++i)
+	{
+		const FVector2D& Point = ScreenPoints[i];
+		if (Point.X < 0 || Point.Y < 0 || Point.X >= ViewportSize.X || Point.Y >= ViewportSize.Y)
+		{
+			OutLuminance[i] = OffScreenLuminance;
+			continue;
+		}
+
+		const int32 X = FMath::FloorToInt(Point.X * Scale.X);
+		const int32 Y = FMath::FloorToInt(Point.Y * Scale.Y);
+		OutLuminance[i] = ProbeRadius > 0
+			? LuminanceMap.BoxAverage(X, Y, ProbeRadius)
+			: LuminanceMap.Sample(X, Y);
+	}
+}
+
+void ULuminanceProbeSubsystem::MeasureWorldProbes(TArrayView<const FVector> WorldPoints, ELuminanceWeighting Weighting
+	, int32 ProbeRadius, TArray<float>& OutLuminance)
+{
+	ProjectedPoints.SetNumUninitialized(WorldPoints.Num());
+
+	{
+		SCOPE_CYCLE_COUNTER(STAT_LuminanceProbeProjection);
+
+		APlayerController* PlayerController = GetWorld() ? GetWorld()->GetFirstPlayerController() : nullptr;
+		ULocalPlayer* LocalPlayer = PlayerController ? PlayerController->GetLocalPlayer() : nullptr;
+
+		FSceneViewProjectionData ProjectionData;
+		if (!LocalPlayer || !LocalPlayer->ViewportClient
+			|| !LocalPlayer->GetProjectionData(LocalPlayer->ViewportClient->Viewport, ProjectionData))
+		{
+			OutLuminance.Init(OffScreenLuminance, WorldPoints.Num());
+			return;
+		}
+
+		//one matrix for the whole batch instead of rebuilding the view per point
+		const FMatrix ViewProjection = ProjectionData.ComputeViewProjectionMatrix();
+		const FIntRect ViewRect = ProjectionData.GetConstrainedViewRect();
+
+		for (int32 i = 0; i < WorldPoints.Num(); ++i)
+		{
+			if (!FSceneView::ProjectWorldToScreen(WorldPoints[i], ViewRect, ViewProjection, ProjectedPoints[i]))
+				ProjectedPoints[i] = FVector2D(-1.f, -1.f); //behind the camera, rejected as off screen
+		}
+	}
+
+	MeasureScreenProbes(ProjectedPoints, Weighting, ProbeRadius, OutLuminance);
+}
+
+TArray<float> ULuminanceProbeSubsystem::MeasureScreenProbes(const TArray<FVector2D>& ScreenPoints, ELuminanceWeighting Weighting
+	, int32 ProbeRadius)
+{
+	TArray<float> Luminance;
+	MeasureScreenProbes(MakeArrayView(ScreenPoints), Weighting, ProbeRadius, Luminance);
+	return Luminance;
+}
+
+TArray<float> ULuminanceProbeSubsystem::MeasureWorldProbes(const TArray<FVector>& WorldPoints, ELuminanceWeighting Weighting
+	, int32 ProbeRadius)
+{
+	TArray<float> Luminance;
+	MeasureWorldProbes(MakeArrayView(WorldPoints), Weighting, ProbeRadius, Luminance);
+	return Luminance;
+}
+
+void ULuminanceProbeSubsystem::InvalidateProbes()
+{
+	++Revision;
+}
+
+/**
+ * LuminaCity.ProbeBenchmark [Iterations]
+ * Logs the cost of a batch of 1, 10, 100 and 1000 random screen probes, once with a fresh readback
+ * and averaged over the following (cached) batches, next to the cost of one blocking ReadPixels per probe.
+ */
+static void RunProbeBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	ULuminanceProbeSubsystem* Subsystem = World ? World->GetSubsystem<ULuminanceProbeSubsystem>() : nullptr;
+	UGameViewportClient* GameViewport = World ? World->GetGameViewport() : nullptr;
+	FViewport* Viewport = GameViewport ? GameViewport->Viewport : nullptr;
+	if (!Subsystem || !Viewport)
+	{
+		UE_LOG(LogLuminaCity, Warning, TEXT("ProbeBenchmark needs a game viewport"));
+		return;
+	}
+
+	const int32 Iterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 100;
+	const FIntPoint Size = Viewport->GetSizeXY();
+	FRandomStream Random(1234);
+
+	TArray<FVector2D> Points;
+	TArray<float> Luminance;
+	for (int32 NumProbes : { 1, 10, 100, 1000 })
+	{
+		Points.Reset(NumProbes);
+		for (int32 i = 0; i < NumProbes; ++i)
+			Points.Add(FVector2D(Random.FRandRange(0.f, Size.X - 1), Random.FRandRange(0.f, Size.Y - 1)));
+
+		Subsystem->InvalidateProbes();
+		double StartTime = FPlatformTime::Seconds();
+		Subsystem->MeasureScreenProbes(Points, ELuminanceWeighting::LW_Radiance, 0, Luminance);
+		const double FirstMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+		StartTime = FPlatformTime::Seconds();
+		for (int32 i = 0; i < Iterations; ++i)
+			Subsystem->MeasureScreenProbes(Points, ELuminanceWeighting::LW_Radiance, 0, Luminance);
+		const double CachedMs = (FPlatformTime::Seconds() - StartTime) * 1000.0 / Iterations;
+
+		//what the probes cost before, one GPU sync each. Skipped for 1000, it takes seconds
+		double PerProbeMs = -1.0;
+		if (NumProbes <= 100)
+		{
+			TArray<FColor> Pixel;
+			StartTime = FPlatformTime::Seconds();
+			for (const FVector2D& Point : Points)
+			{
+				const FIntPoint P(FMath::FloorToInt(Point.X), FMath::FloorToInt(Point.Y));
+				Viewport->ReadPixels(Pixel, FReadSurfaceDataFlags(), FIntRect(P, P + FIntPoint(1, 1)));
+			}
+			PerProbeMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+		}
+
+		UE_LOG(LogLuminaCity, Display, TEXT("%4d probes: batch with readback %.3f ms, cached batch %.4f ms, ReadPixels per probe %.3f ms")
+			, NumProbes, FirstMs, CachedMs, PerProbeMs);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs ProbeBenchmarkCommand(
+	TEXT("LuminaCity.ProbeBenchmark"),
+	TEXT("Logs the cost of batched luminance probes for 1, 10, 100 and 1000 probes. Optional argument: number of iterations"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunProbeBenchmark));
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "LuminanceMap.h"
+#include "LuminanceProbeSubsystem.generated.h"
+
+/**
+ * Answers many luminance probes at once.
+ *
+ * Instead of every probe (e.g. every LigthMeter placed around a site) doing its own blocking ReadPixels,
+ * the frame is read back once into a Luminance Map and every probe of every batch in that frame is a lookup.
+ * World space probes are projected with one view projection matrix for the whole batch.
+ */
+UCLASS()
+class ROTATEOBJECTS_API ULuminanceProbeSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	ULuminanceProbeSubsystem();
+
+	/**
+	 * Measures the luminance at a list of screen points, from a single readback of the frame.
+
+	 * @param ScreenPoints - the probe positions, in viewport pixels
+	 * @param Weighting - which weights to convert the pixels with
+	 * @param ProbeRadius - each probe is the average of the (2 * ProbeRadius + 1) pixels wide box around it, 0 samples a single pixel
+	 * @return the luminance of every probe in the same order, -1 for probes outside of the viewport
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Luminance_meter")
+	TArray<float> MeasureScreenProbes(const TArray<FVector2D>& ScreenPoints, ELuminanceWeighting Weighting, int32 ProbeRadius = 0);
+
+	/**
+	 * Same as MeasureScreenProbes, for world locations projected through the first player's view.
+	 * @return the luminance of every probe in the same order, -1 for probes behind the camera or outside of the viewport
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Luminance_meter")
+	TArray<float> MeasureWorldProbes(const TArray<FVector>& WorldPoints, ELuminanceWeighting Weighting, int32 ProbeRadius = 0);
+
+	// Versions of the above filling a caller owned array, so repeated batches do not allocate
+	void MeasureScreenProbes(TArrayView<const FVector2D> ScreenPoints, ELuminanceWeighting Weighting, int32 ProbeRadius, TArray<float>& OutLuminance);
+	void MeasureWorldProbes(TArrayView<const FVector> WorldPoints, ELuminanceWeighting Weighting, int32 ProbeRadius, TArray<float>& OutLuminance);
+
+	/**
+	 * Marks the captured frame as stale. The frame is read back again at most once per engine frame anyway,
+	 * this is only needed when the scene changed within a frame.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Luminance_meter")
+	void InvalidateProbes();
+
+	/**
+	 * Optional render target holding scene referred HDR color (RTF_RGBA16f) to read instead of the tonemapped viewport.
+	 * Screen points are mapped to it relative to the viewport size.
+	 */
+	UPROPERTY(BlueprintReadWrite, Category = "Luminance_meter")
+	class UTextureRenderTarget2D* HDRSource;
+
+	//Factor applied to linear (HDR Source) luminance, 1 reports cd/m2 with physical lighting units
+	UPROPERTY(BlueprintReadWrite, Category = "Luminance_meter")
+	float LinearLuminanceScale;
+
+private:
+
+	// Reads the frame back if the cached one is from another engine frame, source or revision. Returns false if there is nothing to read
+	bool UpdateFrame(ELuminanceWeighting Weighting);
+
+	FViewport* FindViewport() const;
+
+	FLuminanceMap LuminanceMap;
+
+	// What the Luminance Map was read from
+	uint64 FrameNumber;
+	const FRenderTarget* FrameSource;
+	int32 FrameRevision;
+
+	// Bumped by InvalidateProbes
+	int32 Revision;
+
+	// Viewport size of the last batch, screen points are scaled from it to the map
+	FIntPoint ViewportSize;
+
+	// Scratch space of MeasureWorldProbes
+	TArray<FVector2D> ProjectedPoints;
+};
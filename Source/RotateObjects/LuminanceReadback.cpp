@@ -0,0 +1,235 @@
+#include "LuminanceReadback.h"
+#include "RotateObjects.h"
+#include "RenderingThread.h"
+#include "RHIGPUReadback.h"
+#include "UnrealClient.h"
+#include "Math/Float16Color.h"
+
+#include <atomic>
+
+DECLARE_CYCLE_STAT(TEXT("Luminance Readback Resolve"), STAT_LuminanceReadbackResolve, STATGROUP_LuminaCity);
+
+enum class ESlotState : uint8
+{
+	Idle,
+	InFlight,	// copy enqueued on the GPU
+	Resolving,	// rendering thread has been asked to map the staging buffer
+	Ready,		// Result is filled, waiting to be handed out on the Game Thread
+	Failed
+};
+
+struct FLuminanceReadback::FSlot
+{
+	TUniquePtr<FRHIGPUTextureReadback> Readback;
+
+	// Size of the surface the staging buffer was created for. The staging texture is reused, so it is recreated on resize.
+	FIntPoint SourceSize = FIntPoint::ZeroValue;
+
+	FLuminanceReadbackResult Result;
+
+	std::atomic<ESlotState> State { ESlotState::Idle };
+};
+
+int32 FLuminanceReadbackResult::GetBytesPerPixel() const
+{
+	return Format != PF_Unknown ? GPixelFormats[Format].BlockBytes : 0;
+}
+
+FColor FLuminanceReadbackResult::GetColor(int32 Index) const
+{
+	const int32 BytesPerPixel = GetBytesPerPixel();
+	if (BytesPerPixel == 0 || !Pixels.IsValidIndex(Index * BytesPerPixel + BytesPerPixel - 1))
+		return FColor::Black;
+
+	const uint8* Pixel = Pixels.GetData() + Index * BytesPerPixel;
+
+	switch (Format)
+	{
+	case PF_B8G8R8A8:
+		return FColor(Pixel[2], Pixel[1], Pixel[0], Pixel[3]);
+	case PF_R8G8B8A8:
+		return FColor(Pixel[0], Pixel[1], Pixel[2], Pixel[3]);
+	case PF_A2B10G10R10:
+	{
+		const uint32 Packed = *reinterpret_cast<const uint32*>(Pixel);
+		return FColor(
+			((Packed >> 0) & 0x3FF) >> 2,
+			((Packed >> 10) & 0x3FF) >> 2,
+			((Packed >> 20) & 0x3FF) >> 2,
+			((Packed >> 30) & 0x3) * 85);
+	}
+	case PF_FloatRGBA:
+	case PF_A32B32G32R32F:
+		return GetLinearColor(Index).ToFColor(true);
+	default:
+		return FColor::Black;
+	}
+}
+
+FLinearColor FLuminanceReadbackResult::GetLinearColor(int32 Index) const
+{
+	const int32 BytesPerPixel = GetBytesPerPixel();
+	if (BytesPerPixel == 0 || !Pixels.IsValidIndex(Index * BytesPerPixel + BytesPerPixel - 1))
+		return FLinearColor::Black;
+
+	const uint8* Pixel = Pixels.GetData() + Index * BytesPerPixel;
+
+	switch (Format)
+	{
+	case PF_FloatRGBA:
+		return FLinearColor(*reinterpret_cast<const FFloat16Color*>(Pixel));
+	case PF_A32B32G32R32F:
+		return *reinterpret_cast<const FLinearColor*>(Pixel);
+	default:
+		return FLinearColor(GetColor(Index));
+	}
+}
+
+FLuminanceReadback::FLuminanceReadback(int32 NumStagingBuffers)
+{
+	for (int32 i = 0; i < FMath::Max(1, NumStagingBuffers); ++i)
+		Slots.Add(MakeShared<FSlot, ESPMode::ThreadSafe>());
+}
+
+bool FLuminanceReadback::Enqueue(FRenderTarget* Source, const FIntRect& Rect, int32 RequestId)
+{
+	check(IsInGameThread());
+	if (!Source || Rect.Area() <= 0) return false;
+
+	TSharedPtr<FSlot, ESPMode::ThreadSafe> Slot;
+	for (auto& s : Slots)
+	{
+		if (s->State.load() == ESlotState::Idle)
+		{
+			Slot = s;
+			break;
+		}
+	}
+
+	//all staging buffers are busy, caller should try again next frame
+	if (!Slot.IsValid()) return false;
+
+	Slot->Result.RequestId = RequestId;
+	Slot->Result.Rect = Rect;
+	Slot->State = ESlotState::InFlight;
+
+	ENQUEUE_RENDER_COMMAND(LuminanceReadbackEnqueue)(
+		[Slot, Source, Rect](FRHICommandListImmediate& RHICmdList)
+		{
+			FRHITexture* Texture = Source->GetRenderTargetTexture();
+			if (!Texture)
+			{
+				Slot->State = ESlotState::Failed;
+				return;
+			}
+
+			const FIntPoint TextureSize = Texture->GetSizeXY();
+			const FIntRect ClampedRect(
+				FIntPoint::ComponentMax(Rect.Min, FIntPoint::ZeroValue),
+				FIntPoint::ComponentMin(Rect.Max, TextureSize));
+
+			if (ClampedRect.Area() <= 0)
+			{
+				Slot->State = ESlotState::Failed;
+				return;
+			}
+
+			if (!Slot->Readback.IsValid() || Slot->SourceSize != TextureSize)
+			{
+				Slot->Readback = MakeUnique<FRHIGPUTextureReadback>(TEXT("LuminanceReadback"));
+				Slot->SourceSize = TextureSize;
+			}
+
+			Slot->Result.Rect = ClampedRect;
+			Slot->Result.Format = Texture->GetFormat();
+			Slot->Readback->EnqueueCopy(RHICmdList, Texture
+				, FResolveRect(ClampedRect.Min.X, ClampedRect.Min.Y, ClampedRect.Max.X, ClampedRect.Max.Y));
+		});
+
+	return true;
+}
+
+int32 FLuminanceReadback::Poll(TFunctionRef<void(FLuminanceReadbackResult&)> OnReady)
+{
+	check(IsInGameThread());
+
+	int32 NumPending = 0;
+	for (auto& Slot : Slots)
+	{
+		switch (Slot->State.load())
+		{
+		case ESlotState::InFlight:
+		{
+			//Lock / Unlock of the staging buffer has to happen on the rendering thread
+			Slot->State = ESlotState::Resolving;
+			ENQUEUE_RENDER_COMMAND(LuminanceReadbackResolve)(
+				[Slot](FRHICommandListImmediate& RHICmdList)
+				{
+					if (!Slot->Readback->IsReady())
+					{
+						Slot->State = ESlotState::InFlight; //GPU is not done yet, try again next poll
+						return;
+					}
+
+					SCOPE_CYCLE_COUNTER(STAT_LuminanceReadbackResolve);
+
+					FLuminanceReadbackResult& Result = Slot->Result;
+					const int32 BytesPerPixel = Result.GetBytesPerPixel();
+					const int32 Width = Result.Rect.Width();
+					const int32 Height = Result.Rect.Height();
+
+					int32 RowPitchInPixels = 0;
+					const uint8* Source = static_cast<const uint8*>(Slot->Readback->Lock(RowPitchInPixels));
+					if (!Source)
+					{
+						Slot->State = ESlotState::Failed;
+						return;
+					}
+
+					if (BytesPerPixel > 0)
+					{
+						//the copy lands at the origin of the staging texture, rows are padded to RowPitchInPixels
+						Result.Pixels.SetNumUninitialized(Width * Height * BytesPerPixel);
+						for (int32 y = 0; y < Height; ++y)
+						{
+							FMemory::Memcpy(Result.Pixels.GetData() + y * Width * BytesPerPixel
+								, Source + y * RowPitchInPixels * BytesPerPixel
+								, Width * BytesPerPixel);
+						}
+					}
+					Slot->Readback->Unlock();
+					Slot->State = BytesPerPixel > 0 ? ESlotState::Ready : ESlotState::Failed;
+				});
+			++NumPending;
+			break;
+		}
+		case ESlotState::Resolving:
+			++NumPending;
+			break;
+		case ESlotState::Ready:
+			OnReady(Slot->Result);
+			Slot->Result.Pixels.Reset();
+			Slot->State = ESlotState::Idle;
+			break;
+		case ESlotState::Failed:
+			//hand out an empty result so that the requester can drop the request
+			Slot->Result.Pixels.Reset();
+			OnReady(Slot->Result);
+			Slot->State = ESlotState::Idle;
+			break;
+		default:
+			break;
+		}
+	}
+	return NumPending;
+}
+
+bool FLuminanceReadback::HasPendingRequests() const
+{
+	for (auto& Slot : Slots)
+	{
+		if (Slot->State.load() != ESlotState::Idle)
+			return true;
+	}
+	return false;
+}
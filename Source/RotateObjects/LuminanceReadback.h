@@ -0,0 +1,66 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PixelFormat.h"
+
+class FRenderTarget;
+
+/**
+ * A finished readback. Pixels holds Rect.Width() x Rect.Height() tightly packed pixels
+ * in the Format of the surface they were copied from.
+ */
+struct FLuminanceReadbackResult
+{
+	int32 RequestId = INDEX_NONE;
+	FIntRect Rect;
+	EPixelFormat Format = PF_Unknown;
+	TArray<uint8> Pixels;
+
+	int32 GetBytesPerPixel() const;
+
+	// Whether the pixels are floating point, i.e. linear scene referred color instead of a tonemapped 8 bit image
+	bool IsLinear() const { return Format == PF_FloatRGBA || Format == PF_A32B32G32R32F; }
+
+	// Decodes the pixel at Index (row major inside Rect) to an 8 bit color
+	FColor GetColor(int32 Index) const;
+
+	// Decodes the pixel at Index (row major inside Rect) without clamping or gamma, for linear formats
+	FLinearColor GetLinearColor(int32 Index) const;
+};
+
+/**
+ * Non-blocking readback of a render target (usually the game viewport).
+ *
+ * Copies are enqueued on the rendering thread into a small ring of GPU staging buffers
+ * and handed back through Poll a frame or two later, so unlike FViewport::ReadPixels
+ * this never flushes the rendering commands.
+ */
+class FLuminanceReadback
+{
+public:
+
+	explicit FLuminanceReadback(int32 NumStagingBuffers = 3);
+
+	/**
+	 * Enqueues a copy of Rect from the Source render target.
+	 * @return false if every staging buffer is still in flight (the request is dropped)
+	 */
+	bool Enqueue(FRenderTarget* Source, const FIntRect& Rect, int32 RequestId);
+
+	/**
+	 * Hands every finished readback to OnReady. Must be called from the Game Thread, usually on Tick.
+	 * OnReady may move the pixels out of the result.
+	 * @return the number of readbacks that are still in flight
+	 */
+	int32 Poll(TFunctionRef<void(FLuminanceReadbackResult&)> OnReady);
+
+	bool HasPendingRequests() const;
+
+	int32 GetNumStagingBuffers() const { return Slots.Num(); }
+
+private:
+
+	struct FSlot;
+
+	TArray<TSharedPtr<FSlot, ESPMode::ThreadSafe>> Slots;
+};
@@ -1,11 +1,101 @@
 #include "Luminance_meter.h"
+#include "RotateObjects.h"
+#include "Engine/World.h"
+#include "Engine/GameViewportClient.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "TextureResource.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "Components/LightComponent.h"
+#include "Engine/DirectionalLight.h"
+#include "EngineUtils.h"
+#include "Containers/Ticker.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+
+DECLARE_CYCLE_STAT(TEXT("Luminance ReadPixels (blocking)"), STAT_LuminanceReadPixels, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Luminance Async Request"), STAT_LuminanceAsyncRequest, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Luminance Scene Capture"), STAT_LuminanceSceneCapture, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Luminance Monitor Sample"), STAT_LuminanceMonitorSample, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Luminance Readbacks In Flight"), STAT_LuminanceReadbacksInFlight, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Luminance Monitor Samples Skipped"), STAT_LuminanceMonitorSkipped, STATGROUP_LuminaCity);
+
+//How many finished async requests are kept around to be polled
+static const int32 MaxCompletedRequests = 64;
+
+bool ALuminance_meter::FCaptureViewState::Equals(const FCaptureViewState& Other) const
+{
+	return SceneRevision == Other.SceneRevision
+		&& CaptureRevision == Other.CaptureRevision
+		&& Source == Other.Source
+		&& SourceSize == Other.SourceSize
+		&& FMath::IsNearlyEqual(FOV, Other.FOV, 0.01f)
+		&& Location.Equals(Other.Location, 0.1f)
+		&& Rotation.Equals(Other.Rotation, 0.01f);
+}
+
+bool ALuminance_meter::FMonitorState::Equals(const FMonitorState& Other) const
+{
+	return SceneRevision == Other.SceneRevision
+		&& CaptureRevision == Other.CaptureRevision
+		&& MousePosition == Other.MousePosition
+		&& FMath::IsNearlyEqual(SunIntensity, Other.SunIntensity, 0.001f)
+		&& SunRotation.Equals(Other.SunRotation, 0.01f)
+		&& FMath::IsNearlyEqual(FOV, Other.FOV, 0.01f)
+		&& CameraLocation.Equals(Other.CameraLocation, 0.1f)
+		&& CameraRotation.Equals(Other.CameraRotation, 0.01f);
+}
 
 // Sets default values
 ALuminance_meter::ALuminance_meter()
 {
-	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+	// Tick only runs while the meter has work (monitor, capture cadence or readbacks in flight), see UpdateTickEnabled
 	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+
+	Viewport = nullptr;
+	Luminance = 0.f;
+	NumReadbackBuffers = 3;
+	NextRequestId = 0;
+
+	bUseLuminanceMap = false;
+	bRefreshLuminanceMapAsync = false;
+	ProbeRadius = 5;
+	HDRSource = nullptr;
+	LinearLuminanceScale = 1.f;
 
+	RootScene = CreateDefaultSubobject<USceneComponent>(TEXT("RootScene"));
+	RootComponent = RootScene;
+
+	//rendered explicitly by the cadence, never by the engine on its own
+	SceneCapture = CreateDefaultSubobject<USceneCaptureComponent2D>(TEXT("SceneCapture"));
+	SceneCapture->SetupAttachment(RootScene);
+	SceneCapture->bCaptureEveryFrame = false;
+	SceneCapture->bCaptureOnMovement = false;
+	SceneCapture->CaptureSource = ESceneCaptureSource::SCS_SceneColorHDR;
+
+	bUseSceneCapture = false;
+	CaptureResolution = FIntPoint(512, 288);
+	CaptureCadence = ELuminanceCaptureCadence::LC_OnDemand;
+	CaptureEveryNFrames = 10;
+	bCaptureFollowsCamera = true;
+	CaptureTarget = nullptr;
+	CaptureRevision = 0;
+	FramesSinceCapture = 0;
+	LuminanceMapRequestId = INDEX_NONE;
+	SceneRevision = 0;
+
+	bMonitorLuminance = false;
+	MonitorWeighting = ELuminanceWeighting::LW_Radiance;
+	SamplingInterval = 0.25f;
+	MonitorBudgetMs = 1.f;
+	ChangeThreshold = 1.f;
+	Sun = nullptr;
+	NextMonitorSampleTime = 0.0;
+	bMonitorDirty = true;
+	MonitorRequestId = INDEX_NONE;
+	LastReportedLuminance = 0.f;
+	bHasReportedLuminance = false;
 }
 
 // Called when the game starts or when spawned
@@ -13,6 +103,10 @@ void ALuminance_meter::BeginPlay()
 {
 	Super::BeginPlay();
 
+	if (bMonitorLuminance)
+		StartMonitoring(MonitorWeighting);
+	else
+		UpdateTickEnabled();
 }
 
 // Called every frame
@@ -20,80 +114,629 @@ void ALuminance_meter::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	if (bUseSceneCapture)
+		TickSceneCapture();
+
+	if (bMonitorLuminance)
+		TickMonitor();
+
+	if (AsyncReadback.IsValid())
+	{
+		const int32 NumInFlight = AsyncReadback->Poll([this](FLuminanceReadbackResult& Result)
+		{
+			if (Result.RequestId == LuminanceMapRequestId)
+			{
+				LuminanceMapRequestId = INDEX_NONE;
+				if (Result.Pixels.Num() > 0)
+				{
+					LuminanceMap.SetFrame(MoveTemp(Result), LuminanceMap.GetWeighting());
+					LuminanceMapViewState = PendingLuminanceMapViewState;
+					bMonitorDirty = true;
+				}
+				return;
+			}
+
+			ELuminanceWeighting Weighting;
+			if (!PendingRequests.RemoveAndCopyValue(Result.RequestId, Weighting))
+				return;
+
+			const bool bMonitorRequest = Result.RequestId == MonitorRequestId;
+			if (bMonitorRequest)
+				MonitorRequestId = INDEX_NONE;
+
+			//an empty result means the copy failed (e.g. viewport got resized), the request is dropped
+			if (Result.Pixels.Num() == 0)
+			{
+				bMonitorDirty |= bMonitorRequest;
+				return;
+			}
+
+			//same pixel the blocking functions use
+			Luminance = FLuminanceMap::WeightPixel(Result, 0, Weighting, LinearLuminanceScale);
+			if (bMonitorRequest)
+			{
+				HandleMonitorSample(Luminance);
+				return;
+			}
+
+			CompletedRequests.Add(Result.RequestId, Luminance);
+			OnLuminanceReadback.Broadcast(Result.RequestId, Luminance);
+		});
+		SET_DWORD_STAT(STAT_LuminanceReadbacksInFlight, NumInFlight);
+
+		if (CompletedRequests.Num() > MaxCompletedRequests)
+		{
+			for (auto It = CompletedRequests.CreateIterator(); It; ++It)
+			{
+				if (It.Key() < NextRequestId - MaxCompletedRequests)
+					It.RemoveCurrent();
+			}
+		}
+	}
+
+	UpdateTickEnabled();
 }
 
-float ALuminance_meter::RadianceLuminance()
+bool ALuminance_meter::FindViewport()
+{
+	UGameViewportClient* GameViewport = GetWorld() ? GetWorld()->GetGameViewport() : nullptr;
+	Viewport = GameViewport ? GameViewport->Viewport : nullptr;
+	return Viewport != nullptr;
+}
+
+bool ALuminance_meter::GetMousePosition(FIntPoint& OutPosition)
+{
+	if (!FindViewport()) return false;
+
+	OutPosition = FIntPoint(Viewport->GetMouseX(), Viewport->GetMouseY());
+	return true;
+}
+
+UTextureRenderTarget2D* ALuminance_meter::GetHDRTarget() const
+{
+	return bUseSceneCapture ? CaptureTarget : HDRSource;
+}
+
+FRenderTarget* ALuminance_meter::GetSourceTarget()
+{
+	if (bUseSceneCapture && CaptureRevision == 0)
+		CaptureLuminanceScene();
+
+	if (UTextureRenderTarget2D* HDRTarget = GetHDRTarget())
+		return HDRTarget->GameThread_GetRenderTargetResource();
+
+	return Viewport;
+}
+
+bool ALuminance_meter::GetSourcePosition(FIntPoint& OutPosition)
+{
+	FIntPoint MousePosition;
+	if (!GetMousePosition(MousePosition)) return false;
+
+	FRenderTarget* Source = GetSourceTarget();
+	if (!Source) return false;
+
+	//the HDR Source does not have to match the viewport resolution
+	const FIntPoint ViewportSize = Viewport->GetSizeXY();
+	const FIntPoint SourceSize = Source->GetSizeXY();
+	if (Source == Viewport || ViewportSize == SourceSize || ViewportSize.X <= 0 || ViewportSize.Y <= 0)
+	{
+		OutPosition = MousePosition;
+		return true;
+	}
+
+	OutPosition = FIntPoint(
+		MousePosition.X * SourceSize.X / ViewportSize.X,
+		MousePosition.Y * SourceSize.Y / ViewportSize.Y);
+	return true;
+}
+
+bool ALuminance_meter::GetSourceRect(FIntRect& OutRect)
+{
+	FIntPoint SourcePosition;
+	if (!GetSourcePosition(SourcePosition)) return false;
+
+	OutRect = FIntRect(SourcePosition, SourcePosition + FIntPoint(1, 1));
+	return true;
+}
+
+bool ALuminance_meter::ReadSourcePixel(ELuminanceWeighting Weighting, float& OutLuminance)
 {
-	//FViewport* Viewport;
-	//FIntPoint MousePosition;
-	Viewport = GetWorld()->GetGameViewport()->Viewport;
-	/*UWorld* World = GetWorld();*/
+	FIntRect rect;
+	if (!GetSourceRect(rect)) return false;
 
-	int32 x_pos;
-	int32 y_pos;
-	x_pos = Viewport->GetMouseX();
-	y_pos = Viewport->GetMouseY();
+	FRenderTarget* Source = GetSourceTarget();
+	SCOPE_CYCLE_COUNTER(STAT_LuminanceReadPixels);
 
-	FVector2D PixelLocation = FVector2D(x_pos, y_pos);
+	if (GetHDRTarget())
+	{
+		//RCM_MinMax keeps the values as they are instead of normalizing them to 0-1
+		TArray<FLinearColor> PixelData;
+		if (!Source->ReadLinearColorPixels(PixelData, FReadSurfaceDataFlags(RCM_MinMax), rect) || PixelData.Num() == 0)
+			return false;
 
-	/*FVector LightLocation;
-	ULightComponent* LightComponent = World->GetLightAtLocation(PixelLocation, LightLocation);*/
+		OutLuminance = LinearLuminanceScale * FLuminanceMap::WeightLinearColor(PixelData[0], Weighting);
+		return true;
+	}
 
 	TArray<FColor> PixelData;
 	PixelData.AddZeroed(1);
 
-	FIntRect rect(x_pos - 5, y_pos - 5, x_pos + 5, y_pos + 5);
-
-	Viewport->ReadPixels(
+	Source->ReadPixels(
 		PixelData,
 		FReadSurfaceDataFlags(),
 		rect
 	);
 
-	FColor PixelColor = PixelData[0];
-	uint8 Red = PixelColor.R;
-	uint8 Green = PixelColor.G;
-	uint8 Blue = PixelColor.B;
+	if (PixelData.Num() == 0) return false;
+
+	OutLuminance = FLuminanceMap::WeightColor(PixelData[0], Weighting);
+	return true;
+}
+
+bool ALuminance_meter::GetCurrentViewState(FCaptureViewState& OutViewState)
+{
+	FRenderTarget* Source = GetSourceTarget();
+	if (!Source) return false;
+
+	OutViewState.Source = Source;
+	OutViewState.SourceSize = Source->GetSizeXY();
+	OutViewState.SceneRevision = SceneRevision;
+
+	if (bUseSceneCapture)
+	{
+		//the capture only changes when it renders, the player camera does not matter
+		OutViewState.CaptureRevision = CaptureRevision;
+	}
+	else if (APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(this, 0))
+	{
+		OutViewState.Location = CameraManager->GetCameraLocation();
+		OutViewState.Rotation = CameraManager->GetCameraRotation();
+		OutViewState.FOV = CameraManager->GetFOVAngle();
+	}
+	return OutViewState.SourceSize.X > 0 && OutViewState.SourceSize.Y > 0;
+}
+
+bool ALuminance_meter::UpdateLuminanceMap(ELuminanceWeighting Weighting, bool bAsyncRefresh)
+{
+	FCaptureViewState ViewState;
+	if (!GetCurrentViewState(ViewState)) return false;
+
+	if (!LuminanceMap.IsValid() || !ViewState.Equals(LuminanceMapViewState))
+	{
+		if (bAsyncRefresh || bRefreshLuminanceMapAsync)
+		{
+			if (LuminanceMapRequestId == INDEX_NONE)
+			{
+				if (!AsyncReadback.IsValid())
+					AsyncReadback = MakeUnique<FLuminanceReadback>(NumReadbackBuffers);
+
+				if (AsyncReadback->Enqueue(GetSourceTarget(), FIntRect(FIntPoint::ZeroValue, ViewState.SourceSize), NextRequestId))
+				{
+					LuminanceMapRequestId = NextRequestId++;
+					PendingLuminanceMapViewState = ViewState;
+					UpdateTickEnabled();
+				}
+			}
+		}
+		else
+		{
+			//one flush for the whole frame instead of one per query
+			FRenderTarget* Source = GetSourceTarget();
+			const int32 NumPixels = ViewState.SourceSize.X * ViewState.SourceSize.Y;
+			SCOPE_CYCLE_COUNTER(STAT_LuminanceReadPixels);
+
+			if (GetHDRTarget())
+			{
+				TArray<FFloat16Color> Colors;
+				if (Source->ReadFloat16Pixels(Colors) && Colors.Num() == NumPixels)
+				{
+					LuminanceMap.SetFrame(Colors, ViewState.SourceSize, Weighting);
+					LuminanceMapViewState = ViewState;
+				}
+			}
+			else
+			{
+				TArray<FColor> Colors;
+				if (Source->ReadPixels(Colors) && Colors.Num() == NumPixels)
+				{
+					LuminanceMap.SetFrame(Colors, ViewState.SourceSize, Weighting);
+					LuminanceMapViewState = ViewState;
+				}
+			}
+		}
+	}
+
+	if (!LuminanceMap.IsValid()) return false;
+
+	LuminanceMap.SetLinearScale(LinearLuminanceScale);
+	LuminanceMap.SetWeighting(Weighting);
+	return true;
+}
+
+bool ALuminance_meter::SampleLuminanceMap(ELuminanceWeighting Weighting, bool bAsyncRefresh)
+{
+	FIntPoint SourcePosition;
+	if (!GetSourcePosition(SourcePosition) || !UpdateLuminanceMap(Weighting, bAsyncRefresh))
+		return false;
+
+	Luminance = ProbeRadius > 0
+		? LuminanceMap.BoxAverage(SourcePosition.X, SourcePosition.Y, ProbeRadius)
+		: LuminanceMap.Sample(SourcePosition.X, SourcePosition.Y);
+	return true;
+}
+
+float ALuminance_meter::MeasureLuminance(ELuminanceWeighting Weighting)
+{
+	if (bUseLuminanceMap)
+	{
+		SampleLuminanceMap(Weighting);
+		return Luminance;
+	}
+
+	float PixelLuminance;
+	if (ReadSourcePixel(Weighting, PixelLuminance))
+		Luminance = PixelLuminance;
 
-	// Do something with the RGB values
-	Luminance = ((0.265 * Red) + (0.670 * Green) + (0.065 * Blue));
 	return Luminance;
 }
 
+float ALuminance_meter::RadianceLuminance()
+{
+	return MeasureLuminance(ELuminanceWeighting::LW_Radiance);
+}
+
 float ALuminance_meter::UnrealLuminance()
 {
-	//FViewport* Viewport;
-	//FIntPoint MousePosition;
-	Viewport = GetWorld()->GetGameViewport()->Viewport;
-	/*UWorld* World = GetWorld();*/
+	return MeasureLuminance(ELuminanceWeighting::LW_Unreal);
+}
 
-	int32 x_pos;
-	int32 y_pos;
-	x_pos = Viewport->GetMouseX();
-	y_pos = Viewport->GetMouseY();
+FLuminanceRegionStats ALuminance_meter::GetRegionStatistics(FIntPoint RectMin, FIntPoint RectMax
+	, ELuminanceWeighting Weighting)
+{
+	if (!FindViewport() || !UpdateLuminanceMap(Weighting))
+		return FLuminanceRegionStats();
 
-	FVector2D PixelLocation = FVector2D(x_pos, y_pos);
+	return LuminanceMap.ComputeRegionStats(FIntRect(RectMin, RectMax));
+}
 
-	/*FVector LightLocation;
-	ULightComponent* LightComponent = World->GetLightAtLocation(PixelLocation, LightLocation);*/
+FLuminanceRegionStats ALuminance_meter::GetPolygonStatistics(const TArray<FVector2D>& Polygon
+	, ELuminanceWeighting Weighting)
+{
+	if (!FindViewport() || !UpdateLuminanceMap(Weighting))
+		return FLuminanceRegionStats();
 
-	TArray<FColor> PixelData;
-	PixelData.AddZeroed(1);
+	return LuminanceMap.ComputeRegionStats(FIntRect(FIntPoint::ZeroValue, LuminanceMap.GetSize()), &Polygon);
+}
 
-	FIntRect rect(x_pos - 5, y_pos - 5, x_pos + 5, y_pos + 5);
+void ALuminance_meter::InvalidateLuminanceMap()
+{
+	++SceneRevision;
+}
 
-	Viewport->ReadPixels(
-		PixelData,
-		FReadSurfaceDataFlags(),
-		rect
-	);
+int32 ALuminance_meter::RequestLuminanceAsync(ELuminanceWeighting Weighting)
+{
+	SCOPE_CYCLE_COUNTER(STAT_LuminanceAsyncRequest);
 
-	FColor PixelColor = PixelData[0];
-	uint8 Red = PixelColor.R;
-	uint8 Green = PixelColor.G;
-	uint8 Blue = PixelColor.B;
+	FIntRect rect;
+	if (!GetSourceRect(rect)) return INDEX_NONE;
 
-	// Do something with the RGB values
-	Luminance = ((0.299 * Red) + (0.587 * Green) + (0.114 * Blue));
-	return Luminance;
-}
\ No newline at end of file
+	if (!AsyncReadback.IsValid())
+		AsyncReadback = MakeUnique<FLuminanceReadback>(NumReadbackBuffers);
+
+	//the same pixel as the blocking functions read
+	if (!AsyncReadback->Enqueue(GetSourceTarget(), rect, NextRequestId))
+		return INDEX_NONE;
+
+	PendingRequests.Add(NextRequestId, Weighting);
+	UpdateTickEnabled();
+	return NextRequestId++;
+}
+
+bool ALuminance_meter::PollLuminance(int32 RequestId, float& OutLuminance)
+{
+	return CompletedRequests.RemoveAndCopyValue(RequestId, OutLuminance);
+}
+
+void ALuminance_meter::UpdateCaptureTarget()
+{
+	const int32 SizeX = FMath::Clamp(CaptureResolution.X, 1, 8192);
+	const int32 SizeY = FMath::Clamp(CaptureResolution.Y, 1, 8192);
+
+	if (!CaptureTarget)
+	{
+		CaptureTarget = NewObject<UTextureRenderTarget2D>(this, TEXT("LuminanceCaptureTarget"));
+		CaptureTarget->ClearColor = FLinearColor::Black;
+		CaptureTarget->InitCustomFormat(SizeX, SizeY, PF_FloatRGBA, true);
+	}
+	else if (CaptureTarget->SizeX != SizeX || CaptureTarget->SizeY != SizeY)
+	{
+		CaptureTarget->ResizeTarget(SizeX, SizeY);
+	}
+
+	SceneCapture->TextureTarget = CaptureTarget;
+}
+
+void ALuminance_meter::GetCaptureCamera(FVector& OutLocation, FRotator& OutRotation, float& OutFOV) const
+{
+	APlayerCameraManager* CameraManager = bCaptureFollowsCamera ? UGameplayStatics::GetPlayerCameraManager(this, 0) : nullptr;
+	if (CameraManager)
+	{
+		OutLocation = CameraManager->GetCameraLocation();
+		OutRotation = CameraManager->GetCameraRotation();
+		OutFOV = CameraManager->GetFOVAngle();
+	}
+	else
+	{
+		OutLocation = SceneCapture->GetComponentLocation();
+		OutRotation = SceneCapture->GetComponentRotation();
+		OutFOV = SceneCapture->FOVAngle;
+	}
+}
+
+bool ALuminance_meter::CaptureLuminanceScene()
+{
+	if (!bUseSceneCapture || !GetWorld()) return false;
+
+	SCOPE_CYCLE_COUNTER(STAT_LuminanceSceneCapture);
+
+	UpdateCaptureTarget();
+
+	FVector Location;
+	FRotator Rotation;
+	float FOV;
+	GetCaptureCamera(Location, Rotation, FOV);
+
+	if (bCaptureFollowsCamera)
+	{
+		SceneCapture->SetWorldLocationAndRotation(Location, Rotation);
+		SceneCapture->FOVAngle = FOV;
+	}
+
+	//only enqueues the render, reads of the target later on are ordered after it on the rendering thread
+	SceneCapture->CaptureScene();
+
+	++CaptureRevision;
+	FramesSinceCapture = 0;
+	UpdateTickEnabled();
+
+	LastCaptureState.Location = Location;
+	LastCaptureState.Rotation = Rotation;
+	LastCaptureState.FOV = FOV;
+	LastCaptureState.SceneRevision = SceneRevision;
+	return true;
+}
+
+void ALuminance_meter::TickSceneCapture()
+{
+	++FramesSinceCapture;
+
+	switch (CaptureCadence)
+	{
+	case ELuminanceCaptureCadence::LC_EveryNFrames:
+		if (FramesSinceCapture >= CaptureEveryNFrames)
+			CaptureLuminanceScene();
+		break;
+	case ELuminanceCaptureCadence::LC_OnSceneChange:
+	{
+		FCaptureViewState State;
+		GetCaptureCamera(State.Location, State.Rotation, State.FOV);
+		State.SceneRevision = SceneRevision;
+		if (CaptureRevision == 0 || !State.Equals(LastCaptureState))
+			CaptureLuminanceScene();
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void ALuminance_meter::StartMonitoring(ELuminanceWeighting Weighting)
+{
+	if (!Sun && GetWorld())
+	{
+		TActorIterator<ADirectionalLight> It(GetWorld());
+		Sun = It ? *It : nullptr;
+	}
+
+	bMonitorLuminance = true;
+	MonitorWeighting = Weighting;
+	bMonitorDirty = true;
+	bHasReportedLuminance = false;
+	NextMonitorSampleTime = 0.0;
+	UpdateTickEnabled();
+}
+
+void ALuminance_meter::StopMonitoring()
+{
+	bMonitorLuminance = false;
+	UpdateTickEnabled();
+}
+
+void ALuminance_meter::UpdateTickEnabled()
+{
+	const bool bCaptureCadence = bUseSceneCapture && CaptureCadence != ELuminanceCaptureCadence::LC_OnDemand;
+	const bool bReadbacksInFlight = AsyncReadback.IsValid() && AsyncReadback->HasPendingRequests();
+
+	//readbacks and the capture cadence are counted in frames, the monitor alone can tick at its own interval
+	const bool bEveryFrame = bCaptureCadence || bReadbacksInFlight || MonitorRequestId != INDEX_NONE;
+	SetActorTickInterval(bEveryFrame ? 0.f : SamplingInterval);
+	SetActorTickEnabled(bEveryFrame || bMonitorLuminance);
+}
+
+void ALuminance_meter::GetMonitorState(FMonitorState& OutState)
+{
+	OutState.SceneRevision = SceneRevision;
+	OutState.CaptureRevision = bUseSceneCapture ? CaptureRevision : INDEX_NONE;
+	GetMousePosition(OutState.MousePosition);
+
+	if (APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(this, 0))
+	{
+		OutState.CameraLocation = CameraManager->GetCameraLocation();
+		OutState.CameraRotation = CameraManager->GetCameraRotation();
+		OutState.FOV = CameraManager->GetFOVAngle();
+	}
+
+	if (Sun)
+	{
+		OutState.SunRotation = Sun->GetActorRotation();
+		OutState.SunIntensity = Sun->GetLightComponent() ? Sun->GetLightComponent()->Intensity : 0.f;
+	}
+}
+
+void ALuminance_meter::TickMonitor()
+{
+	const double Now = GetWorld()->GetTimeSeconds();
+	if (Now < NextMonitorSampleTime || MonitorRequestId != INDEX_NONE) return;
+
+	FMonitorState State;
+	GetMonitorState(State);
+
+	if (!bMonitorDirty && State.Equals(LastMonitorState))
+	{
+		INC_DWORD_STAT(STAT_LuminanceMonitorSkipped);
+		NextMonitorSampleTime = Now + SamplingInterval;
+		return;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	{
+		SCOPE_CYCLE_COUNTER(STAT_LuminanceMonitorSample);
+
+		if (bUseLuminanceMap)
+		{
+			//a stale map is refreshed async even without bRefreshLuminanceMapAsync, the frame arriving marks the monitor dirty.
+			//Until the first frame there is nothing to sample and the monitor stays dirty
+			if (SampleLuminanceMap(MonitorWeighting, true))
+			{
+				HandleMonitorSample(Luminance);
+				bMonitorDirty = false;
+			}
+		}
+		else
+		{
+			//never flush the rendering thread from Tick, the result is handled when the readback is polled
+			MonitorRequestId = RequestLuminanceAsync(MonitorWeighting);
+			bMonitorDirty = MonitorRequestId == INDEX_NONE;
+		}
+	}
+	const double CostMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+	LastMonitorState = State;
+
+	//over budget, back off by the same factor
+	const double BackOff = MonitorBudgetMs > 0.f && CostMs > MonitorBudgetMs ? CostMs / MonitorBudgetMs : 1.0;
+	NextMonitorSampleTime = Now + SamplingInterval * BackOff;
+}
+
+void ALuminance_meter::HandleMonitorSample(float Sample)
+{
+	if (bHasReportedLuminance && FMath::Abs(Sample - LastReportedLuminance) <= ChangeThreshold)
+		return;
+
+	const float Previous = bHasReportedLuminance ? LastReportedLuminance : Sample;
+	LastReportedLuminance = Sample;
+	bHasReportedLuminance = true;
+	OnLuminanceChanged.Broadcast(Sample, Previous);
+}
+
+/**
+ * LuminaCity.ReadbackBenchmark [Frames]
+ * Reads the pixel under the mouse with the first Luminance_meter of the world, once per frame for Frames frames
+ * (120 by default) with the blocking RadianceLuminance and then with RequestLuminanceAsync, after as many frames
+ * without any read. Logs the average and worst frame time of each, and how many async readbacks arrived.
+ */
+static void RunReadbackBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	TActorIterator<ALuminance_meter> It(World);
+	if (!World || !It)
+	{
+		UE_LOG(LogLuminaCity, Warning, TEXT("ReadbackBenchmark needs a world with a Luminance_meter"));
+		return;
+	}
+
+	struct FReadbackBenchmark
+	{
+		TWeakObjectPtr<ALuminance_meter> Meter;
+		int32 Frames = 0;
+		int32 Frame = 0;
+		double TotalMs[3] = { 0.0, 0.0, 0.0 };
+		double WorstMs[3] = { 0.0, 0.0, 0.0 };
+		TArray<int32> PendingIds;
+		int32 NumRequested = 0;
+		int32 NumArrived = 0;
+		bool bUsedLuminanceMap = false;
+	};
+	TSharedRef<FReadbackBenchmark> Benchmark = MakeShared<FReadbackBenchmark>();
+	Benchmark->Meter = *It;
+	Benchmark->Frames = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 120;
+
+	//the blocking read of the pixel, not of the whole frame for the luminance map
+	Benchmark->bUsedLuminanceMap = It->bUseLuminanceMap;
+	It->bUseLuminanceMap = false;
+
+	//DeltaTime is the time of the previous frame, the one that made the last read
+	FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([Benchmark](float DeltaTime)
+	{
+		ALuminance_meter* Meter = Benchmark->Meter.Get();
+		if (!Meter)
+		{
+			UE_LOG(LogLuminaCity, Warning, TEXT("ReadbackBenchmark: the Luminance_meter was destroyed"));
+			return false;
+		}
+
+		const int32 Phase = Benchmark->Frame / Benchmark->Frames;
+		if (Benchmark->Frame > 0 && Benchmark->Frame % Benchmark->Frames != 0)
+		{
+			Benchmark->TotalMs[Phase] += DeltaTime * 1000.0;
+			Benchmark->WorstMs[Phase] = FMath::Max(Benchmark->WorstMs[Phase], DeltaTime * 1000.0);
+		}
+
+		for (int32 i = Benchmark->PendingIds.Num() - 1; i >= 0; --i)
+		{
+			float Luminance;
+			if (Meter->PollLuminance(Benchmark->PendingIds[i], Luminance))
+			{
+				Benchmark->PendingIds.RemoveAtSwap(i);
+				++Benchmark->NumArrived;
+			}
+		}
+
+		if (Phase >= 3)
+		{
+			Meter->bUseLuminanceMap = Benchmark->bUsedLuminanceMap;
+
+			//the first frame of every phase is not counted, it was made by the previous one
+			const int32 Counted = FMath::Max(1, Benchmark->Frames - 1);
+			const TCHAR* Names[] = { TEXT("No read"), TEXT("Blocking ReadPixels"), TEXT("Async readback") };
+			for (int32 i = 0; i < 3; ++i)
+			{
+				UE_LOG(LogLuminaCity, Display, TEXT("%-20s %d frames: %.3f ms average frame, %.3f ms worst")
+					, Names[i], Counted, Benchmark->TotalMs[i] / Counted, Benchmark->WorstMs[i]);
+			}
+			UE_LOG(LogLuminaCity, Display, TEXT("%d of %d async readbacks arrived"), Benchmark->NumArrived, Benchmark->NumRequested);
+			return false;
+		}
+
+		if (Phase == 1)
+		{
+			Meter->RadianceLuminance();
+		}
+		else if (Phase == 2)
+		{
+			//every staging buffer in flight, the request is dropped like the monitor's would be
+			const int32 RequestId = Meter->RequestLuminanceAsync(ELuminanceWeighting::LW_Radiance);
+			++Benchmark->NumRequested;
+			if (RequestId != INDEX_NONE)
+				Benchmark->PendingIds.Add(RequestId);
+		}
+
+		++Benchmark->Frame;
+		return true;
+	}));
+}
+
+static FAutoConsoleCommandWithWorldAndArgs ReadbackBenchmarkCommand(
+	TEXT("LuminaCity.ReadbackBenchmark"),
+	TEXT("Logs the frame time of reading the luminance under the mouse every frame, blocking and async. Optional argument: number of frames per run"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunReadbackBenchmark));
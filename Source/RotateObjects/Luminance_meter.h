@@ -2,8 +2,22 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "LuminanceReadback.h"
+#include "LuminanceMap.h"
 #include "Luminance_meter.generated.h"
 
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FLuminanceReadbackDelegate, int32, RequestId, float, Luminance);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FLuminanceChangedDelegate, float, NewLuminance, float, PreviousLuminance);
+
+//When the Scene Capture of a Luminance meter renders
+UENUM(BlueprintType)
+enum class ELuminanceCaptureCadence : uint8
+{
+	LC_OnDemand			UMETA(DisplayName = "On Demand"),
+	LC_EveryNFrames		UMETA(DisplayName = "Every N Frames"),
+	LC_OnSceneChange	UMETA(DisplayName = "On Scene Change"),
+};
+
 UCLASS()
 class ROTATEOBJECTS_API ALuminance_meter : public AActor
 {
@@ -22,6 +36,174 @@ public:
 	// Sets default values for this actor's properties
 	ALuminance_meter();
 
+	/**
+	 * Non-blocking version of RadianceLuminance / UnrealLuminance.
+	 * Enqueues a GPU copy of the pixels under the mouse instead of flushing the rendering thread.
+	 * The result arrives a frame or two later through OnLuminanceReadback, or can be polled with PollLuminance.
+
+	 * @param Weighting - which weights to apply to the pixel (same as RadianceLuminance or UnrealLuminance)
+	 * @return the Request Id, or -1 if there is no viewport or every staging buffer is still in flight
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Luminance_meter")
+	int32 RequestLuminanceAsync(ELuminanceWeighting Weighting);
+
+	/**
+	 * Gets the result of a request made with RequestLuminanceAsync.
+	 * Returns false while the request is still in flight (or if the Request Id is unknown).
+	 * A finished request can only be polled once.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Luminance_meter")
+	bool PollLuminance(int32 RequestId, float& OutLuminance);
+
+	//Called when a request made with RequestLuminanceAsync has been read back
+	UPROPERTY(BlueprintAssignable, Category = "Luminance_meter")
+	FLuminanceReadbackDelegate OnLuminanceReadback;
+
+	/**
+	 * Statistics (mean, min/max, percentiles, glare & uniformity ratios, histogram) of the luminance
+	 * inside a rectangle of the viewport. Uses the Luminance Map, capturing the frame if it is stale.
+
+	 * @param RectMin - top left corner of the rectangle, in source pixels (viewport pixels unless an HDR Source is set)
+	 * @param RectMax - bottom right corner of the rectangle (exclusive), in source pixels (viewport pixels unless an HDR Source is set)
+	 * @param Weighting - which weights to convert the pixels with
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Luminance_meter")
+	FLuminanceRegionStats GetRegionStatistics(FIntPoint RectMin, FIntPoint RectMax, ELuminanceWeighting Weighting);
+
+	/**
+	 * Same as GetRegionStatistics, but only counts the pixels inside a polygon
+	 * (e.g. the outline of a room or facade on screen).
+
+	 * @param Polygon - the polygon points, in source pixels (viewport pixels unless an HDR Source is set)
+	 * @param Weighting - which weights to convert the pixels with
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Luminance_meter")
+	FLuminanceRegionStats GetPolygonStatistics(const TArray<FVector2D>& Polygon, ELuminanceWeighting Weighting);
+
+	/**
+	 * Marks the cached Luminance Map as stale (e.g. because something in the scene changed).
+	 * The next query captures the viewport again.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Luminance_meter")
+	void InvalidateLuminanceMap();
+
+	/**
+	 * Whether RadianceLuminance / UnrealLuminance capture the whole viewport once into a Luminance Map
+	 * and answer every following query with a lookup, until the camera moves or InvalidateLuminanceMap is called.
+	 * If false, every query reads the pixels under the mouse with a blocking ReadPixels.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Luminance_meter")
+	bool bUseLuminanceMap;
+
+	/**
+	 * Only used with bUseLuminanceMap.
+	 * A stale map is refreshed through the async readback instead of a blocking ReadPixels,
+	 * queries keep using the previous map until the new frame arrives.
+	 * The luminance monitor always refreshes the map this way.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Luminance_meter")
+	bool bRefreshLuminanceMapAsync;
+
+	/**
+	 * Only used with bUseLuminanceMap.
+	 * Queries return the average luminance of the (2 * ProbeRadius + 1) pixels wide box around the mouse.
+	 * The cost is the same for any radius (summed-area table), 0 samples the single pixel under the mouse.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Luminance_meter", meta = (ClampMin = "0"))
+	int32 ProbeRadius;
+
+	/**
+	 * Optional render target holding scene referred HDR color (RTF_RGBA16f), e.g. a scene capture
+	 * before tonemapping or the output of the RadianceLuminance post process material.
+	 * If set, luminance is read from it in linear light instead of from the tonemapped 8 bit viewport.
+	 * The mouse position is mapped to it relative to the viewport size.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Luminance_meter")
+	class UTextureRenderTarget2D* HDRSource;
+
+	/**
+	 * Factor applied to linear (HDR Source) luminance.
+	 * With physical lighting units (extended default luminance range) scene color is already in cd/m2, so 1 reports cd/m2.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Luminance_meter", meta = (ClampMin = "0"))
+	float LinearLuminanceScale;
+
+	/**
+	 * Read the luminance from the meter's own Scene Capture instead of the player viewport.
+	 * The capture renders linear scene color (before tonemapping) into a render target of Capture Resolution,
+	 * so the cost and resolution of the analysis do not depend on the window. Takes precedence over HDR Source.
+	 * Mouse positions are mapped to the capture relative to the viewport size.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Scene Capture")
+	bool bUseSceneCapture;
+
+	//Size of the capture render target, e.g. low for continuous monitoring and high for a snapshot
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Scene Capture", meta = (ClampMin = "1", ClampMax = "8192"))
+	FIntPoint CaptureResolution;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Scene Capture")
+	ELuminanceCaptureCadence CaptureCadence;
+
+	//Only used with the Every N Frames cadence
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Scene Capture", meta = (ClampMin = "1"))
+	int32 CaptureEveryNFrames;
+
+	//Whether the capture is moved to the player camera (location, rotation and FOV) before it renders
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Scene Capture")
+	bool bCaptureFollowsCamera;
+
+	/**
+	 * Renders the Scene Capture now (the On Demand cadence, or an extra snapshot with any cadence).
+	 * Following queries read the new capture.
+
+	 * @return false if the capture could not render (no world or bUseSceneCapture is off)
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Scene Capture")
+	bool CaptureLuminanceScene();
+
+	/**
+	 * Starts measuring the luminance under the mouse on Tick, every Sampling Interval.
+	 * A sample is skipped if the camera, mouse, sun and scene revision did not change since the previous one.
+	 * OnLuminanceChanged fires when the value moved more than Change Threshold.
+
+	 * @param Weighting - which weights the monitor measures with
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Monitor")
+	void StartMonitoring(ELuminanceWeighting Weighting);
+
+	UFUNCTION(BlueprintCallable, Category = "Monitor")
+	void StopMonitoring();
+
+	//Called by the monitor when the luminance moved more than Change Threshold since the last time it fired
+	UPROPERTY(BlueprintAssignable, Category = "Monitor")
+	FLuminanceChangedDelegate OnLuminanceChanged;
+
+	//Whether the monitor runs from BeginPlay on, with Monitor Weighting
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Monitor")
+	bool bMonitorLuminance;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Monitor")
+	ELuminanceWeighting MonitorWeighting;
+
+	//Seconds between two monitor samples
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Monitor", meta = (ClampMin = "0"))
+	float SamplingInterval;
+
+	/**
+	 * Game Thread milliseconds a monitor sample may take.
+	 * If a sample costs more, the next one is delayed by the same factor (0 disables the budget).
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Monitor", meta = (ClampMin = "0"))
+	float MonitorBudgetMs;
+
+	//How far the luminance has to move (in the units of the source) before OnLuminanceChanged fires
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Monitor", meta = (ClampMin = "0"))
+	float ChangeThreshold;
+
+	//Directional light whose rotation and intensity count as a scene change. If not set, the first one in the world is used
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Monitor")
+	class ADirectionalLight* Sun;
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
@@ -30,4 +212,138 @@ public:
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
-};
\ No newline at end of file
+private:
+
+	//Camera and source a Luminance Map was captured with
+	struct FCaptureViewState
+	{
+		FVector Location = FVector::ZeroVector;
+		FRotator Rotation = FRotator::ZeroRotator;
+		float FOV = 0.f;
+		const FRenderTarget* Source = nullptr;
+		FIntPoint SourceSize = FIntPoint::ZeroValue;
+		int32 SceneRevision = INDEX_NONE;
+		int32 CaptureRevision = INDEX_NONE;
+
+		bool Equals(const FCaptureViewState& Other) const;
+	};
+
+	//Everything a monitor sample depends on, a sample is skipped while it does not change
+	struct FMonitorState
+	{
+		FVector CameraLocation = FVector::ZeroVector;
+		FRotator CameraRotation = FRotator::ZeroRotator;
+		float FOV = 0.f;
+		FIntPoint MousePosition = FIntPoint::ZeroValue;
+		FRotator SunRotation = FRotator::ZeroRotator;
+		float SunIntensity = 0.f;
+		int32 SceneRevision = INDEX_NONE;
+		int32 CaptureRevision = INDEX_NONE;
+
+		bool Equals(const FMonitorState& Other) const;
+	};
+
+	//Enables Tick only while there is something to do: monitoring, a capture cadence or readbacks in flight
+	void UpdateTickEnabled();
+
+	//Takes a monitor sample if it is due and anything changed, called on Tick
+	void TickMonitor();
+
+	void GetMonitorState(FMonitorState& OutState);
+
+	//Fires OnLuminanceChanged if the sample moved past the Change Threshold
+	void HandleMonitorSample(float Sample);
+
+	//Measures the luminance under the mouse, either from the Luminance Map or with a blocking read
+	float MeasureLuminance(ELuminanceWeighting Weighting);
+
+	//Sets Viewport to the Game Viewport. Returns false if there is none
+	bool FindViewport();
+
+	//Gets the mouse position in the Game Viewport. Returns false if there is no Game Viewport
+	bool GetMousePosition(FIntPoint& OutPosition);
+
+	//Linear render target the luminance is read from: the capture target in Scene Capture mode, else the HDR Source (may be null)
+	class UTextureRenderTarget2D* GetHDRTarget() const;
+
+	//Render target the luminance is read from: the HDR Target if there is one, else the Game Viewport (FindViewport must have succeeded).
+	//Renders the Scene Capture first if it has never rendered
+	FRenderTarget* GetSourceTarget();
+
+	//Gets the pixel of the source under the mouse. Returns false if there is no Game Viewport
+	bool GetSourcePosition(FIntPoint& OutPosition);
+
+	//The one pixel rect of the source under the mouse the luminance functions read. Returns false if there is no Game Viewport
+	bool GetSourceRect(FIntRect& OutRect);
+
+	//Blocking read of the luminance of the pixel under the mouse (flushes the rendering thread)
+	bool ReadSourcePixel(ELuminanceWeighting Weighting, float& OutLuminance);
+
+	bool GetCurrentViewState(FCaptureViewState& OutViewState);
+
+	//Makes sure the Luminance Map matches the current view (or has a refresh in flight). Returns false if there is no map to sample.
+	//bAsyncRefresh refreshes a stale map through the async readback even if bRefreshLuminanceMapAsync is false
+	bool UpdateLuminanceMap(ELuminanceWeighting Weighting, bool bAsyncRefresh = false);
+
+	//Sets Luminance from the Luminance Map under the mouse (box average over Probe Radius). Returns false if there is no map to sample
+	bool SampleLuminanceMap(ELuminanceWeighting Weighting, bool bAsyncRefresh = false);
+
+	FLuminanceMap LuminanceMap;
+	FCaptureViewState LuminanceMapViewState;
+
+	//Async full frame request refreshing the Luminance Map (INDEX_NONE if none is in flight)
+	int32 LuminanceMapRequestId;
+	FCaptureViewState PendingLuminanceMapViewState;
+
+	//Bumped by InvalidateLuminanceMap
+	int32 SceneRevision;
+
+	//Creates the capture render target, or resizes it to Capture Resolution
+	void UpdateCaptureTarget();
+
+	//Runs the Capture Cadence, called on Tick
+	void TickSceneCapture();
+
+	//Camera the capture would render with now, for the On Scene Change cadence
+	void GetCaptureCamera(FVector& OutLocation, FRotator& OutRotation, float& OutFOV) const;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Scene Capture", meta = (AllowPrivateAccess = "true"))
+	class USceneComponent* RootScene;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Scene Capture", meta = (AllowPrivateAccess = "true"))
+	class USceneCaptureComponent2D* SceneCapture;
+
+	//RGBA16f target the Scene Capture renders into, created on the first capture
+	UPROPERTY(Transient)
+	class UTextureRenderTarget2D* CaptureTarget;
+
+	//Bumped on every capture, 0 until the first one
+	int32 CaptureRevision;
+	int32 FramesSinceCapture;
+
+	//Camera and scene revision of the last capture, for the On Scene Change cadence
+	FCaptureViewState LastCaptureState;
+
+	FMonitorState LastMonitorState;
+	double NextMonitorSampleTime;
+
+	//Set when the sources changed in a way the Monitor State does not see (e.g. a new Luminance Map arrived)
+	bool bMonitorDirty;
+
+	//Async request of the monitor in flight (INDEX_NONE if none)
+	int32 MonitorRequestId;
+
+	//Last value OnLuminanceChanged fired with
+	float LastReportedLuminance;
+	bool bHasReportedLuminance;
+
+	//Number of staging buffers used by RequestLuminanceAsync, i.e. how many requests can be in flight at once
+	UPROPERTY(EditAnywhere, Category = "Luminance_meter", meta = (ClampMin = "1", ClampMax = "8"))
+	int32 NumReadbackBuffers;
+
+	TUniquePtr<FLuminanceReadback> AsyncReadback;
+
+	TMap<int32, ELuminanceWeighting> PendingRequests;
+	TMap<int32, float> CompletedRequests;
+	int32 NextRequestId;
+};
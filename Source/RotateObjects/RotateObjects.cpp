@@ -3,5 +3,7 @@
 #include "RotateObjects.h"
 #include "Modules/ModuleManager.h"
 
+DEFINE_LOG_CATEGORY(LogLuminaCity);
+
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, RotateObjects, "RotateObjects" );
  
\ No newline at end of file
@@ -3,3 +3,9 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+// Stat group for the analysis code, use "stat LuminaCity" to inspect it
+DECLARE_STATS_GROUP(TEXT("LuminaCity"), STATGROUP_LuminaCity, STATCAT_Advanced);
+
+DECLARE_LOG_CATEGORY_EXTERN(LogLuminaCity, Log, All);
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class USceneComponent;
+
+/**
+ * Ordered set of selected items: O(1) add, remove and lookup, iteration in selection order.
+ *
+ * Items are kept in a dense array with a map from item to its slot. Removing leaves a tombstone (a default constructed
+ * item) in the slot, the array is compacted once tombstones outnumber the items, so a removal costs O(1) amortized
+ * and the order (which the gizmo placement depends on) never changes.
+ * A default constructed ElementType (nullptr for pointers) is never added.
+ */
+template<typename ElementType>
+class TSelectionSet
+{
+public:
+
+	// @return false if the item was already in the set (or is the tombstone value)
+	bool Add(const ElementType& Item)
+	{
+		if (IsTombstone(Item) || Slots.Contains(Item)) return false;
+
+		Slots.Add(Item, Entries.Add(Item));
+		return true;
+	}
+
+	// @return false if the item was not in the set
+	bool Remove(const ElementType& Item)
+	{
+		int32 Slot;
+		if (!Slots.RemoveAndCopyValue(Item, Slot)) return false;
+
+		Entries[Slot] = ElementType();
+
+		//the last item is gone, the next Add starts at slot 0 and Head has to see it
+		if (Slots.Num() == 0)
+		{
+			Reset();
+			return true;
+		}
+
+		//keep both ends on an item, so that First and Last stay O(1)
+		while (Entries.Num() > 0 && IsTombstone(Entries.Last()))
+			Entries.Pop(false);
+		while (Head < Entries.Num() && IsTombstone(Entries[Head]))
+			++Head;
+
+		if (Entries.Num() - Slots.Num() > FMath::Max(Slots.Num(), 16))
+			Compact();
+		return true;
+	}
+
+	bool Contains(const ElementType& Item) const { return Slots.Contains(Item); }
+
+	int32 Num() const { return Slots.Num(); }
+
+	void Reset()
+	{
+		Entries.Reset();
+		Slots.Reset();
+		Head = 0;
+	}
+
+	// First and last selected item, the tombstone value if the set is empty
+	ElementType First() const { return Head < Entries.Num() ? Entries[Head] : ElementType(); }
+	ElementType Last() const { return Entries.Num() > 0 ? Entries.Last() : ElementType(); }
+
+	// The items in selection order
+	TArray<ElementType> ToArray() const
+	{
+		TArray<ElementType> Items;
+		Items.Reserve(Slots.Num());
+		for (const ElementType& Item : *this)
+			Items.Add(Item);
+		return Items;
+	}
+
+	// Iterates the items in selection order, skipping tombstones
+	class FConstIterator
+	{
+	public:
+		FConstIterator(const TArray<ElementType>& InEntries, int32 InIndex) : Entries(InEntries), Index(InIndex) { SkipTombstones(); }
+
+		const ElementType& operator*() const { return Entries[Index]; }
+		FConstIterator& operator++() { ++Index; SkipTombstones(); return *this; }
+		bool operator!=(const FConstIterator& Other) const { return Index != Other.Index; }
+
+	private:
+		void SkipTombstones() { while (Index < Entries.Num() && IsTombstone(Entries[Index])) ++Index; }
+
+		const TArray<ElementType>& Entries;
+		int32 Index;
+	};
+
+	FConstIterator begin() const { return FConstIterator(Entries, Head); }
+	FConstIterator end() const { return FConstIterator(Entries, Entries.Num()); }
+
+private:
+
+	static bool IsTombstone(const ElementType& Item) { return Item == ElementType(); }
+
+	// Removes the tombstones and renumbers the slots
+	void Compact()
+	{
+		int32 Dense = 0;
+		for (int32 i = Head; i < Entries.Num(); ++i)
+		{
+			if (!IsTombstone(Entries[i]))
+			{
+				Entries[Dense] = Entries[i];
+				Slots[Entries[Dense]] = Dense;
+				++Dense;
+			}
+		}
+		Entries.SetNum(Dense, false);
+		Head = 0;
+	}
+
+	// Selection order, tombstones for removed items
+	TArray<ElementType> Entries;
+
+	// Slot of every item in Entries
+	TMap<ElementType, int32> Slots;
+
+	// Index of the first item in Entries, everything before it is a tombstone
+	int32 Head = 0;
+};
+
+// The selected components of the Transformer Tool
+using FSelectionSet = TSelectionSet<USceneComponent*>;
@@ -0,0 +1,125 @@
+#include "../Analysis/BuildingBVH.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace BuildingBVHTest
+{
+	static const int32 NumBuildings = 8;
+
+	// Distance between the buildings along X, in cm
+	static const double Spacing = 300.0;
+
+	// Component hit by a ray straight down through Location, nullptr if nothing is hit
+	static const UPrimitiveComponent* TraceDown(const FBuildingBVH& BVH, const FVector& Location, FBuildingHit* OutHit = nullptr)
+	{
+		FBuildingHit Hit;
+		if (!BVH.Raycast(Location + FVector(0.0, 0.0, 500.0), Location - FVector(0.0, 0.0, 500.0), Hit)) return nullptr;
+
+		if (OutHit)
+			*OutHit = Hit;
+		return Hit.Component.Get();
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FBuildingBVHRefitTest, "LuminaCity.BuildingBVH.Refit"
+	, EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FBuildingBVHRefitTest::RunTest(const FString& Parameters)
+{
+	using namespace BuildingBVHTest;
+
+	//the engine cube: 100 cm, pivot at its center
+	UStaticMesh* Cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	if (!TestNotNull(TEXT("Cube mesh"), Cube)) return false;
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	TArray<AStaticMeshActor*> Buildings;
+	for (int32 i = 0; i < NumBuildings; ++i)
+	{
+		AStaticMeshActor* Building = World->SpawnActor<AStaticMeshActor>(FVector(i * Spacing, 0.0, 0.0), FRotator::ZeroRotator);
+		Building->SetMobility(EComponentMobility::Movable);
+		Building->GetStaticMeshComponent()->SetStaticMesh(Cube);
+		Buildings.Add(Building);
+	}
+
+	FBuildingBVH BVH;
+	BVH.BuildFromWorld(World);
+	TestEqual(TEXT("Placements"), BVH.GetNumPlacements(), NumBuildings);
+	TestEqual(TEXT("Meshes"), BVH.GetNumMeshes(), 1);
+	TestEqual(TEXT("Nodes"), BVH.GetNumNodes(), 2 * NumBuildings - 1);
+
+	for (int32 i = 0; i < NumBuildings; ++i)
+	{
+		FBuildingHit Hit;
+		const FVector Location = Buildings[i]->GetActorLocation();
+		TestTrue(FString::Printf(TEXT("Building %d hit"), i), TraceDown(BVH, Location, &Hit) == Buildings[i]->GetStaticMeshComponent());
+		TestEqual(FString::Printf(TEXT("Building %d distance"), i), Hit.Distance, 450.f, 0.1f);
+		TestTrue(FString::Printf(TEXT("Building %d normal"), i), Hit.Normal.Z > 0.99);
+	}
+	TestNull(TEXT("Between buildings"), TraceDown(BVH, FVector(0.5 * Spacing, 0.0, 0.0)));
+
+	//a copy is a snapshot, the refit goes into the original only
+	const FBuildingBVH Snapshot = BVH;
+
+	UStaticMeshComponent* Moved = Buildings[3]->GetStaticMeshComponent();
+	const FVector OldLocation = Buildings[3]->GetActorLocation();
+	FVector NewLocation = OldLocation + FVector(0.0, 2000.0, 0.0);
+	Buildings[3]->SetActorLocation(NewLocation);
+	TestTrue(TEXT("Moved component updated"), BVH.UpdateComponent(Moved));
+	BVH.Refit();
+
+	TestNull(TEXT("Old location after refit"), TraceDown(BVH, OldLocation));
+	TestTrue(TEXT("New location after refit"), TraceDown(BVH, NewLocation) == Moved);
+	TestTrue(TEXT("Snapshot keeps the old location"), TraceDown(Snapshot, OldLocation) == Moved);
+	TestNull(TEXT("Snapshot without the new location"), TraceDown(Snapshot, NewLocation));
+
+	//far enough for the bounds to grow past RebuildAreaRatio, the subtree is rebuilt
+	NewLocation = OldLocation + FVector(0.0, 100000.0, 0.0);
+	Buildings[3]->SetActorLocation(NewLocation);
+	BVH.UpdateComponent(Moved);
+	BVH.Refit();
+	TestTrue(TEXT("New location after rebuild"), TraceDown(BVH, NewLocation) == Moved);
+	for (int32 i = 0; i < NumBuildings; ++i)
+	{
+		TestTrue(FString::Printf(TEXT("Building %d after rebuild"), i)
+			, TraceDown(BVH, Buildings[i]->GetActorLocation()) == Buildings[i]->GetStaticMeshComponent());
+	}
+
+	//shadow rays up from below the first 4 buildings, the 4th one moved away
+	FVector3f Origins[4];
+	FVector3f Directions[4];
+	for (int32 i = 0; i < 4; ++i)
+	{
+		Origins[i] = BVH.ToLocal(OldLocation + FVector((i - 3) * Spacing, 0.0, -200.0));
+		Directions[i] = FVector3f::UpVector;
+	}
+	FRayPacket4 Packet;
+	Packet.Set(Origins, Directions, 4, 1000.f);
+	TestEqual(TEXT("Occluded lanes"), BVH.Occluded4(Packet), 0x7);
+
+	//a removed building is skipped by both queries, the copy made before keeps it
+	const FBuildingBVH BeforeRemoval = BVH;
+	BVH.RemoveComponent(FObjectKey(Buildings[1]->GetStaticMeshComponent()));
+	BVH.Refit();
+	TestNull(TEXT("Removed building"), TraceDown(BVH, Buildings[1]->GetActorLocation()));
+	TestEqual(TEXT("Occluded lanes after removal"), BVH.Occluded4(Packet), 0x5);
+	TestEqual(TEXT("Occluded lanes before removal"), BeforeRemoval.Occluded4(Packet), 0x7);
+
+	//components that are not in the BVH are ignored
+	TestTrue(TEXT("Unknown component"), BVH.UpdateComponent(NewObject<UStaticMeshComponent>(Buildings[0])));
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
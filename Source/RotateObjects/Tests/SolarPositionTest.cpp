@@ -0,0 +1,121 @@
+#include "../Analysis/SolarPosition.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace SolarPositionTest
+{
+	// Angle between two directions in degrees, atan2 keeps it accurate for nearly equal ones
+	static double AngleBetween(const FVector& A, const FVector& B)
+	{
+		return FMath::RadiansToDegrees(FMath::Atan2(FVector::CrossProduct(A, B).Size(), FVector::DotProduct(A, B)));
+	}
+
+	// Highest elevation of a UTC day between 10:00 and 14:00, at longitude 0 that is solar noon
+	static double GetNoonElevation(int32 Year, int32 Month, int32 Day, double Latitude)
+	{
+		double Elevation = -90.0;
+		for (int32 Minute = 0; Minute < 240; ++Minute)
+		{
+			const FDateTime UTCTime = FDateTime(Year, Month, Day, 10) + FTimespan::FromMinutes(Minute);
+			Elevation = FMath::Max(Elevation, FSolarPosition::Compute(UTCTime, Latitude, 0.0).Elevation);
+		}
+		return Elevation;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSolarPositionTest, "LuminaCity.Solar.Position"
+	, EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FSolarPositionTest::RunTest(const FString& Parameters)
+{
+	//NREL SPA reference, the elevation without atmospheric refraction
+	const FSolarPosition Reference = FSolarPosition::Compute(FDateTime(2003, 10, 17, 19, 30, 30), 39.742476, -105.1786);
+	TestEqual(TEXT("NREL SPA azimuth"), Reference.Azimuth, 194.34019, 0.01);
+	TestEqual(TEXT("NREL SPA elevation"), Reference.Elevation, 39.872046, 0.01);
+	TestTrue(TEXT("NREL SPA above horizon"), Reference.IsAboveHorizon());
+
+	//at solar noon the elevation is 90 - latitude + declination, +-23.436 (the obliquity of 2024) at the solstices
+	TestEqual(TEXT("June solstice, 40N"), SolarPositionTest::GetNoonElevation(2024, 6, 20, 40.0), 73.436, 0.01);
+	TestEqual(TEXT("December solstice, 40N"), SolarPositionTest::GetNoonElevation(2024, 12, 21, 40.0), 26.564, 0.01);
+	TestEqual(TEXT("December solstice, 40S"), SolarPositionTest::GetNoonElevation(2024, 12, 21, -40.0), 73.436, 0.01);
+
+	//the equinox is at 12:44 UTC, the declination at noon is 0.014
+	TestEqual(TEXT("September equinox, 40N"), SolarPositionTest::GetNoonElevation(2024, 9, 22, 40.0), 50.0, 0.02);
+
+	//at midnight the sun is due north, 90 - latitude - declination below the horizon
+	const FSolarPosition Midnight = FSolarPosition::Compute(FDateTime(2024, 6, 20, 0), 40.0, 0.0);
+	TestFalse(TEXT("Midnight above horizon"), Midnight.IsAboveHorizon());
+	TestEqual(TEXT("Midnight elevation"), Midnight.Elevation, -26.564, 0.01);
+	TestEqual(TEXT("Midnight azimuth"), FMath::FindDeltaAngleDegrees(Midnight.Azimuth, 0.0), 0.0, 1.0);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSolarEphemerisTest, "LuminaCity.Solar.Ephemeris"
+	, EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FSolarEphemerisTest::RunTest(const FString& Parameters)
+{
+	struct FLocation
+	{
+		double Latitude;
+		double Longitude;
+		double UTCOffset;
+	};
+
+	//mid latitude, the sun through the zenith, and the midnight sun
+	const FLocation Locations[] = { { 39.742476, -105.1786, -7.0 }, { 1.35, 103.82, 8.0 }, { 69.65, 18.96, 1.0 } };
+	const int32 Year = 2024;
+
+	for (const FLocation& Location : Locations)
+	{
+		FSolarEphemeris Ephemeris;
+		Ephemeris.Build(Year, Location.Latitude, Location.Longitude, Location.UTCOffset);
+		if (!TestTrue(TEXT("Ephemeris built"), Ephemeris.IsValid())) return false;
+		TestEqual(TEXT("Days"), Ephemeris.GetNumDays(), 366);
+		TestTrue(TEXT("Matches"), Ephemeris.Matches(Year, Location.Latitude, Location.Longitude, Location.UTCOffset, 10));
+
+		//every minute of every third day, most of them between two samples
+		const FDateTime Start = FDateTime(Year, 1, 1) - FTimespan::FromHours(Location.UTCOffset);
+		double MaxError = 0.0;
+		for (int32 Day = 1; Day <= Ephemeris.GetNumDays(); Day += 3)
+		{
+			for (int32 Minute = 0; Minute <= 1440; ++Minute)
+			{
+				const FDateTime UTCTime = Start + FTimespan(Day - 1, 0, Minute, 0);
+				const FVector Expected(FSolarPosition::Compute(UTCTime, Location.Latitude, Location.Longitude).ToDirectionENU());
+				const FVector Interpolated(Ephemeris.GetDirectionENU(Day, Minute / 60.0));
+				MaxError = FMath::Max(MaxError, SolarPositionTest::AngleBetween(Interpolated, Expected));
+			}
+		}
+
+		//the bound FSolarEphemeris documents
+		TestTrue(FString::Printf(TEXT("Interpolation error %.4f below 0.05 degrees at latitude %.2f"), MaxError, Location.Latitude)
+			, MaxError < 0.05);
+	}
+
+	//7 minutes do not divide a day, the last step of a day is only 5 minutes long (1435 to 1440)
+	const FLocation& Location = Locations[0];
+	FSolarEphemeris Ephemeris;
+	Ephemeris.Build(Year, Location.Latitude, Location.Longitude, Location.UTCOffset, 7);
+
+	const FDateTime Start = FDateTime(Year, 1, 1) - FTimespan::FromHours(Location.UTCOffset);
+	double MaxError = 0.0;
+	for (int32 Day = 1; Day <= Ephemeris.GetNumDays(); Day += 30)
+	{
+		for (int32 Minute = 1400; Minute <= 1440; ++Minute)
+		{
+			const FDateTime UTCTime = Start + FTimespan(Day - 1, 0, Minute, 0);
+			const FVector Expected(FSolarPosition::Compute(UTCTime, Location.Latitude, Location.Longitude).ToDirectionENU());
+			const FVector Interpolated(Ephemeris.GetDirectionENU(Day, Minute / 60.0));
+			MaxError = FMath::Max(MaxError, SolarPositionTest::AngleBetween(Interpolated, Expected));
+		}
+	}
+	TestTrue(FString::Printf(TEXT("Interpolation error %.4f below 0.05 degrees before midnight with 7 minute steps"), MaxError)
+		, MaxError < 0.05);
+
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
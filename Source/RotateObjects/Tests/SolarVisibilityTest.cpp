@@ -0,0 +1,148 @@
+#include "../Analysis/SceneBVH.h"
+#include "../Analysis/SolarVisibility.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace SolarVisibilityTest
+{
+	// Half the side of the square roof and its height above the points, in cm
+	static const float RoofHalfSize = 200.f;
+	static const float RoofHeight = 100.f;
+
+	// A horizontal square roof centered above the origin, two triangles
+	static void BuildRoof(FSceneBVH& BVH)
+	{
+		const float S = RoofHalfSize;
+		const float H = RoofHeight;
+		TArray<FVector3f> Vertices = {
+			FVector3f(-S, -S, H), FVector3f(S, -S, H), FVector3f(S, S, H),
+			FVector3f(-S, -S, H), FVector3f(S, S, H), FVector3f(-S, S, H),
+		};
+		BVH.Build(MoveTemp(Vertices), FVector::ZeroVector);
+	}
+
+	// Towards the sun at Elevation degrees above the horizon, in the +X direction
+	static FVector3f SunAt(float Elevation)
+	{
+		const float Radians = FMath::DegreesToRadians(Elevation);
+		return FVector3f(FMath::Cos(Radians), 0.f, FMath::Sin(Radians));
+	}
+
+	// View factor from a point to a parallel A x B rectangle (in multiples of its height) with a corner above the point
+	static double RectangleViewFactor(double A, double B)
+	{
+		const double RootA = FMath::Sqrt(1.0 + A * A);
+		const double RootB = FMath::Sqrt(1.0 + B * B);
+		return (A / RootA * FMath::Atan(B / RootA) + B / RootB * FMath::Atan(A / RootB)) / (2.0 * DOUBLE_PI);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSceneBVHRaycastTest, "LuminaCity.SolarVisibility.SceneBVH"
+	, EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FSceneBVHRaycastTest::RunTest(const FString& Parameters)
+{
+	FSceneBVH BVH;
+	SolarVisibilityTest::BuildRoof(BVH);
+	TestEqual(TEXT("Triangles"), BVH.GetNumTriangles(), 2);
+
+	float Distance = 0.f;
+	FVector3f Normal;
+	if (TestTrue(TEXT("Roof hit from below"), BVH.Raycast(FVector3f::ZeroVector, FVector3f::UpVector, 1000.f, Distance, Normal)))
+	{
+		TestEqual(TEXT("Hit distance"), Distance, SolarVisibilityTest::RoofHeight, 0.01f);
+		TestTrue(TEXT("Normal faces the ray"), Normal.Z < 0.f);
+	}
+
+	TestFalse(TEXT("Roof beyond TMax"), BVH.Occluded(FVector3f::ZeroVector, FVector3f::UpVector, 50.f));
+	TestFalse(TEXT("Beside the roof"), BVH.Occluded(FVector3f(300.f, 0.f, 0.f), FVector3f::UpVector, 1000.f));
+	TestTrue(TEXT("Roof from above"), BVH.Occluded(FVector3f(0.f, 0.f, 200.f), -FVector3f::UpVector, 1000.f));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSolarVisibilityEvaluateTest, "LuminaCity.SolarVisibility.Evaluate"
+	, EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FSolarVisibilityEvaluateTest::RunTest(const FString& Parameters)
+{
+	FSceneBVH Roof;
+	SolarVisibilityTest::BuildRoof(Roof);
+	const FSceneBVH Empty;
+
+	FSkyDome Sky;
+	Sky.Build(16);
+	const FSolarVisibility::FSettings Settings;
+
+	//7 points, so the last packet is not full. Under the roof for |X| < 200
+	const TArray<FVector3f> Points = {
+		FVector3f(-300.f, 0.f, 0.f), FVector3f(-150.f, 0.f, 0.f), FVector3f(-50.f, 0.f, 0.f), FVector3f(0.f, 0.f, 0.f),
+		FVector3f(50.f, 0.f, 0.f), FVector3f(150.f, 0.f, 0.f), FVector3f(300.f, 0.f, 0.f),
+	};
+	TArray<uint8> SunVisible;
+	TArray<float> SkyFactor;
+	SunVisible.SetNumZeroed(Points.Num());
+	SkyFactor.SetNumZeroed(Points.Num());
+
+	//sun at the zenith
+	FSolarVisibility::Evaluate(Roof, Points, FVector3f::UpVector, FVector3f::UpVector, Sky, Settings, SunVisible, SkyFactor);
+	for (int32 i = 0; i < Points.Num(); ++i)
+	{
+		const bool bUnderRoof = FMath::Abs(Points[i].X) < SolarVisibilityTest::RoofHalfSize;
+		TestTrue(FString::Printf(TEXT("Zenith sun at X %.0f"), Points[i].X), (SunVisible[i] != 0) == !bUnderRoof);
+	}
+
+	//the sky seen from below the center of the roof, against the view factor of the roof (the rays start NormalBias above the point)
+	const double A = SolarVisibilityTest::RoofHalfSize / (SolarVisibilityTest::RoofHeight - Settings.NormalBias);
+	const double ExpectedSky = 1.0 - 4.0 * SolarVisibilityTest::RectangleViewFactor(A, A);
+	TestEqual(TEXT("Sky factor below the roof"), SkyFactor[3], float(ExpectedSky), 0.01f);
+
+	//a low sun passes below the roof edge, a high one does not
+	FSolarVisibility::Evaluate(Roof, Points, FVector3f::UpVector, SolarVisibilityTest::SunAt(10.f), Sky, Settings, SunVisible, SkyFactor);
+	TestTrue(TEXT("Low sun below the roof"), SunVisible[3] != 0);
+	FSolarVisibility::Evaluate(Roof, Points, FVector3f::UpVector, SolarVisibilityTest::SunAt(45.f), Sky, Settings, SunVisible, SkyFactor);
+	TestFalse(TEXT("High sun below the roof"), SunVisible[3] != 0);
+
+	//behind the plane of the points, and no sun at all
+	FSolarVisibility::Evaluate(Empty, Points, FVector3f::UpVector, FVector3f(1.f, 0.f, -0.1f).GetSafeNormal(), Sky, Settings, SunVisible, SkyFactor);
+	TestFalse(TEXT("Sun below the horizon"), SunVisible[0] != 0);
+	FSolarVisibility::Evaluate(Empty, Points, FVector3f::UpVector, FVector3f::ZeroVector, Sky, Settings, SunVisible, SkyFactor);
+	TestFalse(TEXT("No sun"), SunVisible[0] != 0);
+
+	//unobstructed: the whole sky for a horizontal point, half of it for a vertical one
+	TestEqual(TEXT("Open sky, horizontal"), SkyFactor[0], 1.f, 0.01f);
+	FSolarVisibility::Evaluate(Empty, Points, FVector3f(1.f, 0.f, 0.f), FVector3f::ZeroVector, Sky, Settings, SunVisible, SkyFactor);
+	TestEqual(TEXT("Open sky, vertical"), SkyFactor[0], 0.5f, 0.01f);
+
+	FSkyDome Tregenza;
+	Tregenza.BuildTregenza();
+	TestEqual(TEXT("Tregenza patches"), Tregenza.Num(), 145);
+	FSolarVisibility::Evaluate(Empty, Points, FVector3f::UpVector, FVector3f::ZeroVector, Tregenza, Settings, SunVisible, SkyFactor);
+	TestEqual(TEXT("Open Tregenza sky, horizontal"), SkyFactor[0], 1.f, 0.01f);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSolarVisibilityAccumulateTest, "LuminaCity.SolarVisibility.AccumulateSun"
+	, EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FSolarVisibilityAccumulateTest::RunTest(const FString& Parameters)
+{
+	FSceneBVH Roof;
+	SolarVisibilityTest::BuildRoof(Roof);
+
+	//below the center of the roof and beside it
+	const TArray<FVector3f> Points = { FVector3f::ZeroVector, FVector3f(300.f, 0.f, 0.f) };
+	const TArray<FVector3f> SunDirections = { FVector3f::UpVector, SolarVisibilityTest::SunAt(10.f), FVector3f(1.f, 0.f, -0.1f).GetSafeNormal() };
+	const TArray<float> Weights = { 1.f, 2.f, 4.f };
+
+	TArray<float> Accumulated = { 10.f, 10.f };
+	FSolarVisibility::AccumulateSun(Roof, Points, FVector3f::UpVector, SunDirections, Weights, FSolarVisibility::FSettings(), Accumulated);
+
+	//the zenith is behind the roof for the first point, the last direction is below the plane for both
+	TestEqual(TEXT("Below the roof"), Accumulated[0], 12.f);
+	TestEqual(TEXT("Beside the roof"), Accumulated[1], 13.f);
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
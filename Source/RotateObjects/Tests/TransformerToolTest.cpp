@@ -0,0 +1,159 @@
+#include "../TransformerTool.h"
+#include "../BuildingInstanceManager.h"
+#include "../Gizmos/TranslationGizmo.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "Misc/AutomationTest.h"
+#include "UObject/UnrealType.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTransformerToolFilterHitsTest, "LuminaCity.TransformerTool.FilterHits"
+	, EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FTransformerToolFilterHitsTest::RunTest(const FString& Parameters)
+{
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	AStaticMeshActor* Replicated = World->SpawnActor<AStaticMeshActor>();
+	AStaticMeshActor* NotReplicated = World->SpawnActor<AStaticMeshActor>();
+	ATranslationGizmo* Gizmo = World->SpawnActor<ATranslationGizmo>();
+	Replicated->SetReplicates(true);
+	Replicated->bNetStartup = true;
+	UStaticMeshComponent* ReplicatedComponent = Replicated->GetStaticMeshComponent();
+	UStaticMeshComponent* NotReplicatedComponent = NewObject<UStaticMeshComponent>(Replicated);
+	UStaticMeshComponent* ComponentOfNotReplicated = NotReplicated->GetStaticMeshComponent();
+
+	//bIgnoreNonReplicatedObjects is only set in the details of the tool, as here through its property
+	UTransformerTool* Tool = NewObject<UTransformerTool>(World);
+	FBoolProperty* IgnoreProperty = FindFProperty<FBoolProperty>(UTransformerTool::StaticClass(), TEXT("bIgnoreNonReplicatedObjects"));
+	if (!TestNotNull(TEXT("bIgnoreNonReplicatedObjects property"), IgnoreProperty)) return false;
+	IgnoreProperty->SetPropertyValue_InContainer(Tool, true);
+
+	const TArray<FHitResult> Hits = {
+		FHitResult(Replicated, NotReplicatedComponent, FVector::ZeroVector, FVector::UpVector),
+		FHitResult(Gizmo, nullptr, FVector::ZeroVector, FVector::UpVector),
+		FHitResult(NotReplicated, ComponentOfNotReplicated, FVector::ZeroVector, FVector::UpVector),
+		FHitResult(),
+		FHitResult(Replicated, ReplicatedComponent, FVector::ZeroVector, FVector::UpVector),
+	};
+
+	//whether a spawned object supports networking depends on how the engine names it, the expected hits are asked to the engine
+	const bool bReplicatedSupported = Replicated->IsSupportedForNetworking();
+	const bool bNotReplicatedSupported = NotReplicated->IsSupportedForNetworking();
+
+	//indices into Hits of the hits that have to survive, in order
+	auto TestFiltered = [this, Tool, &Hits](const TCHAR* What, const TArray<int32>& Expected)
+	{
+		TArray<FHitResult> Filtered = Hits;
+		Tool->FilterHits(Filtered);
+		if (!TestEqual(FString::Printf(TEXT("%s: hits left"), What), Filtered.Num(), Expected.Num())) return;
+
+		for (int32 i = 0; i < Expected.Num(); ++i)
+		{
+			const FHitResult& Hit = Hits[Expected[i]];
+			TestTrue(FString::Printf(TEXT("%s: hit %d"), What, i)
+				, Filtered[i].GetActor() == Hit.GetActor() && Filtered[i].GetComponent() == Hit.GetComponent());
+		}
+	};
+
+	//the Gizmo is always kept and an empty hit never is
+	auto ExpectedHits = [&](bool bComponentBased)
+	{
+		TArray<int32> Expected;
+		for (int32 i = 0; i < Hits.Num(); ++i)
+		{
+			const AActor* Actor = Hits[i].GetActor();
+			const bool bActorSupported = Actor == Replicated ? bReplicatedSupported : Actor == NotReplicated && bNotReplicatedSupported;
+			const UPrimitiveComponent* Component = Hits[i].GetComponent();
+			if (Actor == Gizmo || (bActorSupported && (!bComponentBased || (Component && Component->IsSupportedForNetworking()))))
+				Expected.Add(i);
+		}
+		return Expected;
+	};
+
+	//actors: only whether the actor replicates counts
+	Tool->SetComponentBased(false);
+	TestFiltered(TEXT("Actor based"), ExpectedHits(false));
+
+	//components: the owner and the component have to replicate
+	Tool->SetComponentBased(true);
+	TestFiltered(TEXT("Component based"), ExpectedHits(true));
+
+	//the cache answers until it is cleared, even if the component replicates since. Components of an actor
+	//that does not support networking are never queried
+	if (!bReplicatedSupported)
+	{
+		AddInfo(TEXT("The spawned actor does not support networking in this world, the replication cache is not tested"));
+	}
+	else if (!NotReplicatedComponent->IsSupportedForNetworking())
+	{
+		NotReplicatedComponent->SetIsReplicated(true);
+		TestTrue(TEXT("Replicated component supports networking"), NotReplicatedComponent->IsSupportedForNetworking());
+		TestFiltered(TEXT("Cached"), ExpectedHits(true).FilterByPredicate([](int32 i) { return i != 0; }));
+
+		Tool->ClearReplicationCache();
+		TestFiltered(TEXT("Cache cleared"), ExpectedHits(true));
+	}
+
+	IgnoreProperty->SetPropertyValue_InContainer(Tool, false);
+	TestFiltered(TEXT("Not ignoring"), { 0, 1, 2, 3, 4 });
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTransformerToolDragInstancesTest, "LuminaCity.TransformerTool.DragInstances"
+	, EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FTransformerToolDragInstancesTest::RunTest(const FString& Parameters)
+{
+	UStaticMesh* Cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	if (!TestNotNull(TEXT("Cube mesh"), Cube)) return false;
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	//three buildings 500 cm apart, the first and the last are dragged
+	ABuildingInstanceManager* Manager = World->SpawnActor<ABuildingInstanceManager>();
+	TArray<FBuildingInstance> Instances;
+	for (int32 i = 0; i < 3; ++i)
+		Instances.Add(Manager->AddBuilding(Cube, FTransform(FVector(i * 500.0, 0.0, 0.0))));
+	TestEqual(TEXT("Buildings placed"), Manager->GetNumBuildings(), 3);
+
+	UTransformerTool* Tool = NewObject<UTransformerTool>(World);
+	Tool->SetTransformationType(ETransformationType::TT_Translation);
+	Tool->SelectMultipleInstances({ Instances[0], Instances[2] });
+	TestEqual(TEXT("Instances selected"), Tool->GetSelectedInstances().Num(), 2);
+
+	//two frames of a drag along X
+	const FTransform Delta(FVector(100.0, 0.0, 0.0));
+	Tool->ApplyDeltaTransform(Delta);
+	Tool->ApplyDeltaTransform(Delta);
+
+	const double Expected[] = { 200.0, 500.0, 1200.0 };
+	for (int32 i = 0; i < 3; ++i)
+	{
+		FTransform Transform;
+		if (TestTrue(FString::Printf(TEXT("Instance %d valid"), i), Instances[i].GetTransform(Transform)))
+			TestEqual(FString::Printf(TEXT("Instance %d location"), i), Transform.GetLocation(), FVector(Expected[i], 0.0, 0.0));
+	}
+
+	Tool->DeselectAll();
+	TestEqual(TEXT("Instances deselected"), Tool->GetSelectedInstances().Num(), 0);
+	TestEqual(TEXT("Buildings kept"), Manager->GetNumBuildings(), 3);
+
+	Tool->DestroyPooledGizmos();
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
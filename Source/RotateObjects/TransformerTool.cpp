@@ -23,9 +23,15 @@ SOFTWARE.
 */
 
 #include "TransformerTool.h"
+#include "RotateObjects.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
 #include "Components/PrimitiveComponent.h"
+#include "Engine/StaticMeshActor.h"
 #include "Engine/World.h"
 #include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
 
 #include "Net/UnrealNetwork.h"
 #include "Kismet/GameplayStatics.h"
@@ -36,8 +42,34 @@ SOFTWARE.
 #include "Gizmos/RotationGizmo.h"
 #include "Gizmos/ScaleGizmo.h"
 
+/* Analysis */
+#include "Analysis/BuildingBVHSubsystem.h"
+#include "Analysis/SceneChangeTracker.h"
+
 #define LOCTEXT_NAMESPACE "FRuntimeTransformerModule"
 
+DECLARE_CYCLE_STAT(TEXT("Gizmo Placement Update"), STAT_GizmoPlacementUpdate, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Gizmo Placement Updates"), STAT_GizmoPlacementUpdates, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Gizmo Switch"), STAT_GizmoSwitch, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Gizmos Spawned"), STAT_GizmosSpawned, STATGROUP_LuminaCity);
+DECLARE_CYCLE_STAT(TEXT("Apply Delta Transform"), STAT_ApplyDeltaTransform, STATGROUP_LuminaCity);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Components Transformed"), STAT_ComponentsTransformed, STATGROUP_LuminaCity);
+
+namespace TransformerTool
+{
+	// Selections smaller than this compute their new transforms on the game thread, a ParallelFor would cost more than it saves
+	static const int32 MinParallelComponents = 512;
+
+	// Components handled by one task of a ParallelFor
+	static const int32 ComponentsPerTask = 256;
+
+	// Gizmo placement updates run by every tool so far, read by LuminaCity.SelectionBenchmark
+	static uint32 NumPlacementUpdates = 0;
+
+	// The replication cache is not pruned below this size, every object traced in a session usually fits
+	static const int32 MinNetworkSupportCachePrune = 1024;
+}
+
 DEFINE_LOG_CATEGORY(LogRuntimeTransformer);
 
 #undef LOCTEXT_NAMESPACE
@@ -61,6 +93,7 @@ UTransformerTool::UTransformerTool()
 
 	bResyncSelection = false;
 	bIgnoreNonReplicatedObjects = false;
+	NetworkSupportCachePruneSize = TransformerTool::MinNetworkSupportCachePrune;
 
 	ResetDeltaTransform(AccumulatedDeltaTransform);
 	ResetDeltaTransform(NetworkDeltaTransform);
@@ -73,6 +106,9 @@ UTransformerTool::UTransformerTool()
 	bForceMobility = false;
 	bToggleSelectedInMultiSelection = true;
 	bComponentBased = false;
+
+	GizmoUpdateBatchDepth = 0;
+	bGizmoUpdatePending = false;
 }
 
 void UTransformerTool::GetLifetimeReplicatedProps(
@@ -83,11 +119,34 @@ void UTransformerTool::GetLifetimeReplicatedProps(
 }
 
 
+void UTransformerTool::BeginDestroy()
+{
+	//actors cannot be destroyed during garbage collection, the Gizmos go on the next Game Thread task
+	TArray<TWeakObjectPtr<ABaseGizmo>> pooledGizmos;
+	GizmoPool.GenerateValueArray(pooledGizmos);
+	GizmoPool.Reset();
+	Gizmo.Reset();
+	if (pooledGizmos.Num() > 0)
+	{
+		AsyncTask(ENamedThreads::GameThread, [pooledGizmos]()
+		{
+			for (const TWeakObjectPtr<ABaseGizmo>& pooledGizmo : pooledGizmos)
+			{
+				if (pooledGizmo.IsValid())
+					pooledGizmo->Destroy();
+			}
+		});
+	}
+
+	Super::BeginDestroy();
+}
+
 void UTransformerTool::SetTransform(USceneComponent* Component, const FTransform& Transform)
 {
 	if (!Component) return;
 
-    Component->SetWorldTransform(Transform);
+	//teleport: the physics bodies are placed at the new transform, no velocity is derived from the jump
+	Component->SetWorldTransform(Transform, false, nullptr, ETeleportType::TeleportPhysics);
 
 }
 
@@ -96,29 +155,52 @@ void UTransformerTool::FilterHits(TArray<FHitResult>& outHits)
 	//eliminate all outHits that have non-replicated objects
 	if (bIgnoreNonReplicatedObjects)
 	{
-		TArray<FHitResult> checkHits = outHits;
-		for (int32 i = 0; i < checkHits.Num(); ++i)
+		//RemoveAll compacts in a single pass without allocating, and keeps the hits in order (the first hit is selected)
+		outHits.RemoveAll([this](const FHitResult& hit)
 		{
+			AActor* actor = hit.GetActor();
+
 			//don't remove Gizmos! They do not replicate by default 
-			if (Cast<ABaseGizmo>(checkHits[i].GetActor()))
-				continue;
+			if (Cast<ABaseGizmo>(actor))
+				return false;
 
-			
-			if (checkHits[i].GetActor()->IsSupportedForNetworking())
+			if (actor && IsSupportedForNetworkingCached(actor))
 			{
-				if (bComponentBased)
-				{
-					if (checkHits[i].Component->IsSupportedForNetworking())
-						continue; //components - actor owner + themselves need to replicate
-				}
-				else
-					continue; //actors only consider whether they replicate
+				//components - actor owner + themselves need to replicate
+				//actors only consider whether they replicate
+				return bComponentBased && !IsSupportedForNetworkingCached(hit.GetComponent());
 			}
-			/*RTT_LOG(Warning, "Removing (Actor: %s   ComponentHit:  %s) from hits because it is not supported for networking."
-				, *checkHits[i].GetActor->GetName(), *checkHits[i].Component->GetName());*/
-			outHits.RemoveAt(i);
+			return true;
+		});
+	}
+}
+
+bool UTransformerTool::IsSupportedForNetworkingCached(const UObject* Object)
+{
+	if (!Object) return false;
+
+	if (const bool* bSupported = NetworkSupportCache.Find(Object))
+		return *bSupported;
+
+	//objects destroyed since they were traced (e.g. with their level) are dropped once the cache grew,
+	//the next prune waits until it doubled again so a cache of live objects is not walked on every trace
+	if (NetworkSupportCache.Num() >= NetworkSupportCachePruneSize)
+	{
+		for (auto it = NetworkSupportCache.CreateIterator(); it; ++it)
+		{
+			if (!it.Key().IsValid())
+				it.RemoveCurrent();
 		}
+		NetworkSupportCachePruneSize = FMath::Max(TransformerTool::MinNetworkSupportCachePrune, NetworkSupportCache.Num() * 2);
 	}
+
+	return NetworkSupportCache.Add(Object, Object->IsSupportedForNetworking());
+}
+
+void UTransformerTool::ClearReplicationCache()
+{
+	NetworkSupportCache.Reset();
+	NetworkSupportCachePruneSize = TransformerTool::MinNetworkSupportCachePrune;
 }
 
 void UTransformerTool::SetSpaceType(ESpaceType Type)
@@ -126,13 +208,7 @@ void UTransformerTool::SetSpaceType(ESpaceType Type)
 	CurrentSpaceType = Type;
 	SetGizmo();
 
-    // added by Talad
-    if (Gizmo.IsValid() && playerController)
-    {
-        Gizmo->ScaleGizmoScene(playerController->PlayerCameraManager->GetCameraLocation()
-            , playerController->PlayerCameraManager->GetActorForwardVector()
-            , playerController->PlayerCameraManager->GetFOVAngle());
-    }
+	ScaleGizmoToCamera();
 }
 
 ETransformationDomain UTransformerTool::GetCurrentDomain(bool& TransformInProgress) const
@@ -166,7 +242,7 @@ bool UTransformerTool::GetMouseStartEndPoints(float TraceDistance, FVector& outS
 UClass* UTransformerTool::GetGizmoClass(ETransformationType TransformationType) const /* private */
 {
 	//Assign correct Gizmo Class depending on given Transformation
-	switch (CurrentTransformation)
+	switch (TransformationType)
 	{
 	case ETransformationType::TT_Translation:	return TranslationGizmoClass;
 	case ETransformationType::TT_Rotation:		return RotationGizmoClass;
@@ -248,6 +324,9 @@ bool UTransformerTool::TraceByObjectTypes(const FVector& StartLocation
 	, TArray<AActor*> IgnoredActors
 	, bool bAppendToList)
 {
+	if (TraceGizmo(StartLocation, EndLocation))
+		return true;
+
 	if (UWorld* world = GetWorld())
 	{
 		FCollisionObjectQueryParams CollisionObjectQueryParams;
@@ -258,9 +337,21 @@ bool UTransformerTool::TraceByObjectTypes(const FVector& StartLocation
 			CollisionObjectQueryParams.AddObjectTypesToQuery(cc);
 
 		CollisionQueryParams.AddIgnoredActors(IgnoredActors);
+		CollisionQueryParams.AddIgnoredActor(Gizmo.Get());
 
+		//only the first hit is selected, unless filtering might remove it
 		TArray<FHitResult> OutHits;
-		if (world->LineTraceMultiByObjectType(OutHits, StartLocation, EndLocation
+		if (!bIgnoreNonReplicatedObjects)
+		{
+			FHitResult hitResult;
+			if (world->LineTraceSingleByObjectType(hitResult, StartLocation, EndLocation
+				, CollisionObjectQueryParams, CollisionQueryParams))
+			{
+				OutHits.Add(hitResult);
+				return HandleTracedObjects(OutHits, bAppendToList);
+			}
+		}
+		else if (world->LineTraceMultiByObjectType(OutHits, StartLocation, EndLocation
 			, CollisionObjectQueryParams, CollisionQueryParams))
 		{
 			FilterHits(OutHits);
@@ -276,13 +367,28 @@ bool UTransformerTool::TraceByChannel(const FVector& StartLocation
 	, TArray<AActor*> IgnoredActors
 	, bool bAppendToList)
 {
+	if (TraceGizmo(StartLocation, EndLocation))
+		return true;
+
 	if (UWorld* world = GetWorld())
 	{
 		FCollisionQueryParams CollisionQueryParams;
 		CollisionQueryParams.AddIgnoredActors(IgnoredActors);
+		CollisionQueryParams.AddIgnoredActor(Gizmo.Get());
 
+		//only the first hit is selected, unless filtering might remove it
 		TArray<FHitResult> OutHits;
-		if (world->LineTraceMultiByChannel(OutHits, StartLocation, EndLocation
+		if (!bIgnoreNonReplicatedObjects)
+		{
+			FHitResult hitResult;
+			if (world->LineTraceSingleByChannel(hitResult, StartLocation, EndLocation
+				, TraceChannel, CollisionQueryParams))
+			{
+				OutHits.Add(hitResult);
+				return HandleTracedObjects(OutHits, bAppendToList);
+			}
+		}
+		else if (world->LineTraceMultiByChannel(OutHits, StartLocation, EndLocation
 			, TraceChannel, CollisionQueryParams))
 		{
 			FilterHits(OutHits);
@@ -297,13 +403,28 @@ bool UTransformerTool::TraceByProfile(const FVector& StartLocation
 	, const FName& ProfileName, TArray<AActor*> IgnoredActors
 	, bool bAppendToList)
 {
+	if (TraceGizmo(StartLocation, EndLocation))
+		return true;
+
 	if (UWorld* world = GetWorld())
 	{
 		FCollisionQueryParams CollisionQueryParams;
 		CollisionQueryParams.AddIgnoredActors(IgnoredActors);
+		CollisionQueryParams.AddIgnoredActor(Gizmo.Get());
 
+		//only the first hit is selected, unless filtering might remove it
 		TArray<FHitResult> OutHits;
-		if (world->LineTraceMultiByProfile(OutHits, StartLocation, EndLocation
+		if (!bIgnoreNonReplicatedObjects)
+		{
+			FHitResult hitResult;
+			if (world->LineTraceSingleByProfile(hitResult, StartLocation, EndLocation
+				, ProfileName, CollisionQueryParams))
+			{
+				OutHits.Add(hitResult);
+				return HandleTracedObjects(OutHits, bAppendToList);
+			}
+		}
+		else if (world->LineTraceMultiByProfile(OutHits, StartLocation, EndLocation
 			, ProfileName, CollisionQueryParams))
 		{
 			FilterHits(OutHits);
@@ -313,6 +434,44 @@ bool UTransformerTool::TraceByProfile(const FVector& StartLocation
 	return false;
 }
 
+bool UTransformerTool::MouseTraceBuildings(float TraceDistance
+	, TArray<AActor*> IgnoredActors
+	, bool bAppendToList)
+{
+	FVector start, end;
+	bool bTraceSuccessful = false;
+	if (GetMouseStartEndPoints(TraceDistance, start, end))
+	{
+		bTraceSuccessful = TraceBuildings(start, end, IgnoredActors, bAppendToList);
+		if (!bTraceSuccessful && !bAppendToList)
+		    DeselectAll(false);
+	}
+	return bTraceSuccessful;
+}
+
+bool UTransformerTool::TraceBuildings(const FVector& StartLocation
+	, const FVector& EndLocation
+	, TArray<AActor*> IgnoredActors
+	, bool bAppendToList)
+{
+	UWorld* world = GetWorld();
+	UBuildingBVHSubsystem* buildings = world ? world->GetSubsystem<UBuildingBVHSubsystem>() : nullptr;
+	if (!buildings) return false;
+
+	//the Gizmo is not a building
+	if (TraceGizmo(StartLocation, EndLocation))
+		return true;
+
+	FHitResult hitResult;
+	if (!buildings->LineTrace(StartLocation, EndLocation, hitResult, IgnoredActors))
+		return false;
+
+	TArray<FHitResult> OutHits;
+	OutHits.Add(hitResult);
+	FilterHits(OutHits);
+	return HandleTracedObjects(OutHits, bAppendToList);
+}
+
 #include "Kismet/GameplayStatics.h"
 
 // was inside Tick()
@@ -340,17 +499,9 @@ void UTransformerTool::MoveGizmoAction()
     }
 
     //Only consider Local View
-    if (playerController)
-    {
-        if (playerController->PlayerCameraManager)
-        {
-            Gizmo->ScaleGizmoScene(playerController->PlayerCameraManager->GetCameraLocation()
-                , playerController->PlayerCameraManager->GetActorForwardVector()
-                , playerController->PlayerCameraManager->GetFOVAngle());
-        }
-    }
+    ScaleGizmoToCamera();
 
-    Gizmo->UpdateGizmoSpace(CurrentSpaceType); //ToDo: change when this is called to improve performance when a gizmo is there without doing anything
+    Gizmo->UpdateGizmoSpace(CurrentSpaceType); //does nothing unless the space or the parent rotation changed
 }
 
 
@@ -386,52 +537,175 @@ FTransform UTransformerTool::UpdateTransform(const FVector& LookingVector
 
 void UTransformerTool::ApplyDeltaTransform(const FTransform& DeltaTransform)
 {
+	SCOPE_CYCLE_COUNTER(STAT_ApplyDeltaTransform);
+
+	if (!Gizmo.IsValid()) return;
+
 	bool* snappingEnabled = SnappingEnabled.Find(CurrentTransformation);
 	float* snappingValue = SnappingValues.Find(CurrentTransformation);
 
-	for (auto& sc : SelectedComponents)
+	UWorld* world = GetWorld();
+	USceneChangeTracker* changeTracker = world ? world->GetSubsystem<USceneChangeTracker>() : nullptr;
+
+	/* GATHER the transforms of every Component that can move */
+	DeltaBatch.Reset();
+	for (USceneComponent* sc : SelectedComponents)
 	{
 		if (!sc) continue;
-		if (bForceMobility || sc->Mobility == EComponentMobility::Type::Movable)
+		if (!bForceMobility && sc->Mobility != EComponentMobility::Type::Movable)
 		{
-			const FTransform& componentTransform = sc->GetComponentTransform();
+			RTT_LOG(Warning, "Transform will not affect Component [%s] as it is NOT Moveable!", *sc->GetName());
+			continue;
+		}
 
-			FQuat deltaRotation = DeltaTransform.GetRotation();
+		const FTransform& componentTransform = sc->GetComponentTransform();
+		DeltaBatch.Components.Add(sc);
+		DeltaBatch.Rotations.Add(componentTransform.GetRotation());
+		DeltaBatch.Locations.Add(componentTransform.GetLocation());
+		DeltaBatch.Scales.Add(componentTransform.GetScale3D());
 
-			FVector deltaLocation = componentTransform.GetLocation()
-				- Gizmo->GetActorLocation();
+		//the tracker keeps the bounds before the first move, for the sensors the move could shade or unshade
+		if (changeTracker)
+			changeTracker->NotifyMoving(sc);
+	}
 
-			//DeltaScale is Unrotated Scale to Get Local Scale since World Scale is not supported
-			FVector deltaScale = componentTransform.GetRotation()
-				.UnrotateVector(DeltaTransform.GetScale3D());
+	//the components of a Building Instance Manager are always movable
+	for (const FBuildingInstance& instance : SelectedInstances)
+	{
+		FTransform instanceTransform;
+		if (!instance.GetTransform(instanceTransform)) continue; //removed since it was selected
 
+		DeltaBatch.Instances.Add(instance);
+		DeltaBatch.Rotations.Add(instanceTransform.GetRotation());
+		DeltaBatch.Locations.Add(instanceTransform.GetLocation());
+		DeltaBatch.Scales.Add(instanceTransform.GetScale3D());
 
-			if (false == bRotateOnLocalAxis)
-				deltaLocation = deltaRotation.RotateVector(deltaLocation);
+		if (changeTracker)
+			changeTracker->NotifyInstanceMoving(instance.Component, instance.Index);
+	}
 
-			FTransform newTransform(
-				deltaRotation * componentTransform.GetRotation(),
-				//adding Gizmo Location + prevDeltaLocation 
-				// (i.e. location from Gizmo to Object after optional Rotating)
-				// + deltaTransform Location Offset
-				deltaLocation + Gizmo->GetActorLocation() + DeltaTransform.GetLocation(),
-				deltaScale + componentTransform.GetScale3D());
+	const int32 numComponents = DeltaBatch.Components.Num();
+	const int32 numRows = DeltaBatch.Num();
+	if (numRows == 0) return;
+	INC_DWORD_STAT_BY(STAT_ComponentsTransformed, numRows);
 
+	/* COMPUTE the new transforms in place */
+	const FQuat deltaRotation = DeltaTransform.GetRotation();
+	const FVector deltaLocation = DeltaTransform.GetLocation();
+	const FVector deltaScale = DeltaTransform.GetScale3D();
+	const FVector gizmoLocation = Gizmo->GetActorLocation();
+	const bool bRotateAroundGizmo = !bRotateOnLocalAxis;
 
-			/* SNAPPING LOGIC PER COMPONENT */
-			if (snappingEnabled && *snappingEnabled && snappingValue)
-				newTransform = Gizmo->GetSnappedTransformPerComponent(componentTransform
-					, newTransform, CurrentDomain, *snappingValue);
+	FQuat* rotations = DeltaBatch.Rotations.GetData();
+	FVector* locations = DeltaBatch.Locations.GetData();
+	FVector* scales = DeltaBatch.Scales.GetData();
 
-			sc->SetMobility(EComponentMobility::Type::Movable);
-			SetTransform(sc, newTransform);
+	auto computeTransforms = [&](int32 begin, int32 end)
+	{
+		const VectorRegister4Double deltaRotationV = VectorLoad(&deltaRotation.X);
+		const VectorRegister4Double gizmoLocationV = VectorLoadFloat3_W0(&gizmoLocation.X);
+		const VectorRegister4Double deltaScaleV = VectorLoadFloat3_W0(&deltaScale.X);
+
+		//Gizmo Location + deltaTransform Location Offset, the location from the Gizmo to the Object is added to it
+		const VectorRegister4Double offsetV = VectorAdd(gizmoLocationV, VectorLoadFloat3_W0(&deltaLocation.X));
+
+		for (int32 i = begin; i < end; ++i)
+		{
+			const VectorRegister4Double rotationV = VectorLoad(&rotations[i].X);
+
+			//location from Gizmo to Object, optionally rotated around the Gizmo
+			VectorRegister4Double locationV = VectorSubtract(VectorLoadFloat3_W0(&locations[i].X), gizmoLocationV);
+			if (bRotateAroundGizmo)
+				locationV = VectorQuaternionRotateVector(deltaRotationV, locationV);
+
+			//DeltaScale is Unrotated Scale to Get Local Scale since World Scale is not supported
+			const VectorRegister4Double scaleV = VectorAdd(VectorLoadFloat3_W0(&scales[i].X)
+				, VectorQuaternionInverseRotateVector(rotationV, deltaScaleV));
+
+			VectorStore(VectorQuaternionMultiply2(deltaRotationV, rotationV), &rotations[i].X);
+			VectorStoreFloat3(VectorAdd(locationV, offsetV), &locations[i].X);
+			VectorStoreFloat3(scaleV, &scales[i].X);
 		}
-		else
+	};
+
+	if (numRows < TransformerTool::MinParallelComponents)
+	{
+		computeTransforms(0, numRows);
+	}
+	else
+	{
+		const int32 numTasks = FMath::DivideAndRoundUp(numRows, TransformerTool::ComponentsPerTask);
+		ParallelFor(numTasks, [&](int32 task)
 		{
-			RTT_LOG(Warning, "Transform will not affect Component [%s] as it is NOT Moveable!", *sc->GetName());
+			const int32 begin = task * TransformerTool::ComponentsPerTask;
+			computeTransforms(begin, FMath::Min(begin + TransformerTool::ComponentsPerTask, numRows));
+		});
+	}
+
+	/* COMMIT them on the game thread */
+	//render transforms are only marked dirty here and sent once at the end of the frame.
+	//Every Component defers its child, bounds and overlap updates until all of them moved,
+	//the scopes are emplaced in place and closed in reverse order as the engine expects of nested scopes
+	const bool bSnapping = snappingEnabled && *snappingEnabled && snappingValue;
+	TArray<TOptional<FScopedMovementUpdate>> movementScopes;
+	movementScopes.SetNum(numComponents);
+	for (int32 i = 0; i < numComponents; ++i)
+	{
+		USceneComponent* sc = DeltaBatch.Components[i];
+		movementScopes[i].Emplace(sc, EScopedUpdate::DeferredUpdates);
+		FTransform newTransform(rotations[i], locations[i], scales[i]);
+
+		/* SNAPPING LOGIC PER COMPONENT */
+		if (bSnapping)
+			newTransform = Gizmo->GetSnappedTransformPerComponent(sc->GetComponentTransform()
+				, newTransform, CurrentDomain, *snappingValue);
+
+		//changing the Mobility recreates the render state, only Components forced to move need it
+		if (sc->Mobility != EComponentMobility::Type::Movable)
+			sc->SetMobility(EComponentMobility::Type::Movable);
+		SetTransform(sc, newTransform);
+	}
+
+	for (int32 i = numComponents - 1; i >= 0; --i)
+		movementScopes[i].Reset();
+
+	//instances are written into the instance buffers, every component touched updates its render state once
+	TArray<UInstancedStaticMeshComponent*, TInlineAllocator<8>> instancedComponents;
+	for (int32 i = numComponents; i < numRows; ++i)
+	{
+		const FBuildingInstance& instance = DeltaBatch.Instances[i - numComponents];
+		FTransform newTransform(rotations[i], locations[i], scales[i]);
+
+		if (bSnapping)
+		{
+			FTransform instanceTransform;
+			instance.GetTransform(instanceTransform);
+			newTransform = Gizmo->GetSnappedTransformPerComponent(instanceTransform
+				, newTransform, CurrentDomain, *snappingValue);
 		}
-			
+
+		instance.Component->UpdateInstanceTransform(instance.Index, newTransform, true, false, true);
+		instancedComponents.AddUnique(instance.Component);
 	}
+
+	for (UInstancedStaticMeshComponent* instancedComponent : instancedComponents)
+		instancedComponent->MarkRenderStateDirty();
+
+	//a Gizmo placed on an instance follows it through the Pivot of its manager
+	if (ABuildingInstanceManager* manager = Cast<ABuildingInstanceManager>(Gizmo->GetAttachParentActor()))
+		manager->UpdatePivot();
+}
+
+bool UTransformerTool::TraceGizmo(const FVector& StartLocation, const FVector& EndLocation)
+{
+	if (!Gizmo.IsValid()) return false;
+
+	ETransformationDomain domain = Gizmo->TraceDomain(StartLocation, EndLocation);
+	if (domain == ETransformationDomain::TD_None) return false;
+
+	ClearDomain();
+	SetDomain(domain);
+	return true;
 }
 
 bool UTransformerTool::HandleTracedObjects(const TArray<FHitResult>& HitResults
@@ -467,6 +741,14 @@ bool UTransformerTool::HandleTracedObjects(const TArray<FHitResult>& HitResults
 			continue; //ignore other Gizmos.
 		}
 
+		//an instance placed by a Building Instance Manager is selected on its own, whether Component Based or not
+		const FBuildingInstance instance(Cast<UHierarchicalInstancedStaticMeshComponent>(hits.GetComponent()), hits.Item);
+		if (instance.GetManager() && instance.IsValid())
+		{
+			SelectInstance(instance, bAppendToList);
+			return true;
+		}
+
 		if (bComponentBased)
 			SelectComponent(Cast<USceneComponent>(hits.GetComponent()), bAppendToList);
 		else
@@ -480,25 +762,28 @@ bool UTransformerTool::HandleTracedObjects(const TArray<FHitResult>& HitResults
 
 void UTransformerTool::SetComponentBased(bool bIsComponentBased)
 {
-	auto selectedComponents = DeselectAll();
-	bComponentBased = bIsComponentBased;
-	if(bComponentBased)
-		SelectMultipleComponents(selectedComponents, false);
-	else
 	{
-		TArray<AActor*> actors;
-		for (auto& c : selectedComponents)
-			actors.Add(c->GetOwner());
-		SelectMultipleActors(actors, false);
+		//the Gizmo keeps its place if the same objects end up selected
+		FGizmoUpdateBatch batch(this);
+
+		auto selectedInstances = SelectedInstances.ToArray();
+		auto selectedComponents = DeselectAll();
+		bComponentBased = bIsComponentBased;
+		if(bComponentBased)
+			SelectMultipleComponents(selectedComponents, false);
+		else
+		{
+			TArray<AActor*> actors;
+			for (auto& c : selectedComponents)
+				actors.Add(c->GetOwner());
+			SelectMultipleActors(actors, false);
+		}
+
+		//instances are selected the same way in both modes
+		SelectMultipleInstances(selectedInstances, true);
 	}
 
-    // added by Talad
-    if (Gizmo.IsValid() && playerController)
-    {
-        Gizmo->ScaleGizmoScene(playerController->PlayerCameraManager->GetCameraLocation()
-            , playerController->PlayerCameraManager->GetActorForwardVector()
-            , playerController->PlayerCameraManager->GetFOVAngle());
-    }
+	ScaleGizmoToCamera();
 
 }
 
@@ -522,13 +807,7 @@ void UTransformerTool::SetTransformationType(ETransformationType TransformationT
 
 	UpdateGizmoPlacement();
 
-    // added by Talad
-    if (Gizmo.IsValid() && playerController)
-    {
-        Gizmo->ScaleGizmoScene(playerController->PlayerCameraManager->GetCameraLocation()
-            , playerController->PlayerCameraManager->GetActorForwardVector()
-            , playerController->PlayerCameraManager->GetFOVAngle());
-    }
+	ScaleGizmoToCamera();
 }
 
 void UTransformerTool::SetSnappingEnabled(ETransformationType TransformationType, bool bSnappingEnabled)
@@ -544,14 +823,19 @@ void UTransformerTool::SetSnappingValue(ETransformationType TransformationType,
 void UTransformerTool::GetSelectedComponents(TArray<class USceneComponent*>& outComponentList
 	, USceneComponent*& outGizmoPlacedComponent) const
 {
-	outComponentList = SelectedComponents;
+	outComponentList = SelectedComponents.ToArray();
 	if (Gizmo.IsValid())
 		outGizmoPlacedComponent = Gizmo->GetParentComponent();
 }
 
 TArray<USceneComponent*> UTransformerTool::GetSelectedComponents() const
 {
-	return SelectedComponents;
+	return SelectedComponents.ToArray();
+}
+
+TArray<FBuildingInstance> UTransformerTool::GetSelectedInstances() const
+{
+	return SelectedInstances.ToArray();
 }
 
 void UTransformerTool::SelectComponent(class USceneComponent* Component
@@ -561,18 +845,16 @@ void UTransformerTool::SelectComponent(class USceneComponent* Component
 
 	if (ShouldSelect(Component->GetOwner(), Component))
 	{
-		if (false == bAppendToList)
-			DeselectAll();
-		AddComponent_Internal(SelectedComponents, Component);
-		UpdateGizmoPlacement();
+		{
+			//the Gizmo is not destroyed by DeselectAll just to be spawned again
+			FGizmoUpdateBatch batch(this);
+			if (false == bAppendToList)
+				DeselectAll();
+			AddComponent_Internal(SelectedComponents, Component);
+			UpdateGizmoPlacement();
+		}
 
-        // added by Talad
-        if (Gizmo.IsValid() && playerController)
-        {
-            Gizmo->ScaleGizmoScene(playerController->PlayerCameraManager->GetCameraLocation()
-                , playerController->PlayerCameraManager->GetActorForwardVector()
-                , playerController->PlayerCameraManager->GetFOVAngle());
-        }
+		ScaleGizmoToCamera();
 	}
 }
 
@@ -583,24 +865,24 @@ void UTransformerTool::SelectActor(AActor* Actor
 
 	if (ShouldSelect(Actor, Actor->GetRootComponent()))
 	{
-		if (false == bAppendToList)
-			DeselectAll();
-		AddComponent_Internal(SelectedComponents, Actor->GetRootComponent());
-		UpdateGizmoPlacement();
+		{
+			//the Gizmo is not destroyed by DeselectAll just to be spawned again
+			FGizmoUpdateBatch batch(this);
+			if (false == bAppendToList)
+				DeselectAll();
+			AddComponent_Internal(SelectedComponents, Actor->GetRootComponent());
+			UpdateGizmoPlacement();
+		}
 
-        // added by Talad
-        if (Gizmo.IsValid() && playerController)
-        {
-            Gizmo->ScaleGizmoScene(playerController->PlayerCameraManager->GetCameraLocation()
-                , playerController->PlayerCameraManager->GetActorForwardVector()
-                , playerController->PlayerCameraManager->GetFOVAngle());
-        }
+		ScaleGizmoToCamera();
 	}
 }
 
 void UTransformerTool::SelectMultipleComponents(const TArray<USceneComponent*>& Components
 	, bool bAppendToList)
 {
+	FGizmoUpdateBatch batch(this);
+
 	bool bValidList = false;
 
 	for (auto& c : Components)
@@ -624,6 +906,8 @@ void UTransformerTool::SelectMultipleComponents(const TArray<USceneComponent*>&
 void UTransformerTool::SelectMultipleActors(const TArray<AActor*>& Actors
 	, bool bAppendToList)
 {
+	FGizmoUpdateBatch batch(this);
+
 	bool bValidList = false;
 	for (auto& a : Actors)
 	{
@@ -643,6 +927,50 @@ void UTransformerTool::SelectMultipleActors(const TArray<AActor*>& Actors
 	if(bValidList) UpdateGizmoPlacement();
 }
 
+void UTransformerTool::SelectInstance(const FBuildingInstance& Instance
+	, bool bAppendToList)
+{
+	if (!Instance.IsValid()) return;
+
+	if (ShouldSelect(Instance.Component->GetOwner(), Instance.Component))
+	{
+		{
+			//the Gizmo is not destroyed by DeselectAll just to be spawned again
+			FGizmoUpdateBatch batch(this);
+			if (false == bAppendToList)
+				DeselectAll();
+			AddInstance_Internal(Instance);
+			UpdateGizmoPlacement();
+		}
+
+		ScaleGizmoToCamera();
+	}
+}
+
+void UTransformerTool::SelectMultipleInstances(const TArray<FBuildingInstance>& Instances
+	, bool bAppendToList)
+{
+	FGizmoUpdateBatch batch(this);
+
+	bool bValidList = false;
+	for (auto& i : Instances)
+	{
+		if (!i.IsValid()) continue;
+		if (!ShouldSelect(i.Component->GetOwner(), i.Component)) continue;
+
+		if (false == bAppendToList)
+		{
+			DeselectAll();
+			bAppendToList = true;
+			//only run once. This is not place outside in case a list is empty or contains only invalid instances
+		}
+
+		bValidList = true;
+		AddInstance_Internal(i);
+	}
+	if(bValidList) UpdateGizmoPlacement();
+}
+
 void UTransformerTool::DeselectComponent(USceneComponent* Component)
 {
 	if (!Component) return;
@@ -656,17 +984,38 @@ void UTransformerTool::DeselectActor(AActor* Actor)
 		DeselectComponent(Actor->GetRootComponent());
 }
 
+void UTransformerTool::DeselectInstance(const FBuildingInstance& Instance)
+{
+	if (SelectedInstances.Remove(Instance))
+		UpdateGizmoPlacement();
+}
+
 TArray<USceneComponent*> UTransformerTool::DeselectAll(bool bDestroyDeselected)
 {
-	TArray<USceneComponent*> componentsToDeselect = SelectedComponents;
-	for (auto& i : componentsToDeselect)
-		DeselectComponent(i);
-		//calling internal so as not to modify SelectedComponents until the last bit!
-	SelectedComponents.Empty();
+	FGizmoUpdateBatch batch(this);
+
+	TArray<USceneComponent*> componentsToDeselect = SelectedComponents.ToArray();
+	TArray<FBuildingInstance> instancesToDeselect = SelectedInstances.ToArray();
+	SelectedComponents.Reset();
+	SelectedInstances.Reset();
 	UpdateGizmoPlacement();
 
 	if (bDestroyDeselected)
 	{
+		//all at once per manager, removing one instance can change the index of another
+		TSet<ABuildingInstanceManager*> managers;
+		for (const FBuildingInstance& instance : instancesToDeselect)
+		{
+			if (ABuildingInstanceManager* manager = instance.GetManager())
+				managers.Add(manager);
+		}
+		for (ABuildingInstanceManager* manager : managers)
+			manager->RemoveBuildings(instancesToDeselect);
+
+		//the sensors a destroyed building shaded are evaluated again, like for a move to nowhere
+		UWorld* world = GetWorld();
+		USceneChangeTracker* changeTracker = world ? world->GetSubsystem<USceneChangeTracker>() : nullptr;
+
 		for (auto& c : componentsToDeselect)
 		{
 			if (!IsValid(c)) continue; //a component that was in the same actor destroyed will be pending kill
@@ -674,9 +1023,17 @@ TArray<USceneComponent*> UTransformerTool::DeselectAll(bool bDestroyDeselected)
 			{
 				//We destroy the actor if no components are left to destroy, or the system is currently ActorBased
 				if (bComponentBased && actor->GetComponents().Num() > 1)
+				{
+					if (changeTracker)
+						changeTracker->NotifyMoving(c);
 					c->DestroyComponent(true);
+				}
 				else
+				{
+					if (changeTracker)
+						changeTracker->NotifyMoving(actor->GetRootComponent());
 					actor->Destroy();
+				}
 			}
 		}
 	}
@@ -684,93 +1041,155 @@ TArray<USceneComponent*> UTransformerTool::DeselectAll(bool bDestroyDeselected)
 	return componentsToDeselect;
 }
 
-void UTransformerTool::AddComponent_Internal(TArray<USceneComponent*>& OutComponentList
+void UTransformerTool::AddComponent_Internal(FSelectionSet& OutComponentList
 	, USceneComponent* Component)
 {
 	//if (!Component) return; //assumes that previous have checked, since this is Internal.
 
-	int32 Index = OutComponentList.Find(Component);
-
-	if (INDEX_NONE == Index) //Component is not in list
-	{
-		OutComponentList.Emplace(Component);
-	}
-	else if (bToggleSelectedInMultiSelection)
-		DeselectComponentAtIndex_Internal(OutComponentList, Index);
+	//Add fails if the Component is already in the list
+	if (!OutComponentList.Add(Component) && bToggleSelectedInMultiSelection)
+		OutComponentList.Remove(Component);
 }
 
-void UTransformerTool::DeselectComponent_Internal(TArray<USceneComponent*>& OutComponentList
+void UTransformerTool::DeselectComponent_Internal(FSelectionSet& OutComponentList
 	, USceneComponent* Component)
 {
 	//if (!Component) return; //assumes that previous have checked, since this is Internal.
 
-	int32 Index = OutComponentList.Find(Component);
-	if (INDEX_NONE != Index)
-		DeselectComponentAtIndex_Internal(OutComponentList, Index);
+	OutComponentList.Remove(Component);
 }
 
-void UTransformerTool::DeselectComponentAtIndex_Internal(
-	TArray<USceneComponent*>& OutComponentList
-	, int32 Index)
+void UTransformerTool::AddInstance_Internal(const FBuildingInstance& Instance)
 {
-	//if (!Component) return; //assumes that previous have checked, since this is Internal.
-	if (OutComponentList.IsValidIndex(Index))
+	//Add fails if the Instance is already in the list
+	if (!SelectedInstances.Add(Instance) && bToggleSelectedInMultiSelection)
+		SelectedInstances.Remove(Instance);
+}
+
+void UTransformerTool::SetGizmo()
+{
+	SCOPE_CYCLE_COUNTER(STAT_GizmoSwitch);
+
+	//If there are selected components, the Gizmo of the current transformation is shown
+	ABaseGizmo* newGizmo = SelectedComponents.Num() + SelectedInstances.Num() > 0 ? GetPooledGizmo(CurrentTransformation) : nullptr;
+	if (Gizmo.Get() == newGizmo) return;
+
+	//the previous one is hidden, not destroyed
+	if (Gizmo.IsValid())
+		SetGizmoActive(Gizmo.Get(), false);
+
+	Gizmo = newGizmo;
+	if (newGizmo)
+		SetGizmoActive(newGizmo, true);
+}
+
+ABaseGizmo* UTransformerTool::GetPooledGizmo(ETransformationType TransformationType)
+{
+	UClass* GizmoClass = GetGizmoClass(TransformationType);
+	if (!GizmoClass) return nullptr;
+
+	TWeakObjectPtr<ABaseGizmo>& pooledGizmo = GizmoPool.FindOrAdd(TransformationType);
+	if (pooledGizmo.IsValid())
 	{
-		USceneComponent* Component = OutComponentList[Index];
-		OutComponentList.RemoveAt(Index);
+		if (pooledGizmo->GetClass() == GizmoClass)
+			return pooledGizmo.Get();
+
+		//the Gizmo Classes were changed (@see SetupGizmos)
+		if (Gizmo == pooledGizmo)
+			Gizmo.Reset();
+		pooledGizmo->Destroy();
+		pooledGizmo.Reset();
 	}
 
+	UWorld* world = GetWorld();
+	if (!world) return nullptr;
+
+	ABaseGizmo* newGizmo = Cast<ABaseGizmo>(world->SpawnActor(GizmoClass));
+	if (!newGizmo) return nullptr;
+	INC_DWORD_STAT(STAT_GizmosSpawned);
+
+	newGizmo->OnGizmoStateChange.AddDynamic(this, &UTransformerTool::OnGizmoStateChanged);
+
+	//previews the analysis while dragging and commits it when the drag ends
+	if (USceneChangeTracker* changeTracker = world->GetSubsystem<USceneChangeTracker>())
+		newGizmo->OnGizmoStateChange.AddDynamic(changeTracker, &USceneChangeTracker::HandleGizmoStateChange);
+
+	//spawned hidden, SetGizmo shows it
+	SetGizmoActive(newGizmo, false);
+	pooledGizmo = newGizmo;
+	return newGizmo;
 }
 
-void UTransformerTool::SetGizmo()
+void UTransformerTool::DestroyPooledGizmos()
 {
-
-	//If there are selected components, then we see whether we need to create a new gizmo.
-	if (SelectedComponents.Num() > 0)
+	for (TPair<ETransformationType, TWeakObjectPtr<ABaseGizmo>>& pooledGizmo : GizmoPool)
 	{
-		bool bCreateGizmo = true;
-		if (Gizmo.IsValid())
-		{
-			if (CurrentTransformation == Gizmo->GetGizmoType())
-			{
-				bCreateGizmo = false; // do not create gizmo if there is already a matching gizmo
-			}
-			else
-			{
-				// Destroy the current gizmo as the transformation types do not match
-				Gizmo->Destroy();
-				Gizmo.Reset();
-			}
-		}
+		if (pooledGizmo.Value.IsValid())
+			pooledGizmo.Value->Destroy();
+	}
+	GizmoPool.Reset();
+	Gizmo.Reset();
+}
 
-		if (bCreateGizmo)
-		{
-			if (UWorld* world = GetWorld())
-			{
-				UClass* GizmoClass = GetGizmoClass(CurrentTransformation);
-				if (GizmoClass)
-				{
-					Gizmo = Cast<ABaseGizmo>(world->SpawnActor(GizmoClass));
-					Gizmo->OnGizmoStateChange.AddDynamic(this, &UTransformerTool::OnGizmoStateChanged);
-				}
-			}
-		}
+void UTransformerTool::SetGizmoActive(ABaseGizmo* InGizmo, bool bActive)
+{
+	if (!InGizmo) return;
+
+	InGizmo->SetActorHiddenInGame(!bActive);
+	InGizmo->SetActorEnableCollision(bActive);
+	InGizmo->SetActorTickEnabled(bActive);
+	if (!bActive)
+	{
+		//a hidden Gizmo does not keep transforming
+		if (InGizmo->GetTransformProgressState())
+			InGizmo->SetTransformProgressState(false, ETransformationDomain::TD_None);
+		InGizmo->DetachFromActor(FDetachmentTransformRules::KeepWorldTransform);
 	}
-	//Since there are no selected components, we must destroy any gizmos present
-	else
+}
+
+FGizmoUpdateBatch::FGizmoUpdateBatch(UTransformerTool* InTool)
+	: Tool(InTool)
+{
+	++Tool->GizmoUpdateBatchDepth;
+}
+
+FGizmoUpdateBatch::~FGizmoUpdateBatch()
+{
+	if (--Tool->GizmoUpdateBatchDepth == 0 && Tool->bGizmoUpdatePending)
 	{
-		if (Gizmo.IsValid())
-		{
-			Gizmo->Destroy();
-			Gizmo.Reset();
-		}
+		Tool->bGizmoUpdatePending = false;
+		Tool->UpdateGizmoPlacement();
 	}
+}
+
+void UTransformerTool::ScaleGizmoToCamera()
+{
+	if (!Gizmo.IsValid() || !playerController || !playerController->PlayerCameraManager) return;
 
+	if (CameraSnapshot.FrameNumber != GFrameCounter)
+	{
+		APlayerCameraManager* cameraManager = playerController->PlayerCameraManager;
+		CameraSnapshot.Location = cameraManager->GetCameraLocation();
+		CameraSnapshot.Forward = cameraManager->GetActorForwardVector();
+		CameraSnapshot.FieldOfView = cameraManager->GetFOVAngle();
+		CameraSnapshot.FrameNumber = GFrameCounter;
+	}
 
+	Gizmo->ScaleGizmoScene(CameraSnapshot.Location, CameraSnapshot.Forward, CameraSnapshot.FieldOfView);
 }
 
 void UTransformerTool::UpdateGizmoPlacement()
 {
+	if (GizmoUpdateBatchDepth > 0)
+	{
+		bGizmoUpdatePending = true;
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_GizmoPlacementUpdate);
+	INC_DWORD_STAT(STAT_GizmoPlacementUpdates);
+	++TransformerTool::NumPlacementUpdates;
+
 	SetGizmo();
 	//means that there are no active gizmos (no selections) so nothing to do in this func
 	if (!Gizmo.IsValid()) return;
@@ -782,13 +1201,23 @@ void UTransformerTool::UpdateGizmoPlacement()
 	Gizmo->SetActorTransform(FTransform()); //Reset Transformation
 
 	USceneComponent* ComponentToAttachTo = nullptr;
+	FBuildingInstance InstanceToAttachTo;
 
 	switch (GizmoPlacement)
 	{
 	case EGizmoPlacement::GP_OnFirstSelection: 
-		ComponentToAttachTo = SelectedComponents[0]; break;
+		ComponentToAttachTo = SelectedComponents.First();
+		InstanceToAttachTo = SelectedInstances.First(); break;
 	case EGizmoPlacement::GP_OnLastSelection:
-		ComponentToAttachTo = SelectedComponents.Last(); break;
+		ComponentToAttachTo = SelectedComponents.Last();
+		InstanceToAttachTo = SelectedInstances.Last(); break;
+	}
+
+	//Instances have no Component of their own, the Pivot of their manager is moved onto them
+	if (!ComponentToAttachTo)
+	{
+		if (ABuildingInstanceManager* manager = InstanceToAttachTo.GetManager())
+			ComponentToAttachTo = manager->PlacePivot(InstanceToAttachTo);
 	}
 
 	if (ComponentToAttachTo)
@@ -807,10 +1236,11 @@ void UTransformerTool::LogSelectedComponents()
 
 	RTT_LOG(Log, "******************** SELECTED COMPONENTS LOG START ********************");
 	RTT_LOG(Log, "   * Selected Component Count: %d", SelectedComponents.Num());
+	RTT_LOG(Log, "   * Selected Instance Count: %d", SelectedInstances.Num());
 	RTT_LOG(Log, "   * -------------------------------- ");
-	for (int32 i = 0; i < SelectedComponents.Num(); ++i)
+	int32 i = 0;
+	for (USceneComponent* cmp : SelectedComponents)
 	{
-		USceneComponent* cmp = SelectedComponents[i];
 		FString message = "Component: ";
 		if (cmp)
 		{
@@ -823,7 +1253,7 @@ void UTransformerTool::LogSelectedComponents()
 		else
 			message += TEXT("[INVALID]");
 
-		RTT_LOG(Log, "   * [%d] %s", i, *message);
+		RTT_LOG(Log, "   * [%d] %s", i++, *message);
 	}
 
 	RTT_LOG(Log, "******************** SELECTED COMPONENTS LOG END   ********************");
@@ -844,6 +1274,185 @@ void UTransformerTool::SetupGizmos(APlayerController* pController, UClass* trans
     TranslationGizmoClass = translationClass;
     RotationGizmoClass = rotationClass;
     ScaleGizmoClass = scaleClass;
+
+	//Gizmos of the previous classes would stay hidden in the world, the current one is spawned again from the new class
+	DestroyPooledGizmos();
+	UpdateGizmoPlacement();
+}
+
+/**
+ * LuminaCity.SelectionBenchmark [Count]
+ * Spawns Count movable actors (1000 by default) and logs the time and the number of Gizmo placement updates
+ * of selecting them, switching to and from Component based selection and deselecting them all at once,
+ * next to deselecting them one by one. The first selection includes spawning the Gizmo.
+ */
+static void RunSelectionBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	if (!World)
+	{
+		UE_LOG(LogLuminaCity, Warning, TEXT("SelectionBenchmark needs a world"));
+		return;
+	}
+
+	const int32 Count = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 1000;
+
+	TArray<AActor*> Actors;
+	TArray<USceneComponent*> Components;
+	for (int32 i = 0; i < Count; ++i)
+	{
+		AStaticMeshActor* Actor = World->SpawnActor<AStaticMeshActor>(FVector(i * 100.0, 0.0, 0.0), FRotator::ZeroRotator);
+		if (!Actor) continue;
+
+		Actor->SetMobility(EComponentMobility::Movable);
+		Actors.Add(Actor);
+		Components.Add(Actor->GetRootComponent());
+	}
+
+	UTransformerTool* Tool = NewObject<UTransformerTool>(World);
+
+	auto Measure = [](const TCHAR* Phase, TFunctionRef<void()> Run)
+	{
+		const uint32 FirstUpdate = TransformerTool::NumPlacementUpdates;
+		const double StartTime = FPlatformTime::Seconds();
+		Run();
+		UE_LOG(LogLuminaCity, Display, TEXT("%-32s %9.3f ms, %5u placement updates")
+			, Phase, (FPlatformTime::Seconds() - StartTime) * 1000.0, TransformerTool::NumPlacementUpdates - FirstUpdate);
+	};
+
+	UE_LOG(LogLuminaCity, Display, TEXT("Selection benchmark, %d components:"), Components.Num());
+	Measure(TEXT("SelectMultipleComponents"), [&]() { Tool->SelectMultipleComponents(Components); });
+	Measure(TEXT("SetComponentBased(true)"), [&]() { Tool->SetComponentBased(true); });
+	Measure(TEXT("SetComponentBased(false)"), [&]() { Tool->SetComponentBased(false); });
+	Measure(TEXT("DeselectAll"), [&]() { Tool->DeselectAll(); });
+	Measure(TEXT("SelectMultipleActors"), [&]() { Tool->SelectMultipleActors(Actors); });
+
+	//one update per call, what DeselectAll cost before it was batched
+	Measure(TEXT("DeselectComponent one by one"), [&]()
+	{
+		for (USceneComponent* Component : Components)
+			Tool->DeselectComponent(Component);
+	});
+
+	Tool->DestroyPooledGizmos();
+	for (AActor* Actor : Actors)
+		Actor->Destroy();
+}
+
+static FAutoConsoleCommandWithWorldAndArgs SelectionBenchmarkCommand(
+	TEXT("LuminaCity.SelectionBenchmark"),
+	TEXT("Logs the time and Gizmo placement updates of selecting and deselecting many components. Optional argument: number of components"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunSelectionBenchmark));
+
+/**
+ * LuminaCity.GizmoSwitchBenchmark [Switches]
+ * Selects one actor and cycles the Transformation (W, E, R) Switches times (300 by default), once with the pooled Gizmos
+ * and once destroying them before every switch, so every switch destroys one Gizmo and spawns another as before pooling.
+ */
+static void RunGizmoSwitchBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	AStaticMeshActor* Actor = World ? World->SpawnActor<AStaticMeshActor>() : nullptr;
+	if (!Actor)
+	{
+		UE_LOG(LogLuminaCity, Warning, TEXT("GizmoSwitchBenchmark needs a world"));
+		return;
+	}
+	Actor->SetMobility(EComponentMobility::Movable);
+
+	const int32 Switches = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 300;
+	const ETransformationType Types[] = { ETransformationType::TT_Translation, ETransformationType::TT_Rotation, ETransformationType::TT_Scale };
+
+	UTransformerTool* Tool = NewObject<UTransformerTool>(World);
+	Tool->SelectActor(Actor);
+
+	//every Gizmo spawned once, so the pooled run does not count the first spawns. It ends on the last type, every switch below changes it
+	for (ETransformationType Type : Types)
+		Tool->SetTransformationType(Type);
+	int32 NextType = 0;
+
+	auto Measure = [&](const TCHAR* Name, bool bRespawn)
+	{
+		double TotalMs = 0.0;
+		double WorstMs = 0.0;
+		for (int32 i = 0; i < Switches; ++i)
+		{
+			const double StartTime = FPlatformTime::Seconds();
+			if (bRespawn)
+				Tool->DestroyPooledGizmos();
+			Tool->SetTransformationType(Types[NextType++ % UE_ARRAY_COUNT(Types)]);
+
+			const double SwitchMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+			TotalMs += SwitchMs;
+			WorstMs = FMath::Max(WorstMs, SwitchMs);
+		}
+		UE_LOG(LogLuminaCity, Display, TEXT("%-24s %d switches: %.4f ms average, %.4f ms worst")
+			, Name, Switches, TotalMs / Switches, WorstMs);
+	};
+
+	Measure(TEXT("Pooled Gizmos"), false);
+	Measure(TEXT("Spawned per switch"), true);
+
+	Tool->DestroyPooledGizmos();
+	Actor->Destroy();
 }
 
+static FAutoConsoleCommandWithWorldAndArgs GizmoSwitchBenchmarkCommand(
+	TEXT("LuminaCity.GizmoSwitchBenchmark"),
+	TEXT("Logs the latency of switching the Transformation with pooled Gizmos and with a Gizmo spawned per switch. Optional argument: number of switches"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunGizmoSwitchBenchmark));
+
+/**
+ * LuminaCity.DragBenchmark [Count] [Frames]
+ * Spawns Count movable actors (2000 by default), selects them and logs the average and worst time of Frames
+ * (120 by default) calls of ApplyDeltaTransform, as a drag of the Translation Gizmo would make one per frame.
+ */
+static void RunDragBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	if (!World)
+	{
+		UE_LOG(LogLuminaCity, Warning, TEXT("DragBenchmark needs a world"));
+		return;
+	}
+
+	const int32 Count = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 2000;
+	const int32 Frames = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 120;
+
+	TArray<AActor*> Actors;
+	for (int32 i = 0; i < Count; ++i)
+	{
+		AStaticMeshActor* Actor = World->SpawnActor<AStaticMeshActor>(FVector(i * 100.0, 0.0, 0.0), FRotator::ZeroRotator);
+		if (!Actor) continue;
+
+		Actor->SetMobility(EComponentMobility::Movable);
+		Actors.Add(Actor);
+	}
+
+	UTransformerTool* Tool = NewObject<UTransformerTool>(World);
+	Tool->SetTransformationType(ETransformationType::TT_Translation);
+	Tool->SelectMultipleActors(Actors);
+
+	const FTransform Delta(FVector(1.0, 0.0, 0.0));
+	double TotalMs = 0.0;
+	double WorstMs = 0.0;
+	for (int32 i = 0; i < Frames; ++i)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		Tool->ApplyDeltaTransform(Delta);
+
+		const double FrameMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+		TotalMs += FrameMs;
+		WorstMs = FMath::Max(WorstMs, FrameMs);
+	}
+	UE_LOG(LogLuminaCity, Display, TEXT("Drag benchmark, %d components, %d frames: %.3f ms average, %.3f ms worst")
+		, Actors.Num(), Frames, TotalMs / Frames, WorstMs);
+
+	Tool->DestroyPooledGizmos();
+	for (AActor* Actor : Actors)
+		Actor->Destroy();
+}
+
+static FAutoConsoleCommandWithWorldAndArgs DragBenchmarkCommand(
+	TEXT("LuminaCity.DragBenchmark"),
+	TEXT("Logs the time of dragging many selected components with the Translation Gizmo. Optional arguments: number of components, number of frames"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunDragBenchmark));
+
 #undef RTT_LOG
\ No newline at end of file
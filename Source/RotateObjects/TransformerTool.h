@@ -26,6 +26,8 @@ SOFTWARE.
 
 #include "CoreMinimal.h"
 #include "GameFramework/Pawn.h"
+#include "SelectionSet.h"
+#include "BuildingInstanceManager.h"
 #include "TransformerTool.generated.h"
 
 
@@ -73,6 +75,42 @@ enum class EGizmoPlacement : uint8
 	GP_OnLastSelection		UMETA(DisplayName = "On Last Selection"),
 };
 
+//View of the Player Camera Manager, read at most once per frame
+struct FGizmoCameraSnapshot
+{
+	FVector Location = FVector::ZeroVector;
+	FVector Forward = FVector::ForwardVector;
+	float FieldOfView = 90.f;
+
+	//GFrameCounter of the frame it was read in
+	uint64 FrameNumber = MAX_uint64;
+};
+
+/**
+ * Scratch arrays of ApplyDeltaTransform, one array per transform part so the new transforms can be computed with vector math
+ * in a single pass. Kept by the tool so dragging a large selection does not allocate every frame.
+ * The rows of the Components come first, then the rows of the Instances.
+ */
+struct FDeltaTransformBatch
+{
+	TArray<class USceneComponent*> Components;
+	TArray<FBuildingInstance> Instances;
+	TArray<FQuat> Rotations;
+	TArray<FVector> Locations;
+	TArray<FVector> Scales;
+
+	void Reset()
+	{
+		Components.Reset();
+		Instances.Reset();
+		Rotations.Reset();
+		Locations.Reset();
+		Scales.Reset();
+	}
+
+	int32 Num() const { return Components.Num() + Instances.Num(); }
+};
+
 UCLASS(Blueprintable)
 class  UTransformerTool : public UObject
 {
@@ -84,14 +122,30 @@ public:
 	virtual void GetLifetimeReplicatedProps(
 		TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 
+	//The pooled Gizmos are destroyed with the tool
+	virtual void BeginDestroy() override;
+
+	/**
+	 * Removes the hits the tool cannot select, as every Trace does before selecting the first hit left.
+	 * Only filters with bIgnoreNonReplicatedObjects. Single pass, in place, keeps the order of the hits.
+	 */
+	void FilterHits(TArray<FHitResult>& outHits);
+
 private:
 
 	//Sets the Transform for a Given Component and calls the 
 	//Ufocusable transform function called if it implements the Interface
 	void SetTransform(class USceneComponent* Component, const FTransform& Transform);
 
-	//Used to Filter unwanted things from a list of OutHits.
-	void FilterHits(TArray<FHitResult>& outHits);
+	//IsSupportedForNetworking of an Actor or Component, cached (@see ClearReplicationCache)
+	bool IsSupportedForNetworkingCached(const UObject* Object);
+
+	/**
+	 * First stage of every Trace: only the Components of the current Gizmo, on the Gizmo Trace Channel.
+	 * If a Domain is hit it becomes the Current Domain and the Scene does not need to be traced.
+	 * @return whether a Gizmo Domain was hit
+	 */
+	bool TraceGizmo(const FVector& StartLocation, const FVector& EndLocation);
 
 public:
 
@@ -260,6 +314,35 @@ public:
 		, TArray<AActor*> IgnoredActors
 		, bool bAppendToList = false);
 
+	/**
+	 * Same as TraceByChannel, but Objects are found in the Building BVH of the World (see UBuildingBVHSubsystem)
+	 * instead of the Physics Scene. Only the Gizmo (Visibility Channel) is traced through Physics.
+
+	  * Note: This function does not Deselect the Objects selected if Trace doesn't select anything in any situation
+
+	 * @param StartLocation - the starting Location of the trace, in World Space
+	 * @param EndLocation - the ending location of the trace, in World Space
+	 * @param Ignored Actors	- The Actors to be Ignored during trace
+	 * @param bAppendToList - If a selection happens, whether to append to the previously selected components or not
+	 * @return bool Whether there was an Object traced successfully
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Transformer")
+	bool TraceBuildings(const FVector& StartLocation
+		, const FVector& EndLocation
+		, TArray<AActor*> IgnoredActors
+		, bool bAppendToList = false);
+
+	/**
+	 * TraceBuildings from the Mouse Position.
+
+	 * This function only does the actual trace if there is a Player Controller Set
+	 * @see SetupGizmos
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Transformer")
+	bool MouseTraceBuildings(float TraceDistance
+		, TArray<AActor*> IgnoredActors
+		, bool bAppendToList = false);
+
 
 	/**
 	 * If the Gizmo is currently in a Valid Domain,
@@ -295,6 +378,13 @@ public:
 	bool HandleTracedObjects(const TArray<FHitResult>& HitResults
 		, bool bAppendToList = false);
 
+	/**
+	 * Forgets which Actors / Components were found to support networking.
+	 * Needs to be called if the replication of an already traced object is turned on or off.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Replicated Runtime Transformer")
+	void ClearReplicationCache();
+
 	/*
 	 * Called when the Gizmo State has changed (i.e. Domain has changed)
 	 * @param GizmoType - the type of Gizmo that was changed (Translation, Rotation or Scale)
@@ -367,6 +457,10 @@ public:
 
 	TArray<class USceneComponent*> GetSelectedComponents() const;
 
+	//Gets the list of Selected Building Instances, in the order they were selected
+	UFUNCTION(BlueprintCallable, Category = "Runtime Transformer")
+	TArray<FBuildingInstance> GetSelectedInstances() const;
+
 public:
 
 
@@ -402,6 +496,23 @@ public:
 	void SelectMultipleActors(const TArray<AActor*>& Actors
 		, bool bAppendToList = false);
 
+	/**
+	 * Select Instance adds one instance of a Building Instance Manager to the list of instances that will be used for the Runtime Transforms.
+	 * Instances are selected on their own, in both Actor and Component based mode. The traces select the instance they hit.
+	 * @param Instance The instance to add to the list.
+	 * @param bAppendToList - If a selection happens, whether to append to the previously selected components and instances or not
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Transformer")
+	void SelectInstance(const FBuildingInstance& Instance, bool bAppendToList = false);
+
+	/**
+	 * Selects all the Instances in given list.
+	 * @see SelectInstance func
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Transformer")
+	void SelectMultipleInstances(const TArray<FBuildingInstance>& Instances
+		, bool bAppendToList = false);
+
 	/**
 	 * Deselects a given Component, if found on the list.
 	 * @param Component the Component to deselect
@@ -416,10 +527,17 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Runtime Transformer")
 	void DeselectActor(AActor* Actor);
 
+	/**
+	 * Deselects a given Instance, if found on the list.
+	 * @param Instance the Instance to deselect
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Transformer")
+	void DeselectInstance(const FBuildingInstance& Instance);
+
 	/*
-	* Deselects all the Selected Components that are in the list.
+	* Deselects all the Selected Components (and Instances) that are in the list.
 
-	* @param bDestroyComponents - whether to Deselect all Components and Destroy them!
+	* @param bDestroyComponents - whether to Deselect all Components and Destroy them! Selected Instances are removed from their manager
 
 	* @return the list of components that were Deselected. (list will be empty if bDestroyComponents is true)
 	*/
@@ -432,24 +550,34 @@ private:
 	The core functionality, but can be called by Selection of Multiple objects
 	so as to not call UpdateGizmo every time
 	*/
-	void AddComponent_Internal(TArray<class USceneComponent*>& OutComponentList
+	void AddComponent_Internal(FSelectionSet& OutComponentList
 		, class USceneComponent* Component);
 
 	/*
 	The core functionality, but can be called by Selection of Multiple objects
 	so as to not call UpdateGizmo every time
 	*/
-	void DeselectComponent_Internal(TArray<class USceneComponent*>& OutComponentList
+	void DeselectComponent_Internal(FSelectionSet& OutComponentList
 		, class USceneComponent* Component);
-	void DeselectComponentAtIndex_Internal(TArray<class USceneComponent*>& OutComponentList
-		, int32 Index);
+
+	//AddComponent_Internal for Building Instances
+	void AddInstance_Internal(const FBuildingInstance& Instance);
 
 	/**
-	 * Creates / Replaces Gizmo with the Current Transformation.
-	 * It destroys any current active gizmo to replace it.
+	 * Activates the pooled Gizmo of the Current Transformation (spawning it the first time), and deactivates
+	 * the previous one. Gizmos are hidden instead of destroyed, so switching Transformations does not spawn actors.
 	*/
 	void SetGizmo();
 
+	//The pooled Gizmo for a Transformation, spawned if there is none yet or its Gizmo Class changed
+	class ABaseGizmo* GetPooledGizmo(ETransformationType TransformationType);
+
+	//Shows / Hides a Gizmo and turns its collision on / off
+	void SetGizmoActive(class ABaseGizmo* InGizmo, bool bActive);
+
+	//Scales the Gizmo Scene for the Player Camera (@see ABaseGizmo::ScaleGizmoScene). Nothing is updated if neither moved
+	void ScaleGizmoToCamera();
+
 	/**
 	 * Updates the Gizmo Placement (Position)
 	 * Called when an object was selected, deselected
@@ -488,6 +616,10 @@ public:
     UFUNCTION(BlueprintCallable, Category = "Runtime Transformer")
     void SetupGizmos(APlayerController* playerController, UClass* translationClass, UClass* rotationClass, UClass* scaleClass);
 
+	//Destroys the pooled Gizmos, done by SetupGizmos and when the tool is destroyed. They are spawned again the next time one is needed
+	UFUNCTION(BlueprintCallable, Category = "Runtime Transformer")
+	void DestroyPooledGizmos();
+
 
 	//Networking Variables
 private:
@@ -502,6 +634,12 @@ private:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Replicated Runtime Transformer", meta = (AllowPrivateAccess = "true"))
 	bool bIgnoreNonReplicatedObjects;
 
+	//Whether each Actor / Component traced so far supports networking, so picking does not query it again on every click
+	TMap<TWeakObjectPtr<const UObject>, bool> NetworkSupportCache;
+
+	//Size of NetworkSupportCache at which the entries of destroyed objects are dropped
+	int32 NetworkSupportCachePruneSize;
+
 	/*
 	 * Optional minimum time to wait for all Cloned objects to fully replicate and are selectable.
 	 * It is not required, but there are occassions (especially when cloning multiple objects at once)
@@ -563,6 +701,15 @@ private:
 	UPROPERTY()
 	TWeakObjectPtr<class ABaseGizmo> Gizmo;
 
+	//One Gizmo per Transformation, spawned on first use and only hidden when not in use. Gizmo is one of these
+	TMap<ETransformationType, TWeakObjectPtr<class ABaseGizmo>> GizmoPool;
+
+	//The Player Camera of the current frame, shared by every ScaleGizmoToCamera in it
+	FGizmoCameraSnapshot CameraSnapshot;
+
+	//Selected Components and their transforms while ApplyDeltaTransform moves them
+	FDeltaTransformBatch DeltaBatch;
+
 	// Tell which Domain is Selected. If NONE, then that means that there is no Selected Objects, or
 	// that the Gizmo has not been hit yet.
 	ETransformationDomain CurrentDomain;
@@ -576,10 +723,16 @@ private:
 	ETransformationType CurrentTransformation;
 
 	/**
-	 * Array storing Selected Components. Although a quick O(1) removal is needed (like a Set),
-	 * it is Crucial that we maintain the order of the elements as they were selected
+	 * Set storing Selected Components. Adding, removing and finding are O(1),
+	 * and it is Crucial that we maintain the order of the elements as they were selected
 	 */
-	TArray<class USceneComponent*> SelectedComponents;
+	FSelectionSet SelectedComponents;
+
+	/**
+	 * Selected instances of Building Instance Managers, in the order they were selected.
+	 * The Gizmo is only placed on one of them if no Components are selected.
+	 */
+	TSelectionSet<FBuildingInstance> SelectedInstances;
 
 	/*
 	* Map storing the Snap values for each transformation
@@ -641,4 +794,26 @@ private:
 
     // player controller referenced by this tool
     APlayerController* playerController;
+
+	//Open FGizmoUpdateBatch scopes, UpdateGizmoPlacement is deferred while there are any
+	int32 GizmoUpdateBatchDepth;
+
+	//UpdateGizmoPlacement was called during a batch
+	bool bGizmoUpdatePending;
+
+	friend struct FGizmoUpdateBatch;
+};
+
+/**
+ * Batches selection changes: while a scope is alive UpdateGizmoPlacement only marks the Gizmo as needing an update,
+ * the outermost scope places the Gizmo (and shows or hides the pooled one, spawning it the first time) once when it ends.
+ * Scopes can be nested.
+ */
+struct FGizmoUpdateBatch
+{
+	explicit FGizmoUpdateBatch(UTransformerTool* InTool);
+	~FGizmoUpdateBatch();
+
+private:
+	UTransformerTool* Tool;
 };